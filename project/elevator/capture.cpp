@@ -0,0 +1,60 @@
+#include <elevator/capture.h>
+#include <cstring>
+#include <thread>
+
+namespace elevator {
+
+const long Capture::defaultSize;
+const uint64_t Capture::magic;
+
+std::atomic< Capture * > Capture::_active{ nullptr };
+std::atomic< int > Capture::_writers{ 0 };
+
+Capture::Capture( std::string path, long size ) : _log( path, magic, size ) { }
+
+Capture::~Capture() {
+    Capture *self = this;
+    // writer which loaded this capture before it was uninstalled is already
+    // counted, log can be unmapped only after it finishes
+    if ( _active.compare_exchange_strong( self, nullptr ) )
+        while ( _writers.load() )
+            std::this_thread::yield();
+}
+
+void Capture::recordActive( bool sent, const udp::Packet &packet ) {
+    if ( !_active.load( std::memory_order_relaxed ) )
+        return; // not capturing, no need to be counted
+    _writers.fetch_add( 1 );
+    if ( Capture *capture = _active.load() )
+        capture->record( sent, packet );
+    _writers.fetch_sub( 1, std::memory_order_release );
+}
+
+void Capture::record( bool sent, const udp::Packet &packet ) {
+    MicrosecondTime time = nowMicro();
+    uint32_t size = sizeof( RecordHeader ) + packet.size();
+    char *ptr = _log.reserve( size );
+    if ( !ptr )
+        return;
+    std::memcpy( ptr + sizeof( RecordHeader ), packet.cdata(), packet.size() );
+    RecordHeader &rh = *reinterpret_cast< RecordHeader * >( ptr );
+    rh.ip = packet.address().ip().asInt();
+    rh.port = packet.address().port().get();
+    rh.time = time - _log.start();
+    rh.sent = sent;
+    MappedLog::commit( ptr, size );
+}
+
+bool CaptureReader::next( Entry &e ) {
+    auto *rh = _log.next< Capture::RecordHeader >();
+    if ( !rh )
+        return false;
+    e.time = rh->time;
+    e.sent = rh->sent;
+    e.packet = udp::Packet( reinterpret_cast< const char * >( rh + 1 ),
+            rh->size - sizeof( Capture::RecordHeader ),
+            udp::Address( udp::IPv4Address( rh->ip ), udp::Port( rh->port ) ) );
+    return true;
+}
+
+}
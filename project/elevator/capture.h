@@ -0,0 +1,80 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Capture of network traffic for later replay
+ *
+ * When capture is installed every datagram sent or received by udp::Socket
+ * is appended to MappedLog together with monotonic timestamp, direction and
+ * remote address. Appending never blocks, so it does not delay network
+ * threads.
+ */
+
+#include <string>
+#include <atomic>
+
+#include <elevator/mappedlog.h>
+#include <elevator/udptools.h>
+#include <elevator/time.h>
+
+#ifndef SRC_CAPTURE_H
+#define SRC_CAPTURE_H
+
+namespace elevator {
+
+struct Capture {
+    static const long defaultSize = 64 * 1024 * 1024;
+    static const uint64_t magic = 0x5041435056454c45ull; // "ELEVCAPP"
+
+    /* creates (overwrites) capture file of given maximal size */
+    explicit Capture( std::string path, long size = defaultSize );
+    ~Capture();
+
+    /* capture which udp::Socket writes into, nullptr if none */
+    static Capture *active() { return _active.load( std::memory_order_acquire ); }
+    /* start capturing into this capture, destructor uninstalls it and waits
+     * for writers which might still use it */
+    void install() { _active.store( this, std::memory_order_release ); }
+
+    /* record into installed capture, if any (used by udp::Socket) */
+    static void recordActive( bool sent, const udp::Packet & );
+    void record( bool sent, const udp::Packet & );
+
+    long used() const { return _log.used(); }
+    long dropped() const { return _log.dropped(); }
+
+    struct RecordHeader {
+        uint32_t size;   // of record, including header
+        uint32_t ip;
+        MicrosecondTime time;
+        uint16_t port;
+        uint8_t sent;    // 1 = sent (address is destination), 0 = received
+        uint8_t reserved;
+        uint32_t reserved2;
+    };
+
+  private:
+    static std::atomic< Capture * > _active;
+    static std::atomic< int > _writers; // in recordActive
+    MappedLog _log;
+};
+
+/* sequential reader of capture file */
+struct CaptureReader {
+    struct Entry {
+        MicrosecondTime time; // relative to start of capture
+        bool sent;
+        udp::Packet packet;   // with remote address
+    };
+
+    explicit CaptureReader( std::string path ) : _log( path, Capture::magic ) { }
+
+    /* read next record, false at the end of capture (or at torn record) */
+    bool next( Entry & );
+    void rewind() { _log.rewind(); }
+
+  private:
+    MappedLogReader _log;
+};
+
+}
+
+#endif // SRC_CAPTURE_H
@@ -0,0 +1,83 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <elevator/capture.h>
+#include <elevator/test.h>
+#include <cstring>
+#include <sys/stat.h>
+
+using namespace elevator;
+
+struct TestCapture {
+    Test roundtrip() {
+        test::TempFile file( "capture" );
+        udp::Address addr{ udp::IPv4Address( 10, 0, 0, 1 ), udp::Port( 1234 ) };
+        {
+            Capture c{ file.path };
+            for ( int i = 1; i <= 10; ++i ) {
+                udp::Packet p{ "0123456789", i, addr };
+                c.record( i % 2, p );
+            }
+        }
+        struct stat st;
+        assert_eq( stat( file.path.c_str(), &st ), 0, "" );
+        assert_lt( st.st_size, 1024, "capture should be truncated" );
+
+        CaptureReader reader{ file.path };
+        CaptureReader::Entry e;
+        MicrosecondTime last = 0;
+        for ( int i = 1; i <= 10; ++i ) {
+            assert( reader.next( e ), "record missing" );
+            assert_eq( e.packet.size(), i, "" );
+            assert_eq( e.sent, bool( i % 2 ), "" );
+            assert( e.packet.address() == addr, "" );
+            assert( std::memcmp( e.packet.cdata(), "0123456789", i ) == 0, "" );
+            assert_leq( last, e.time, "time must be monotonic" );
+            last = e.time;
+        }
+        assert( !reader.next( e ), "no more records expected" );
+    }
+
+    Test full() {
+        test::TempFile file( "capture" );
+        {
+            Capture c{ file.path, 256 };
+            udp::Packet p{ "0123456789", 10 };
+            for ( int i = 0; i < 10; ++i )
+                c.record( true, p );
+            assert_lt( 0, c.dropped(), "" );
+        }
+        CaptureReader reader{ file.path };
+        CaptureReader::Entry e;
+        int count = 0;
+        while ( reader.next( e ) )
+            ++count;
+        // header + 6 records of 40 bytes
+        assert_eq( count, 6, "" );
+    }
+
+    Test socket() {
+        test::TempFile file( "capture" );
+        udp::Address target{ udp::IPv4Address::localhost, udp::Port( test::port( 64130 ) ) };
+        {
+            Capture c{ file.path };
+            c.install();
+            udp::Socket rcv{ target };
+            udp::Socket snd{};
+            udp::Packet packet{ "Test", 5, target };
+            assert( snd.sendPacket( packet ), "" );
+            auto got = rcv.recvPacketWithTimeout( 1000 );
+            assert_eq( got.size(), 5, "" );
+        }
+        assert( Capture::active() == nullptr, "capture must uninstall itself" );
+
+        CaptureReader reader{ file.path };
+        CaptureReader::Entry e;
+        assert( reader.next( e ), "" );
+        assert( e.sent, "" );
+        assert( e.packet.address() == target, "" );
+        assert( reader.next( e ), "" );
+        assert( !e.sent, "" );
+        assert_eq( std::string( e.packet.cdata() ), "Test", "" );
+        assert( !reader.next( e ), "" );
+    }
+};
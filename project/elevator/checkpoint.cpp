@@ -0,0 +1,78 @@
+#include <elevator/checkpoint.h>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace elevator {
+
+const int CheckpointRing::slotCount;
+const int CheckpointRing::slotSize;
+
+CheckpointRing::CheckpointRing() {
+    int fd = syscall( SYS_memfd_create, "elevator-checkpoint", 0 );
+    assert_leq( 0, fd, "memfd_create failed" );
+    int rc = ftruncate( fd, sizeof( Shared ) );
+    assert_eq( rc, 0, "ftruncate failed" );
+    using Mode = wibble::sys::MMap::ProtectMode;
+    using wibble::operator|;
+    _map.map( fd, Mode::Read | Mode::Write | Mode::Shared ); // takes ownership of fd
+    // memory of fresh file is zeroed, which is valid initial state
+}
+
+static serialization::Serialized truncated( const Checkpoint &cp, long size ) {
+    using serialization::Serializer;
+    // all commands serialize to the same size
+    long base = Serializer::serialize( Checkpoint( cp.state, { }, cp.dropped ) ).size();
+    long perCommand = ( size - base ) / long( cp.requests.size() );
+    long keep = std::min( long( cp.requests.size() ),
+                          std::max( 0L, ( CheckpointRing::slotSize - base ) / perCommand ) );
+    int dropped = cp.dropped + cp.requests.size() - keep;
+    return Serializer::serialize( Checkpoint( cp.state,
+                std::vector< Command >( cp.requests.begin(), cp.requests.begin() + keep ),
+                dropped ) );
+}
+
+void CheckpointRing::write( const Checkpoint &cp ) {
+    auto serial = serialization::Serializer::serialize( cp );
+    if ( serial.size() > slotSize && !cp.requests.empty() )
+        serial = truncated( cp, serial.size() );
+    assert_leq( serial.size(), long( slotSize ), "checkpoint without requests does not fit" );
+    Shared &sh = _shared();
+    long w = sh.written.load( std::memory_order_relaxed );
+    Slot &slot = sh.slots[ w % slotCount ];
+
+    uint32_t seq = slot.seq.load( std::memory_order_relaxed );
+    slot.seq.store( seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    slot.size = serial.size();
+    std::memcpy( slot.data, serial.rawData(), serial.size() );
+    slot.seq.store( seq + 2, std::memory_order_release );
+    sh.written.store( w + 1, std::memory_order_release );
+}
+
+wibble::Maybe< Checkpoint > CheckpointRing::read() const {
+    const Shared &sh = _shared();
+    long w = sh.written.load( std::memory_order_acquire );
+    std::vector< char > buf( slotSize );
+
+    // newest first, slot can be being overwritten or torn by dead writer
+    for ( long i = w - 1; i >= 0 && i >= w - slotCount; --i ) {
+        const Slot &slot = sh.slots[ i % slotCount ];
+        uint32_t seq = slot.seq.load( std::memory_order_acquire );
+        if ( seq & 1 )
+            continue;
+        uint32_t size = std::min< uint32_t >( slot.size, slotSize );
+        std::memcpy( buf.data(), slot.data, size );
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( slot.seq.load( std::memory_order_relaxed ) != seq )
+            continue;
+
+        serialization::Serialized serial{ Checkpoint::type(), buf.data(), size };
+        return serialization::Serializer::deserialize< Checkpoint >( serial );
+    }
+    return wibble::Maybe< Checkpoint >::Nothing();
+}
+
+}
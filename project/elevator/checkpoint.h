@@ -0,0 +1,88 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* State checkpoints for warm standby
+ *
+ * Primary process writes checkpoints of its elevator state and pending
+ * requests into ring in shared memory, backup process (forked from the same
+ * parent before primary starts writing) reads the newest complete one when
+ * it takes over. Every slot of the ring is protected by sequence lock, so
+ * writer never waits for reader and checkpoint torn by death of writer is
+ * just skipped by reader. Slots are of fixed size, therefore checkpoint with
+ * too many requests is truncated.
+ */
+
+#include <wibble/sys/mmap_v2.h>
+#include <wibble/maybe.h>
+
+#include <atomic>
+#include <vector>
+#include <tuple>
+
+#include <elevator/state.h>
+#include <elevator/command.h>
+#include <elevator/serialization.h>
+
+#ifndef SRC_CHECKPOINT_H
+#define SRC_CHECKPOINT_H
+
+namespace elevator {
+
+struct Checkpoint {
+    using Tuple = std::tuple< ElevatorState, std::vector< Command >, int >;
+
+    Checkpoint() : dropped( 0 ) { }
+    Checkpoint( ElevatorState state, std::vector< Command > requests, int dropped = 0 ) :
+        state( state ), requests( requests ), dropped( dropped )
+    { }
+    explicit Checkpoint( Tuple t ) :
+        Checkpoint( std::get< 0 >( t ), std::get< 1 >( t ), std::get< 2 >( t ) )
+    { }
+
+    Tuple tuple() const { return std::make_tuple( state, requests, dropped ); }
+    static serialization::TypeSignature type() {
+        return serialization::TypeSignature::Checkpoint;
+    }
+
+    ElevatorState state;
+    std::vector< Command > requests; // pending requests scheduled by this elevator
+    int dropped; // pending requests which did not fit into checkpoint
+};
+
+struct CheckpointRing {
+    static const int slotCount = 8;
+    static const int slotSize = 4096;
+
+    /* creates anonymous shared mapping, it is shared with all processes
+     * forked after this point */
+    CheckpointRing();
+
+    /* single writer, if checkpoint does not fit into slot, only requests
+     * which fit are kept (in order) and the rest is counted in dropped */
+    void write( const Checkpoint & );
+    /* newest complete checkpoint, if any */
+    wibble::Maybe< Checkpoint > read() const;
+
+    long written() const { return _shared().written.load( std::memory_order_acquire ); }
+
+  private:
+    struct Slot {
+        std::atomic< uint32_t > seq; // odd while being written
+        uint32_t size;
+        char data[ slotSize ];
+    };
+    struct Shared {
+        std::atomic< long > written; // number of completed writes
+        Slot slots[ slotCount ];
+    };
+    static_assert( ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LONG_LOCK_FREE == 2,
+            "lock-free atomics are required for sharing between processes" );
+
+    wibble::sys::MMap _map;
+
+    Shared &_shared() { return _map.get< Shared >( 0 ); }
+    const Shared &_shared() const { return _map.get< Shared >( 0 ); }
+};
+
+}
+
+#endif // SRC_CHECKPOINT_H
@@ -0,0 +1,58 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <elevator/checkpoint.h>
+#include <elevator/test.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace elevator;
+
+struct TestCheckpoint {
+    static Checkpoint make( int floor ) {
+        ElevatorState st;
+        st.id = 3;
+        st.lastFloor = floor;
+        return Checkpoint( st, { Command{ CommandType::CallToFloorAndGoUp, 4, floor } } );
+    }
+
+    Test readLast() {
+        CheckpointRing ring;
+        assert( ring.read().isNothing(), "nothing was written" );
+        for ( int i = 0; i < 3 * CheckpointRing::slotCount; ++i )
+            ring.write( make( i % 4 ) );
+        auto cp = ring.read();
+        assert( !cp.isNothing(), "" );
+        assert_eq( cp.value().state.id, 3, "" );
+        assert_eq( cp.value().state.lastFloor, (3 * CheckpointRing::slotCount - 1) % 4, "" );
+        assert_eq( cp.value().requests.size(), 1u, "" );
+        assert_eq( cp.value().requests[ 0 ].targetElevatorId, 4, "" );
+    }
+
+    Test truncated() {
+        CheckpointRing ring;
+        Checkpoint big = make( 1 );
+        big.requests.resize( CheckpointRing::slotSize, big.requests[ 0 ] );
+        ring.write( big );
+        auto cp = ring.read();
+        assert( !cp.isNothing(), "too big checkpoint should be truncated, not dropped" );
+        assert_leq( 1u, cp.value().requests.size(), "" );
+        assert_eq( cp.value().requests.size() + cp.value().dropped, big.requests.size(), "" );
+        assert_eq( cp.value().requests[ 0 ].targetElevatorId, 4, "" );
+        assert_eq( make( 1 ).dropped, 0, "" );
+    }
+
+    Test acrossFork() {
+        CheckpointRing ring;
+        int pid = fork();
+        assert_leq( 0, pid, "fork failed" );
+        if ( pid == 0 ) {
+            ring.write( make( 2 ) );
+            _exit( 0 );
+        }
+        waitpid( pid, nullptr, 0 );
+        assert_eq( ring.written(), 1, "" );
+        auto cp = ring.read();
+        assert( !cp.isNothing(), "checkpoint of child should be visible" );
+        assert_eq( cp.value().state.lastFloor, 2, "" );
+    }
+};
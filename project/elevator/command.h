@@ -1,5 +1,7 @@
+#include <climits>
 #include <elevator/test.h>
 #include <elevator/serialization.h>
+#include <elevator/time.h>
 
 #ifndef SRC_COMMAND_H
 #define SRC_COMMAND_H
@@ -24,26 +26,33 @@ struct Command {
     CommandType commandType;
     int targetElevatorId;
     int targetFloor;
+    MicrosecondTime origin; // wallMicro() of event which caused command, 0 if unknown
 
     Command() :
-        commandType( CommandType::Empty ), targetElevatorId( NO_ID ), targetFloor( NO_ID )
+        commandType( CommandType::Empty ), targetElevatorId( NO_ID ), targetFloor( NO_ID ),
+        origin( 0 )
     { }
-    Command( CommandType type, int targetElevId, int floor ) :
-        commandType( type ), targetElevatorId( targetElevId ), targetFloor( floor )
+    Command( CommandType type, int targetElevId, int floor, MicrosecondTime origin = 0 ) :
+        commandType( type ), targetElevatorId( targetElevId ), targetFloor( floor ),
+        origin( origin )
     { }
 
     // serialization
-    explicit Command( std::tuple< CommandType, int, int > tuple ) :
-        Command( std::get< 0 >( tuple ), std::get< 1 >( tuple ), std::get< 2 >( tuple ) )
+    using Tuple = std::tuple< CommandType, int, int, MicrosecondTime >;
+    explicit Command( Tuple tuple ) :
+        Command( std::get< 0 >( tuple ), std::get< 1 >( tuple ), std::get< 2 >( tuple ),
+                std::get< 3 >( tuple ) )
     { }
     static serialization::TypeSignature type() {
         return serialization::TypeSignature::ElevatorCommand;
     }
-    std::tuple< CommandType, int, int > tuple() const {
-        return std::make_tuple( commandType, targetElevatorId, targetFloor );
+    Tuple tuple() const {
+        return std::make_tuple( commandType, targetElevatorId, targetFloor, origin );
     }
 };
 
+const char *showCommand( CommandType );
+
 }
 
 #endif // SRC_COMMAND_H
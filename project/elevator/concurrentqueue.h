@@ -2,6 +2,7 @@
 
 #include <mutex>
 #include <deque>
+#include <atomic>
 #include <condition_variable>
 
 #include <elevator/time.h>
@@ -20,9 +21,12 @@ namespace elevator {
 template< typename T >
 struct ConcurrentQueue {
 
+    ConcurrentQueue() : _size( 0 ) { }
+
     void enqueue( const T &data ) {
         Guard g{ _lock };
         _queue.push_back( data );
+        _size.store( _queue.size(), std::memory_order_relaxed );
         _cond.notify_one();
     }
 
@@ -34,6 +38,7 @@ struct ConcurrentQueue {
         _cond.wait( g, [&]() { return !_queue.empty(); } );
         T data = _queue.front();
         _queue.pop_front();
+        _size.store( _queue.size(), std::memory_order_relaxed );
         return data;
     }
 
@@ -48,6 +53,7 @@ struct ConcurrentQueue {
         {
             T data = _queue.front();
             _queue.pop_front();
+            _size.store( _queue.size(), std::memory_order_relaxed );
             return wibble::Maybe< T >::Just( data );
         } else {
             return wibble::Maybe< T >::Nothing();
@@ -63,6 +69,7 @@ struct ConcurrentQueue {
         } else {
             auto it = wibble::Maybe< T >::Just( _queue.front() );
             _queue.pop_front();
+            _size.store( _queue.size(), std::memory_order_relaxed );
             return it;
         }
     }
@@ -75,9 +82,17 @@ struct ConcurrentQueue {
         return _queue.empty();
     }
 
+    /** size without locking, for monitoring only (it can be outdated by the
+     * time it is returned)
+     */
+    size_t approxSize() const {
+        return _size.load( std::memory_order_relaxed );
+    }
+
   private:
     std::mutex _lock;
     std::deque< T > _queue;
+    std::atomic< size_t > _size;
     std::condition_variable _cond;
     using Guard = std::unique_lock< std::mutex >;
 };
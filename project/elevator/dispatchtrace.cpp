@@ -0,0 +1,46 @@
+#include <elevator/dispatchtrace.h>
+
+namespace elevator {
+
+const long DispatchTrace::defaultSize;
+const uint64_t DispatchTrace::magic;
+
+using Record = DispatchTrace::Record;
+using Candidate = DispatchTrace::Candidate;
+
+Candidate *DispatchTrace::dispatch( int candidates ) {
+    char *ptr = _log.reserve( sizeof( Record ) + candidates * sizeof( Candidate ) );
+    if ( !ptr )
+        return nullptr;
+    reinterpret_cast< Record * >( ptr )->count = candidates;
+    return reinterpret_cast< Candidate * >( ptr + sizeof( Record ) );
+}
+
+void DispatchTrace::finish( Candidate *candidates, MillisecondTime time,
+        ButtonType button, int floor, int chosen )
+{
+    char *ptr = reinterpret_cast< char * >( candidates ) - sizeof( Record );
+    Record &r = *reinterpret_cast< Record * >( ptr );
+    r.kind = Kind::Dispatch;
+    r.button = uint8_t( button );
+    r.floor = floor;
+    r.elevator = chosen;
+    r.time = time;
+    MappedLog::commit( ptr, sizeof( Record ) + r.count * sizeof( Candidate ) );
+}
+
+void DispatchTrace::served( MillisecondTime time, ButtonType button, int floor, int elevator ) {
+    char *ptr = _log.reserve( sizeof( Record ) );
+    if ( !ptr )
+        return;
+    Record &r = *reinterpret_cast< Record * >( ptr );
+    r.kind = Kind::Served;
+    r.button = uint8_t( button );
+    r.count = 0;
+    r.floor = floor;
+    r.elevator = elevator;
+    r.time = time;
+    MappedLog::commit( ptr, sizeof( Record ) );
+}
+
+}
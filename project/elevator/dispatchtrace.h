@@ -0,0 +1,92 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Binary trace of scheduler decisions
+ *
+ * For every call dispatched by Scheduler trace keeps all candidate
+ * elevators with age of their state and every component of their cost, so
+ * that decisions can be analysed (and penalties tuned) offline against
+ * outcomes. Outcome of call is the time it was served, therefore served
+ * calls seen by scheduler are traced too. Times are from scheduler's clock
+ * (capture time when trace is made by replay).
+ *
+ * Trace is MappedLog, candidates are written directly to it while scheduler
+ * evaluates them, so tracing does not allocate nor block.
+ */
+
+#include <string>
+
+#include <elevator/mappedlog.h>
+#include <elevator/driver.h>
+#include <elevator/time.h>
+
+#ifndef SRC_DISPATCH_TRACE_H
+#define SRC_DISPATCH_TRACE_H
+
+namespace elevator {
+
+struct DispatchTrace {
+    static const long defaultSize = 64 * 1024 * 1024;
+    static const uint64_t magic = 0x4352544456454c45ull; // "ELEVDTRC"
+
+    enum class Kind : uint8_t { Dispatch, Served };
+
+    struct Candidate {
+        int32_t id;
+        int32_t lastFloor;
+        int32_t age;       // of state, in ms
+        int32_t distance;  // in floors
+        // penalties
+        int32_t outdated;  // state is older than outdated threshold
+        int32_t stopped;
+        int32_t busy;      // call is ahead in direction of travel (or at end floor)
+        int32_t opposite;  // moving, but call is not ahead of it
+        int8_t direction;  // Direction
+        uint8_t dead;      // skipped, state is older than dead threshold
+        uint8_t reserved[ 2 ];
+
+        int cost() const { return distance + outdated + stopped + busy + opposite; }
+    };
+
+    struct Record {
+        uint32_t size;     // of record, including candidates which follow it
+        Kind kind;
+        uint8_t button;    // ButtonType
+        uint16_t count;    // of candidates, 0 for Served
+        int32_t floor;
+        int32_t elevator;  // chosen one or the one which served the call
+        MillisecondTime time;
+
+        const Candidate *candidates() const {
+            return reinterpret_cast< const Candidate * >( this + 1 );
+        }
+    };
+
+    explicit DispatchTrace( std::string path, long size = defaultSize ) :
+        _log( path, magic, size )
+    { }
+
+    /* space for dispatch with given number of candidates, nullptr if trace
+     * is full; all candidates are written by caller, then it calls finish */
+    Candidate *dispatch( int candidates );
+    void finish( Candidate *, MillisecondTime time, ButtonType, int floor, int chosen );
+    void served( MillisecondTime time, ButtonType, int floor, int elevator );
+
+    long dropped() const { return _log.dropped(); }
+
+  private:
+    MappedLog _log;
+};
+
+/* sequential reader of dispatch trace, nullptr at the end */
+struct DispatchTraceReader {
+    explicit DispatchTraceReader( std::string path ) : _log( path, DispatchTrace::magic ) { }
+    const DispatchTrace::Record *next() { return _log.next< DispatchTrace::Record >(); }
+    void rewind() { _log.rewind(); }
+
+  private:
+    MappedLogReader _log;
+};
+
+}
+
+#endif // SRC_DISPATCH_TRACE_H
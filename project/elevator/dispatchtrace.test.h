@@ -0,0 +1,76 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <elevator/dispatchtrace.h>
+#include <elevator/scheduler.h>
+#include <elevator/test.h>
+
+using namespace elevator;
+
+struct TestDispatchTrace {
+    static MillisecondTime fixedTime() { return 10000; }
+
+    Test scheduler() {
+        test::TempFile file( "trace" );
+        BasicDriverInfo info( 0, 3 );
+        GlobalState global;
+        ConcurrentQueue< StateChange > stateIn, stateOut;
+        ConcurrentQueue< Command > toRemote, toLocal;
+        int chosen;
+        {
+            DispatchTrace trace{ file.path };
+            Scheduler sched( 0, info, global, stateIn, stateOut, toRemote, toLocal );
+            sched.useClock( &fixedTime );
+            sched.traceTo( trace );
+
+            ElevatorState near, far, dead;
+            near.id = 1;
+            near.lastFloor = 2;
+            near.stopped = true; // stopped penalty makes it lose
+            near.timestamp = fixedTime() - 100;
+            far.id = 2;
+            far.lastFloor = 0;
+            far.timestamp = fixedTime();
+            dead.id = 3;
+            dead.lastFloor = 3;
+            dead.timestamp = 0;
+            global.update( near );
+            global.update( far );
+            global.update( dead );
+
+            chosen = sched.optimalElevator( ButtonType::CallUp, 3 );
+            trace.served( fixedTime() + 500, ButtonType::CallUp, 3, chosen );
+        }
+        assert_eq( chosen, 2, "" );
+
+        DispatchTraceReader reader{ file.path };
+        auto *r = reader.next();
+        assert( r, "dispatch missing" );
+        assert( r->kind == DispatchTrace::Kind::Dispatch, "" );
+        assert_eq( r->floor, 3, "" );
+        assert_eq( r->elevator, 2, "" );
+        assert_eq( r->time, fixedTime(), "" );
+        assert_eq( r->count, 3, "" );
+        for ( int i = 0; i < 3; ++i ) {
+            const auto &c = r->candidates()[ i ];
+            if ( c.id == 1 ) {
+                assert_eq( c.distance, 1, "" );
+                assert_eq( c.age, 100, "" );
+                assert_eq( c.stopped, 30, "" );
+                assert_eq( c.cost(), 31, "" );
+            } else if ( c.id == 2 ) {
+                assert_eq( c.cost(), 3, "" );
+                assert( !c.dead, "" );
+            } else {
+                assert_eq( c.id, 3, "" );
+                assert( c.dead, "" );
+            }
+        }
+
+        r = reader.next();
+        assert( r, "served call missing" );
+        assert( r->kind == DispatchTrace::Kind::Served, "" );
+        assert_eq( r->elevator, 2, "" );
+        assert_eq( r->count, 0, "" );
+        assert( !reader.next(), "" );
+    }
+};
@@ -1,6 +1,7 @@
 #include <climits>
 #include <elevator/elevator.h>
 #include <elevator/restartwrapper.h>
+#include <elevator/latency.h>
 #include <elevator/test.h>
 #include <wibble/raii.h>
 
@@ -51,7 +52,8 @@ void Elevator::terminate() {
 }
 
 void Elevator::run( HeartBeat &heartbeat ) {
-    _thread = std::thread( restartWrapper( &Elevator::_loop ), this, &heartbeat );
+    _loopCheckpoint.invalidate();
+    _thread = std::thread( restartWrapper( &Elevator::_loop, ThreadClass::Control, "elevator" ), this, &heartbeat );
 }
 
 void Elevator::_addTargetFloor( int floor ) {
@@ -152,6 +154,7 @@ void Elevator::_emitStateChange( ChangeType type, int floor ) {
     change.changeType = type;
     change.changeFloor = floor;
     _lastStateUpdate = change.state.timestamp = now();
+    change.created = wallMicro();
     _outState.enqueue( change );
 }
 
@@ -245,30 +248,36 @@ void Elevator::_loop( HeartBeat *heartbeat ) {
     // restarting)
     auto d_stop = wibble::raii::defer( [&]() { _stopElevator(); } );
 
-    // for some buttons, we need to keep track about changes, so that we
-    // can detect button press/release event no just the fact that button
-    // is now activated
-    FloorSet inFloorButtons, inFloorButtonsLast;
-    bool stopLast{ false }, stopNow{ false };
-
-    int prevFloor{ INT_MIN }; // to keep track when to send state update
-
-    MillisecondTime doorWaitingStarted{ 0 }; // for closing doors
-
-    enum class State { Normal, WaitingForInButton, Stopped };
-    State state = State::Normal;
+    using State = LoopMode;
+    LoopState loop;
+    if ( _loopCheckpoint.valid() ) {
+        // restarted after failure, hardware is already initialized and motor
+        // was stopped by d_stop, normal state will start it again if needed
+        loop = _loopCheckpoint.state();
+    } else {
+        _initializeElevator();
+        if ( _driver.getStopLamp() )
+            loop.mode = State::Stopped;
+    }
 
-    _initializeElevator();
-    if ( _driver.getStopLamp() )
-        state = State::Stopped;
+    FloorSet &inFloorButtons = loop.inFloorButtons,
+             &inFloorButtonsLast = loop.inFloorButtonsLast;
+    bool &stopLast = loop.stopLast, &stopNow = loop.stopNow;
+    int &prevFloor = loop.prevFloor;
+    MillisecondTime &doorWaitingStarted = loop.doorWaitingStarted;
+    State &state = loop.mode;
 
     while ( !_terminate.load( std::memory_order::memory_order_relaxed ) ) {
+        latency::StageTimer iterationTimer{ latency::Stage::ElevatorLoop };
+
         // initialize cycle
         inFloorButtonsLast = inFloorButtons;
         inFloorButtons.reset();
         stopLast = stopNow;
 
-        assertConsistency();
+        // full scan of state on every iteration is too expensive for release
+        if ( test::assertLevel >= test::assertLevelDebug )
+            assertConsistency();
 
         // handle buttons and lamps
         for ( auto b : _floorButtons ) {
@@ -322,6 +331,13 @@ void Elevator::_loop( HeartBeat *heartbeat ) {
             auto command = maybeCommand.value();
             assert( command.targetElevatorId == _elevState.id
                     || command.targetElevatorId == Command::ANY_ID, "command to other elevator" );
+            // FloorSet checks bounds only in debug builds
+            assert( command.commandType == CommandType::Empty
+                    || ( _driver.minFloor() <= command.targetFloor
+                        && command.targetFloor <= _driver.maxFloor() ), "command floor out of bounds" );
+            if ( command.origin != 0 )
+                latency::histogram( latency::Stage::ButtonToCommand )
+                    .record( wallMicro() - command.origin );
             switch ( command.commandType ) {
             case CommandType::Empty:
                 break;
@@ -429,6 +445,7 @@ void Elevator::_loop( HeartBeat *heartbeat ) {
         // we don't need to care about beating too often, it is cheap and safe
         heartbeat->beat();
         prevFloor = currentFloor;
+        _loopCheckpoint.save( loop );
     }
 }
 
@@ -8,8 +8,10 @@
 #include <elevator/command.h>
 #include <elevator/state.h>
 #include <elevator/floorset.h>
+#include <elevator/restartwrapper.h>
 
 #include <atomic>
+#include <climits>
 #include <thread>
 #include <vector>
 
@@ -41,6 +43,27 @@ struct Elevator {
   private:
     void _loop( HeartBeat * );
 
+    enum class LoopMode { Normal, WaitingForInButton, Stopped };
+
+    /* local state of control loop, checkpointed at the end of every iteration
+     * so that loop restarted after assertion failure continues without
+     * re-reading lamps and without losing button edge tracking */
+    struct LoopState {
+        LoopState() :
+            stopLast( false ), stopNow( false ), prevFloor( INT_MIN ),
+            doorWaitingStarted( 0 ), mode( LoopMode::Normal )
+        { }
+
+        // for some buttons, we need to keep track about changes, so that we
+        // can detect button press/release event no just the fact that button
+        // is now activated
+        FloorSet inFloorButtons, inFloorButtonsLast;
+        bool stopLast, stopNow;
+        int prevFloor; // to keep track when to send state update
+        MillisecondTime doorWaitingStarted; // for closing doors
+        LoopMode mode;
+    };
+
     std::atomic< bool > _terminate;
     ConcurrentQueue< Command > &_inCommands;
     ConcurrentQueue< StateChange > &_outState;
@@ -50,6 +73,7 @@ struct Elevator {
     ElevatorState _elevState;
     Direction _previousDirection;
     MillisecondTime _lastStateUpdate;
+    LoopCheckpoint< LoopState > _loopCheckpoint;
 
     const std::vector< Button > _floorButtons;
 
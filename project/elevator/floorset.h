@@ -83,9 +83,10 @@ struct FloorSet {
     }
 
   private:
+    // floors from outside (network) are checked on input, so this is debug only
     static void _checkBounds( int floor, const BasicDriverInfo &d ) {
-        assert_leq( d.minFloor(), floor, "out-of-bounds floor (minimun)" );
-        assert_leq( floor, d.maxFloor(), "out-of-bounds floor (maximum)" );
+        assert_debug_leq( d.minFloor(), floor, "out-of-bounds floor (minimun)" );
+        assert_debug_leq( floor, d.maxFloor(), "out-of-bounds floor (maximum)" );
     }
     uint64_t _floors;
 
@@ -26,6 +26,25 @@ struct GlobalState {
         return _elevators;
     }
 
+    /* calls f with every elevator state, under lock */
+    template< typename F >
+    void eachElevator( F f ) const {
+        Guard g{ _lock };
+        for ( auto &e : _elevators )
+            f( e.second );
+    }
+
+    /* elevator left or failed, requests it was supposed to serve are
+     * expired so that they are rescheduled */
+    void remove( int id ) {
+        {
+            Guard g{ _lock };
+            _elevators.erase( id );
+            updateButtons( g );
+        }
+        _requests.expireTarget( id );
+    }
+
     bool has( int i ) const {
         Guard g{ _lock };
         return _elevators.find( i ) != _elevators.end();
@@ -41,7 +60,7 @@ struct GlobalState {
     void assertConsistency( const BasicDriverInfo &bi ) const {
         Guard g{ _lock };
         assert( _upButtons.consistent( bi ), "consistency check failed" );
-        assert( _upButtons.consistent( bi ), "consistency check failed" );
+        assert( _downButtons.consistent( bi ), "consistency check failed" );
         for ( auto &e : _elevators )
             e.second.assertConsistency( bi );
     }
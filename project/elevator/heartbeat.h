@@ -1,5 +1,6 @@
 #include <elevator/test.h>
 #include <elevator/time.h>
+#include <elevator/latency.h>
 #include <thread>
 #include <chrono>
 #include <cstdint>
@@ -7,6 +8,9 @@
 #include <exception>
 #include <string>
 #include <deque>
+#include <algorithm>
+#include <functional>
+#include <ostream>
 
 #ifndef SRC_HEARTBEAT_H
 #define SRC_HEARTBEAT_H
@@ -33,31 +37,102 @@ struct HeartBeatException : std::exception {
 };
 
 /* heart-beat helper with millisecond precision
- * you have to make sure first beat will happen before first check */
+ * you have to make sure first beat will happen before first check
+ * (see HeartBeatManager::waitForFirstBeats)
+ *
+ * heart-beat keeps histogram of intervals between beats and the worst delta
+ * seen (either between beats or at check), so that thresholds can be tuned
+ * and it can call warning callback when delta exceeds given fraction of
+ * threshold (from checking thread, once for every late beat) */
 struct HeartBeat {
+    using Warning = std::function< void( const HeartBeat &, MillisecondTime delta ) >;
 
-    HeartBeat( MillisecondTime threshold ) : _threshold( threshold ) { }
+    HeartBeat( MillisecondTime threshold, const char *name = "" ) :
+        _lastBeat( 0 ), _threshold( threshold ), _name( name ), _sameMs( 0 ),
+        _worst( 0 ), _warnAt( threshold + 1 ), _warned( 0 )
+    { }
     HeartBeat( const HeartBeat & ) = delete; // disable copying
 
+    /* only one thread can beat */
     void beat() {
-        _lastBeat.store( now(), std::memory_order_release );
+        MillisecondTime t = now();
+        MillisecondTime last = _lastBeat.load( std::memory_order_relaxed );
+        if ( last == t ) {
+            // beating can be very frequent, keep it cheap
+            ++_sameMs;
+            return;
+        }
+        if ( last != 0 ) {
+            if ( _sameMs ) {
+                _intervals.record( 0, _sameMs );
+                _sameMs = 0;
+            }
+            _intervals.record( t - last );
+            _updateWorst( t - last );
+        }
+        _lastBeat.store( t, std::memory_order_release );
     }
 
     bool check() const {
         return _delta() <= _threshold;
     }
 
-    void throwIfLate() const {
-        int delta = _delta();
+    void throwIfLate() {
+        MillisecondTime lastBeat = _lastBeat.load( std::memory_order_acquire );
+        MillisecondTime delta = now() - lastBeat;
+        _updateWorst( delta );
+        if ( delta >= _warnAt && _warned != lastBeat && _warning ) {
+            _warned = lastBeat;
+            _warning( *this, delta );
+        }
         if ( delta > _threshold )
             throw HeartBeatException( delta, _threshold );
     }
 
+    /* call warning (from checking thread) when delta reaches fraction of
+     * threshold, must be set before checking starts */
+    void setWarning( double fraction, Warning warning ) {
+        assert_lt( 0, fraction, "invalid warning fraction" );
+        _warnAt = MillisecondTime( fraction * _threshold );
+        _warning = warning;
+    }
+
     MillisecondTime threshold() const { return _threshold; }
+    const char *name() const { return _name; }
+    bool started() const { return _lastBeat.load( std::memory_order_acquire ) != 0; }
+
+    const Histogram &intervals() const { return _intervals; }
+    /* longest delta seen so far */
+    MillisecondTime worst() const { return _worst.load( std::memory_order_relaxed ); }
+    /* how far from threshold was the worst delta */
+    MillisecondTime slack() const { return _threshold - worst(); }
+
+    void dump( std::ostream &os ) const {
+        os << "    heartbeat " << _name << " (threshold " << _threshold << " ms): worst = "
+           << worst() << " ms, slack = " << slack() << " ms, intervals [ms]: "
+           << _intervals.summary() << std::endl;
+    }
 
   private:
     std::atomic< MillisecondTime > _lastBeat;
     const MillisecondTime _threshold;
+    const char *_name;
+
+    // telemetry
+    Histogram _intervals;
+    int64_t _sameMs; // beats since last recorded, owned by beating thread
+    std::atomic< MillisecondTime > _worst;
+
+    // owned by checking thread
+    MillisecondTime _warnAt;
+    MillisecondTime _warned; // last beat for which warning was issued
+    Warning _warning;
+
+    void _updateWorst( MillisecondTime delta ) {
+        MillisecondTime w = _worst.load( std::memory_order_relaxed );
+        while ( delta > w && !_worst.compare_exchange_weak( w, delta, std::memory_order_relaxed ) )
+        { }
+    }
 
     MillisecondTime _delta() const {
         MillisecondTime lastBeat = _lastBeat.load( std::memory_order_acquire );
@@ -78,14 +153,32 @@ struct HeartBeatManager {
      * to at least 10 times shorter period that is threshold
      * of this beat
      */
-    HeartBeat &getNew( MillisecondTime threshold ) {
+    HeartBeat &getNew( MillisecondTime threshold, const char *name = "" ) {
         MillisecondTime thisRerun = threshold / 10;
         if ( rerunTime > thisRerun )
             rerunTime = thisRerun;
-        beats.emplace_back( threshold );
+        beats.emplace_back( threshold, name );
         return beats.back();
     }
 
+    /* set warning for all heartbeats created so far */
+    void setWarning( double fraction, HeartBeat::Warning warning ) {
+        for ( auto &b : beats )
+            b.setWarning( fraction, warning );
+    }
+
+    void dump( std::ostream &os ) const {
+        for ( auto &b : beats )
+            b.dump( os );
+    }
+
+    /* heartbeats must not be added while iterating */
+    template< typename Yield >
+    void each( Yield yield ) const {
+        for ( auto &b : beats )
+            yield( b );
+    }
+
     /* Runs thread running checking loop in background,
      * this function can be run at most once
      * thread will stop when HeartBeatManager is destructed
@@ -99,6 +192,21 @@ struct HeartBeatManager {
         thr = std::thread( &HeartBeatManager::runInThisThread, this );
     }
 
+    /* wait untill all heartbeats have beaten at least once, or timeout
+     * expires, returns true if all have started */
+    bool waitForFirstBeats( MillisecondTime timeout ) {
+        MillisecondTime deadline = now() + timeout;
+        while ( true ) {
+            bool all = std::all_of( beats.begin(), beats.end(),
+                    []( const HeartBeat &b ) { return b.started(); } );
+            if ( all )
+                return true;
+            if ( now() >= deadline )
+                return false;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+    }
+
     void runInThisThread() {
         while ( !terminate.load( std::memory_order::memory_order_relaxed ) ) {
             auto next = std::chrono::steady_clock::now() + toSystemTime( rerunTime );
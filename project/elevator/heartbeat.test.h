@@ -21,4 +21,34 @@ struct TestHeartBeat {
         } catch ( HeartBeatException & )
         { }
     }
+
+    Test firstBeats() {
+        HeartBeatManager manager;
+        HeartBeat &hb = manager.getNew( 1000 );
+        assert( !hb.started(), "" );
+        assert( !manager.waitForFirstBeats( 10 ), "should time out" );
+        std::thread thr( [&hb] {
+                usleep( 50 * 1000 );
+                hb.beat();
+            } );
+        assert( manager.waitForFirstBeats( 1000 ), "should have started" );
+        assert( hb.started(), "" );
+        thr.join();
+    }
+    Test telemetry() {
+        HeartBeat hb( 1000, "test" );
+        int warnings = 0;
+        hb.setWarning( 0.01, [&warnings]( const HeartBeat &, MillisecondTime ) { ++warnings; } );
+        hb.beat();
+        usleep( 30 * 1000 );
+        hb.throwIfLate();
+        hb.throwIfLate(); // only one warning per late beat
+        assert_eq( warnings, 1, "" );
+        hb.beat();
+        hb.beat();
+        assert_leq( 30, hb.worst(), "" );
+        assert_eq( hb.slack(), 1000 - hb.worst(), "" );
+        assert_leq( 1, hb.intervals().count(), "" );
+        assert_leq( 30, hb.intervals().max(), "" );
+    }
 };
@@ -9,6 +9,8 @@
 #include <type_traits>
 #include <vector>
 #include <tuple>
+#include <algorithm>
+#include <cstring>
 
 #include <wibble/sfinae.h>
 
@@ -18,6 +20,44 @@
 #define SRC_INTERNAL_SERIALIZATION_H
 
 namespace serialization {
+
+/* bounds-checked reader of serialized data: every read is checked against
+ * size of data, once read fails cursor is invalid and all further reads
+ * return zeros, so decoder can check validity just once at the end
+ */
+struct Cursor {
+    Cursor( const char *data, long size ) : _ptr( data ), _left( size ) { }
+
+    template< typename T >
+    T read() {
+        T value{};
+        if ( take( sizeof( T ) ) )
+            std::memcpy( &value, _ptr - sizeof( T ), sizeof( T ) );
+        return value;
+    }
+
+    /* consume size bytes, false (and cursor invalidated) if there are not
+     * enough of them */
+    bool take( long size ) {
+        if ( size < 0 || size > _left ) {
+            invalidate();
+            return false;
+        }
+        _ptr += size;
+        _left -= size;
+        return true;
+    }
+
+    void invalidate() { _left = -1; }
+    bool valid() const { return _left >= 0; }
+    long left() const { return std::max( _left, 0L ); }
+    const char *ptr() const { return _ptr; }
+
+  private:
+    const char *_ptr;
+    long _left; // -1 if invalid
+};
+
 namespace _internal {
 
 enum Trait {
@@ -102,13 +142,28 @@ constexpr Trait trait() { return trait_1< T >( wibble::Preferred() ); }
 template< typename T, Trait tr >
 struct SerializableImpl { }; // for Trait::Other, static_assert will fail anyway
 
+/* every implementation provides constexpr fixedSize() which is size of
+ * serialized value if it is same for all values of given type (only
+ * fundamental types, enums and tuples of them), -1 otherwise, and
+ * minSize() which is lower bound of serialized size of any value
+ *
+ * deserialize( const char ** ) reads trusted data without any checks,
+ * deserialize( Cursor * ) checks bounds and counts of containers, the
+ * result is meaningless if cursor is invalid afterwards
+ */
 template< typename T, Trait tr >
 struct Serializable : SerializableImpl< T, tr > {
     static_assert( tr != Trait::Other, "Trying to serialize type which is neither "
             "fundamental type (numerical types) nor collection or tuple of serializable types" );
     using Base = SerializableImpl< T, tr >;
 
-    using Base::deserialize;
+    // fixed size types need not walk the value
+    static long size( const T &value ) {
+        return Base::fixedSize() >= 0 ? Base::fixedSize() : Base::size( value );
+    }
+
+    static T deserialize( const char **from ) { return Base::deserialize( from ); }
+    static T deserialize( Cursor *from ) { return Base::deserialize( from ); }
     static T deserialize( char **from ) {
         return Base::deserialize( const_cast< const char ** >( from ) );
     }
@@ -116,6 +171,8 @@ struct Serializable : SerializableImpl< T, tr > {
 
 template< typename T >
 struct SerializableImpl< T, Trait::Fundamental > {
+    static constexpr long fixedSize() { return sizeof( T ); }
+    static constexpr long minSize() { return sizeof( T ); }
     static long size( T ) { return sizeof( T ); }
 
     static void serialize( T source, char **to ) {
@@ -128,6 +185,8 @@ struct SerializableImpl< T, Trait::Fundamental > {
         *from += sizeof( T );
         return t;
     }
+
+    static T deserialize( Cursor *from ) { return from->read< T >(); }
 };
 
 template< typename T >
@@ -135,6 +194,9 @@ struct SerializableImpl< T, Trait::Container > {
     using ValueType = typename T::value_type;
     using ValueSerializable = Serializable< ValueType, trait< ValueType >() >;
 
+    static constexpr long fixedSize() { return -1; }
+    static constexpr long minSize() { return sizeof( long ); }
+
     static long size( const T &container ) {
         long s = sizeof( long ); // constant overhead for storing size of container
         for ( const ValueType &val : container )
@@ -149,13 +211,29 @@ struct SerializableImpl< T, Trait::Container > {
             ValueSerializable::serialize( val, to );
     }
 
+    // values are inserted directly, in order, so inserting at end is
+    // constant time for both sequences and sorted containers
     static T deserialize( const char **from ) {
         const long count = *reinterpret_cast< const long * >( *from );
         *from += sizeof( long );
-        std::vector< ValueType > tempstore;
+        T result;
         for ( long i = 0; i < count; ++i )
-            tempstore.push_back( ValueSerializable::deserialize( from ) );
-        return T( tempstore.begin(), tempstore.end() );
+            result.insert( result.end(), ValueSerializable::deserialize( from ) );
+        return result;
+    }
+
+    static T deserialize( Cursor *from ) {
+        const long count = from->read< long >();
+        T result;
+        // count which cannot fit into rest of data is rejected before
+        // anything is allocated
+        if ( count < 0 || count > from->left() / std::max( ValueSerializable::minSize(), 1L ) ) {
+            from->invalidate();
+            return result;
+        }
+        for ( long i = 0; i < count && from->valid(); ++i )
+            result.insert( result.end(), ValueSerializable::deserialize( from ) );
+        return result;
     }
 };
 
@@ -167,6 +245,9 @@ struct SerializableImpl< T, Trait::Tuple > {
     using NestedSerializable = Serializable< NestedType< i >, trait< NestedType< i > >() >;
     static constexpr long tuple_size = std::tuple_size< T >::value;
 
+    static constexpr long fixedSize() { return _fixedSize< 0 >( 0 ); }
+    static constexpr long minSize() { return _minSize< 0 >( 0 ); }
+
     static long size( const T &tuple ) { return _size< 0 >( 0, tuple ); }
 
     static void serialize( const T &source, char **to ) {
@@ -177,7 +258,39 @@ struct SerializableImpl< T, Trait::Tuple > {
         return _deserialize< 0 >( from );
     }
 
+    static T deserialize( Cursor *from ) {
+        return _deserialize< 0 >( from );
+    }
+
   private:
+    template< long i >
+    static constexpr auto _fixedSize( long accum ) -> typename
+        std::enable_if< i != tuple_size, long >::type
+    {
+        return NestedSerializable< i >::fixedSize() < 0
+            ? -1
+            : _fixedSize< i + 1 >( accum + NestedSerializable< i >::fixedSize() );
+    }
+    template< long i >
+    static constexpr auto _fixedSize( long accum ) -> typename
+        std::enable_if< i == tuple_size, long >::type
+    {
+        return accum;
+    }
+
+    template< long i >
+    static constexpr auto _minSize( long accum ) -> typename
+        std::enable_if< i != tuple_size, long >::type
+    {
+        return _minSize< i + 1 >( accum + NestedSerializable< i >::minSize() );
+    }
+    template< long i >
+    static constexpr auto _minSize( long accum ) -> typename
+        std::enable_if< i == tuple_size, long >::type
+    {
+        return accum;
+    }
+
     template< long i >
     static auto _size( long accum, const T &tuple ) -> typename
         std::enable_if< i != tuple_size, long >::type
@@ -203,16 +316,17 @@ struct SerializableImpl< T, Trait::Tuple > {
         std::enable_if< i == tuple_size >::type
     { }
 
-    template< long i, typename... Args >
-    static auto _deserialize( const char **from, Args &&...args ) -> typename
+    // From is const char ** or Cursor *
+    template< long i, typename From, typename... Args >
+    static auto _deserialize( From from, Args &&...args ) -> typename
         std::enable_if< i != tuple_size, T >::type
     {
         NestedType< i > elem = NestedSerializable< i >::deserialize( from );
         return _deserialize< i + 1 >( from, std::forward< Args >( args )...,
                 std::forward< NestedType< i > >( elem ) );
     }
-    template< long i, typename... Args >
-    static auto _deserialize( const char **, Args &&...args ) -> typename
+    template< long i, typename From, typename... Args >
+    static auto _deserialize( From, Args &&...args ) -> typename
         std::enable_if< i == tuple_size, T >::type
     {
         return T{ std::forward< Args >( args )... };
@@ -224,6 +338,9 @@ struct SerializableImpl< T, Trait::TupleSerializable > {
     using TupleType = decltype( std::declval< T >().tuple() );
     using TupleSerializable = Serializable< TupleType, trait< TupleType >() >;
 
+    static constexpr long fixedSize() { return TupleSerializable::fixedSize(); }
+    static constexpr long minSize() { return TupleSerializable::minSize(); }
+
     static long size( const T &value ) {
         return TupleSerializable::size( value.tuple() );
     }
@@ -235,6 +352,10 @@ struct SerializableImpl< T, Trait::TupleSerializable > {
     static T deserialize( const char **from ) {
         return T( TupleSerializable::deserialize( from ) );
     }
+
+    static T deserialize( Cursor *from ) {
+        return T( TupleSerializable::deserialize( from ) );
+    }
 };
 
 template< typename T >
@@ -242,6 +363,9 @@ struct SerializableImpl< T, Trait::Enum > {
     using BaseType = typename std::underlying_type< T >::type;
     using BaseSerializable = Serializable< BaseType, trait< BaseType >() >;
 
+    static constexpr long fixedSize() { return BaseSerializable::fixedSize(); }
+    static constexpr long minSize() { return BaseSerializable::minSize(); }
+
     static long size( const T &value ) {
         return BaseSerializable::size( BaseType( value ) );
     }
@@ -253,6 +377,10 @@ struct SerializableImpl< T, Trait::Enum > {
     static T deserialize( const char **from ) {
         return T( BaseSerializable::deserialize( from ) );
     }
+
+    static T deserialize( Cursor *from ) {
+        return T( BaseSerializable::deserialize( from ) );
+    }
 };
 
 }
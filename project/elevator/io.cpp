@@ -78,13 +78,17 @@ int lowlevel::IO::io_read_analog( int channel ) {
 #warning Using fake comedi library binding
 
 #include <map>
+#include <iostream>
+#include <elevator/simulator.h>
 
 struct comedi_t_struct {
     std::map< int, bool > setBits;
+    lowlevel::Simulator *simulator; // all IO goes here if simulator is enabled
 };
 
 lowlevel::IO::IO( const char * ) {
     _comediHandle = new comedi_t();
+    _comediHandle->simulator = Simulator::instance();
 }
 
 lowlevel::IO::~IO() {
@@ -92,17 +96,25 @@ lowlevel::IO::~IO() {
 }
 
 void lowlevel::IO::io_set_bit( int channel, bool value ) {
-    _comediHandle->setBits[ channel ] = value;
+    if ( _comediHandle->simulator )
+        _comediHandle->simulator->setBit( channel, value );
+    else
+        _comediHandle->setBits[ channel ] = value;
 }
 
 
 void lowlevel::IO::io_write_analog( int channel, int value ) {
-    std::cout << "write analog, channel " << channel << " value " << value << std::endl;
+    if ( _comediHandle->simulator )
+        _comediHandle->simulator->writeAnalog( channel, value );
+    else
+        std::cout << "write analog, channel " << channel << " value " << value << std::endl;
 }
 
 
 
 bool lowlevel::IO::io_read_bit( int channel ) {
+    if ( _comediHandle->simulator )
+        return _comediHandle->simulator->readBit( channel );
     auto it = _comediHandle->setBits.find( channel );
     return it != _comediHandle->setBits.end()
         ? it->second
@@ -0,0 +1,216 @@
+#include <elevator/journal.h>
+#include <elevator/restartwrapper.h>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace elevator {
+
+using namespace serialization;
+
+const long Journal::defaultRegionSize;
+
+static const uint64_t journalMagic = 0x4c4e524a56454c45ull; // "ELEVJRNL"
+
+// FNV-1a
+static uint32_t checksum( TypeSignature type, const char *data, long size ) {
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash]( const char *ptr, long len ) {
+        for ( long i = 0; i < len; ++i ) {
+            hash ^= uint8_t( ptr[ i ] );
+            hash *= 16777619u;
+        }
+    };
+    mix( reinterpret_cast< const char * >( &type ), sizeof( type ) );
+    mix( data, size );
+    return hash;
+}
+
+Journal::Journal( std::string path, long regionSize ) :
+    _regionSize( regionSize ), _region( 1 ), _generation( 0 ), _used( sizeof( Header ) ),
+    _hasRecovered( false ), _terminate( false )
+{
+    assert_eq( regionSize % sysconf( _SC_PAGESIZE ), 0, "region size must be multiple of page size" );
+    int fd = ::open( path.c_str(), O_RDWR | O_CREAT, 0644 );
+    assert_leq( 0, fd, "cannot open journal" );
+    struct stat st;
+    int rc = fstat( fd, &st );
+    assert_eq( rc, 0, "cannot stat journal" );
+    if ( st.st_size != 2 * regionSize ) {
+        if ( st.st_size != 0 )
+            std::cerr << "WARNING: journal " << path << " has unexpected size, it will be discarded"
+                      << std::endl;
+        rc = ftruncate( fd, 0 );
+        assert_eq( rc, 0, "cannot truncate journal" );
+        rc = ftruncate( fd, 2 * regionSize );
+        assert_eq( rc, 0, "cannot resize journal" );
+    }
+    using Mode = wibble::sys::MMap::ProtectMode;
+    using wibble::operator|;
+    _map.map( fd, Mode::Read | Mode::Write | Mode::Shared ); // takes ownership of fd
+
+    _replay();
+    // start with clean region, so that garbage after last valid record
+    // can never be mistaken for a record
+    _compact();
+}
+
+Journal::~Journal() {
+    if ( _thr.joinable() ) {
+        _terminate = true;
+        _thr.join();
+    }
+    for ( ;; ) {
+        auto e = _queue.tryDequeue();
+        if ( e.isNothing() )
+            break;
+        _write( e.value() );
+    }
+    msync( _regionPtr( 0 ), 2 * _regionSize, MS_SYNC );
+}
+
+wibble::Maybe< Checkpoint > Journal::recovered() const {
+    return _hasRecovered
+        ? wibble::Maybe< Checkpoint >::Just( _recovered )
+        : wibble::Maybe< Checkpoint >::Nothing();
+}
+
+void Journal::run() {
+    _thr = std::thread( restartWrapper( &Journal::_loop, ThreadClass::Background, "journal" ), this );
+}
+
+void Journal::record( const StateChange &change ) {
+    _queue.enqueue( Entry{ true, change, RequestEvent() } );
+}
+
+void Journal::record( const RequestEvent &event ) {
+    _queue.enqueue( Entry{ false, StateChange(), event } );
+}
+
+void Journal::_replay() {
+    int best = -1;
+    for ( int r = 0; r < 2; ++r ) {
+        Header &h = _header( r );
+        if ( h.magic == journalMagic && (best < 0 || h.generation > _header( best ).generation) )
+            best = r;
+    }
+    if ( best < 0 )
+        return; // fresh journal
+
+    _region = best;
+    _generation = _header( best ).generation;
+    const char *ptr = _regionPtr( _region );
+    while ( _used + long( sizeof( RecordHeader ) ) <= _regionSize ) {
+        RecordHeader rh;
+        std::memcpy( &rh, ptr + _used, sizeof( RecordHeader ) );
+        if ( rh.size == 0 || rh.size > _regionSize - _used - sizeof( RecordHeader ) )
+            break;
+        const char *data = ptr + _used + sizeof( RecordHeader );
+        if ( checksum( rh.type, data, rh.size ) != rh.checksum ) {
+            std::cerr << "WARNING: torn record in journal, replay stopped" << std::endl;
+            break;
+        }
+        // journal of older (or otherwise incompatible) version is treated
+        // just like torn one, it must not prevent start
+        if ( !_apply( Serialized{ rh.type, data, rh.size } ) ) {
+            std::cerr << "WARNING: malformed record in journal, replay stopped" << std::endl;
+            break;
+        }
+        _used += sizeof( RecordHeader ) + rh.size;
+    }
+    _hasRecovered = _model.state.id != INT_MIN;
+    _recovered = _model;
+}
+
+bool Journal::_apply( Serialized &&serial ) {
+    switch ( serial.type() ) {
+        case TypeSignature::Checkpoint: {
+            auto cp = Serializer::decode< Checkpoint >( serial.rawData(), serial.size() );
+            if ( cp.isNothing() )
+                return false;
+            _model = cp.value();
+            return true; }
+        case TypeSignature::ElevatorState: {
+            auto change = Serializer::decode< StateChange >( serial.rawData(), serial.size() );
+            if ( change.isNothing() )
+                return false;
+            _model.state = change.value().state;
+            return true; }
+        case TypeSignature::RequestEvent: {
+            auto ev = Serializer::decode< RequestEvent >( serial.rawData(), serial.size() );
+            if ( ev.isNothing() )
+                return false;
+            const Command &comm = ev.value().command;
+            if ( ev.value().added )
+                _model.requests.push_back( comm );
+            else {
+                auto it = std::find_if( _model.requests.begin(), _model.requests.end(),
+                        [&]( const Command &c ) { return c.tuple() == comm.tuple(); } );
+                if ( it != _model.requests.end() )
+                    _model.requests.erase( it );
+            }
+            return true; }
+        default:
+            return false;
+    }
+}
+
+bool Journal::_append( const Serialized &serial ) {
+    long need = sizeof( RecordHeader ) + serial.size();
+    if ( _used + need > _regionSize )
+        return false;
+    char *ptr = _regionPtr( _region ) + _used;
+    // data first, header with checksum makes record valid
+    std::memcpy( ptr + sizeof( RecordHeader ), serial.rawData(), serial.size() );
+    RecordHeader rh{ uint32_t( serial.size() ),
+        checksum( serial.type(), serial.rawData(), serial.size() ), serial.type() };
+    std::memcpy( ptr, &rh, sizeof( RecordHeader ) );
+    _used += need;
+    return true;
+}
+
+void Journal::_compact() {
+    int other = 1 - _region;
+    char *ptr = _regionPtr( other );
+    std::memset( ptr, 0, _regionSize );
+    _region = other;
+    _used = sizeof( Header );
+    bool fits = _append( Serializer::serialize( _model ) );
+    assert( fits, "snapshot does not fit into journal region" );
+    msync( ptr, _regionSize, MS_SYNC );
+
+    // region becomes valid only when magic is written, on crash before
+    // that the old one is still used
+    Header &h = _header( other );
+    h.generation = ++_generation;
+    h.magic = journalMagic;
+    msync( ptr, sizeof( Header ), MS_SYNC );
+}
+
+void Journal::_write( const Entry &e ) {
+    Serialized serial = e.isState
+        ? Serializer::serialize( e.change )
+        : Serializer::serialize( e.event );
+    bool valid = _apply( Serialized{ serial.type(), serial.rawData(), serial.size() } );
+    assert( valid, "journal cannot apply its own record" );
+    if ( !_append( serial ) )
+        _compact(); // snapshot already contains this record
+}
+
+void Journal::_loop() {
+    while ( !_terminate.load( std::memory_order_relaxed ) ) {
+        auto e = _queue.timeoutDequeue( 100 );
+        if ( e.isNothing() ) {
+            // idle, good time to schedule writeback
+            msync( _regionPtr( 0 ), 2 * _regionSize, MS_ASYNC );
+            continue;
+        }
+        _write( e.value() );
+    }
+}
+
+}
@@ -0,0 +1,111 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Crash-safe journal of local elevator state and pending requests
+ *
+ * Journal is file mapped to memory which consists of two regions, only the
+ * one with higher generation is valid. Records (local state changes and
+ * additions and removals of requests) are appended to the valid region,
+ * every record carries its size and checksum so that record torn by crash
+ * ends replay. When region fills up, compacted snapshot is written to the
+ * other region which then gets higher generation.
+ *
+ * Records are only enqueued by callers, they are written by journal's own
+ * thread so that writing never blocks control loop.
+ */
+
+#include <wibble/sys/mmap_v2.h>
+#include <wibble/maybe.h>
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include <elevator/checkpoint.h>
+#include <elevator/concurrentqueue.h>
+#include <elevator/serialization.h>
+
+#ifndef SRC_JOURNAL_H
+#define SRC_JOURNAL_H
+
+namespace elevator {
+
+struct RequestEvent {
+    using Tuple = std::tuple< bool, Command >;
+
+    RequestEvent() : added( false ) { }
+    RequestEvent( bool added, Command command ) : added( added ), command( command ) { }
+    explicit RequestEvent( Tuple t ) : RequestEvent( std::get< 0 >( t ), std::get< 1 >( t ) ) { }
+
+    Tuple tuple() const { return std::make_tuple( added, command ); }
+    static serialization::TypeSignature type() {
+        return serialization::TypeSignature::RequestEvent;
+    }
+
+    bool added;
+    Command command;
+};
+
+struct Journal {
+    static const long defaultRegionSize = 1024 * 1024;
+
+    /* opens (or creates) journal and replays it */
+    explicit Journal( std::string path, long regionSize = defaultRegionSize );
+    ~Journal();
+
+    /* state and requests at the time of last complete record */
+    wibble::Maybe< Checkpoint > recovered() const;
+
+    /* spawn writer thread */
+    void run();
+
+    /* enqueue record, non blocking */
+    void record( const StateChange & );
+    void record( const RequestEvent & );
+
+    /* generation of valid region, for diagnostics */
+    uint64_t generation() const { return _generation; }
+
+  private:
+    struct Header {
+        uint64_t magic;
+        uint64_t generation;
+    };
+    struct RecordHeader {
+        uint32_t size;
+        uint32_t checksum; // of type and data
+        serialization::TypeSignature type;
+    };
+
+    wibble::sys::MMap _map;
+    const long _regionSize;
+    int _region;
+    uint64_t _generation;
+    long _used; // within current region, including header
+    Checkpoint _model; // what replay of current region gives
+    bool _hasRecovered;
+    Checkpoint _recovered;
+
+    // serialization is left to writer thread too
+    struct Entry {
+        bool isState;
+        StateChange change;
+        RequestEvent event;
+    };
+    ConcurrentQueue< Entry > _queue;
+    std::atomic< bool > _terminate;
+    std::thread _thr;
+
+    char *_regionPtr( int region ) { return &_map[ region * _regionSize ]; }
+    Header &_header( int region ) { return _map.get< Header >( region * _regionSize ); }
+
+    void _replay();
+    bool _apply( serialization::Serialized && ); // false if malformed
+    bool _append( const serialization::Serialized & );
+    void _compact();
+    void _write( const Entry & );
+    void _loop();
+};
+
+}
+
+#endif // SRC_JOURNAL_H
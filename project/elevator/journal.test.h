@@ -0,0 +1,96 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <elevator/journal.h>
+#include <elevator/test.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace elevator;
+
+struct TestJournal {
+    static StateChange change( int floor ) {
+        StateChange ch;
+        ch.changeType = ChangeType::OtherChange;
+        ch.state.id = 1;
+        ch.state.lastFloor = floor;
+        return ch;
+    }
+
+    Test replay() {
+        test::TempFile file( "journal" );
+        {
+            Journal j{ file.path };
+            assert( j.recovered().isNothing(), "fresh journal" );
+            j.run();
+            j.record( change( 2 ) );
+            j.record( RequestEvent( true, Command{ CommandType::CallToFloorAndGoUp, 1, 2 } ) );
+            j.record( RequestEvent( true, Command{ CommandType::CallToFloorAndGoDown, 1, 3 } ) );
+            j.record( RequestEvent( false, Command{ CommandType::CallToFloorAndGoUp, 1, 2 } ) );
+            j.record( change( 3 ) );
+        }
+        Journal j{ file.path };
+        auto cp = j.recovered();
+        assert( !cp.isNothing(), "state should be recovered" );
+        assert_eq( cp.value().state.lastFloor, 3, "" );
+        assert_eq( cp.value().requests.size(), 1u, "" );
+        assert_eq( cp.value().requests[ 0 ].targetFloor, 3, "" );
+    }
+
+    Test compaction() {
+        test::TempFile file( "journal" );
+        long region = sysconf( _SC_PAGESIZE );
+        uint64_t generation;
+        {
+            Journal j{ file.path, region };
+            generation = j.generation();
+            for ( int i = 0; i < 1000; ++i )
+                j.record( change( i % 4 ) );
+        } // records are written on destruction
+        Journal j{ file.path, region };
+        assert_lt( generation + 2, j.generation(), "journal should have been compacted" );
+        assert( !j.recovered().isNothing(), "" );
+        assert_eq( j.recovered().value().state.lastFloor, 999 % 4, "" );
+    }
+
+    // record with correct checksum but data which cannot be decoded (such
+    // as from older version) ends replay, just like torn one
+    Test malformed() {
+        test::TempFile file( "journal" );
+        long region = sysconf( _SC_PAGESIZE );
+        std::vector< char > data( 2 * region );
+        struct { uint64_t magic, generation; } header{ 0x4c4e524a56454c45ull, 1 };
+        std::memcpy( &data[ 0 ], &header, sizeof( header ) );
+        long offset = sizeof( header );
+        auto append = [&]( serialization::TypeSignature type, const char *ptr, uint32_t size ) {
+            uint32_t hash = 2166136261u;
+            auto mix = [&hash]( const char *p, long len ) {
+                for ( long i = 0; i < len; ++i ) {
+                    hash ^= uint8_t( p[ i ] );
+                    hash *= 16777619u;
+                }
+            };
+            mix( reinterpret_cast< const char * >( &type ), sizeof( type ) );
+            mix( ptr, size );
+            struct { uint32_t size, checksum; serialization::TypeSignature type; } rh{ size, hash, type };
+            std::memcpy( &data[ offset ], &rh, sizeof( rh ) );
+            std::memcpy( &data[ offset + sizeof( rh ) ], ptr, size );
+            offset += sizeof( rh ) + size;
+        };
+        auto good = serialization::Serializer::serialize( change( 2 ) );
+        append( good.type(), good.rawData(), good.size() );
+        append( serialization::TypeSignature::RequestEvent, "xyz", 3 );
+        auto after = serialization::Serializer::serialize( change( 3 ) );
+        append( after.type(), after.rawData(), after.size() );
+        {
+            std::ofstream out( file.path, std::ios::binary );
+            out.write( &data[ 0 ], data.size() );
+        }
+
+        Journal j{ file.path, region };
+        assert( !j.recovered().isNothing(), "records before malformed one are used" );
+        assert_eq( j.recovered().value().state.lastFloor, 2, "" );
+        assert( j.recovered().value().requests.empty(), "" );
+    }
+};
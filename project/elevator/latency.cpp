@@ -0,0 +1,166 @@
+#include <elevator/latency.h>
+#include <elevator/test.h>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <climits>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace elevator {
+
+const int Histogram::subBits;
+const int Histogram::subCount;
+const int Histogram::maxExponent;
+const int Histogram::bucketCount;
+
+int Histogram::bucket( int64_t value ) {
+    if ( value < subCount )
+        return value < 0 ? 0 : value;
+    int exp = 63 - __builtin_clzll( value );
+    if ( exp > maxExponent )
+        return bucketCount - 1;
+    // top subBits + 1 bits of value, the highest one is always set
+    int sub = int( value >> (exp - subBits) ) - subCount;
+    return (exp - subBits + 1) * subCount + sub;
+}
+
+int64_t Histogram::lowerBound( int bucket ) {
+    if ( bucket < subCount )
+        return bucket;
+    int exp = bucket / subCount + subBits - 1;
+    int sub = bucket % subCount;
+    return int64_t( subCount + sub ) << (exp - subBits);
+}
+
+void Histogram::record( int64_t value, int64_t count ) {
+    if ( value < 0 )
+        value = 0;
+    _buckets[ bucket( value ) ].fetch_add( count, std::memory_order_relaxed );
+    _count.fetch_add( count, std::memory_order_relaxed );
+    _sum.fetch_add( value * count, std::memory_order_relaxed );
+
+    int64_t m = _max.load( std::memory_order_relaxed );
+    while ( value > m && !_max.compare_exchange_weak( m, value, std::memory_order_relaxed ) ) { }
+    m = _min.load( std::memory_order_relaxed );
+    while ( value < m && !_min.compare_exchange_weak( m, value, std::memory_order_relaxed ) ) { }
+}
+
+void Histogram::reset() {
+    for ( auto &b : _buckets )
+        b.store( 0, std::memory_order_relaxed );
+    _count.store( 0, std::memory_order_relaxed );
+    _sum.store( 0, std::memory_order_relaxed );
+    _min.store( INT64_MAX, std::memory_order_relaxed );
+    _max.store( 0, std::memory_order_relaxed );
+}
+
+int64_t Histogram::min() const {
+    return count() ? _min.load( std::memory_order_relaxed ) : 0;
+}
+
+double Histogram::mean() const {
+    int64_t c = count();
+    return c ? double( _sum.load( std::memory_order_relaxed ) ) / c : 0;
+}
+
+int64_t Histogram::percentile( double p ) const {
+    assert_leq( 0, p, "invalid percentile" );
+    assert_leq( p, 100, "invalid percentile" );
+    // buckets can be updated concurrently, use their own total
+    int64_t total = 0;
+    for ( auto &b : _buckets )
+        total += b.load( std::memory_order_relaxed );
+    if ( total == 0 )
+        return 0;
+    int64_t rank = int64_t( p / 100 * total + 0.5 );
+    if ( rank < 1 )
+        rank = 1;
+    int64_t seen = 0;
+    for ( int i = 0; i < bucketCount; ++i ) {
+        seen += _buckets[ i ].load( std::memory_order_relaxed );
+        if ( seen >= rank )
+            return std::min( upperBound( i ), max() );
+    }
+    return max();
+}
+
+std::string Histogram::summary() const {
+    std::stringstream ss;
+    ss << "count = " << count() << ", min = " << min()
+       << ", mean = " << int64_t( mean() ) << ", p50 = " << percentile( 50 )
+       << ", p90 = " << percentile( 90 ) << ", p99 = " << percentile( 99 )
+       << ", p99.9 = " << percentile( 99.9 ) << ", max = " << max();
+    return ss.str();
+}
+
+namespace latency {
+
+const char *showStage( Stage s ) {
+    switch ( s ) {
+        case Stage::ElevatorLoop: return "ElevatorLoop";
+        case Stage::LocalStateQueue: return "LocalStateQueue";
+        case Stage::RemoteStateDelivery: return "RemoteStateDelivery";
+        case Stage::SchedulerUpdate: return "SchedulerUpdate";
+        case Stage::ButtonToCommand: return "ButtonToCommand";
+    }
+    assert_unreachable( "unhandled case" );
+}
+
+Histogram &histogram( Stage s ) {
+    static Histogram histograms[ stageCount ];
+    return histograms[ int( s ) ];
+}
+
+static std::mutex dumpersLock;
+
+static std::vector< std::function< void( std::ostream & ) > > &dumpers() {
+    static std::vector< std::function< void( std::ostream & ) > > d;
+    return d;
+}
+
+void addDumper( std::function< void( std::ostream & ) > dumper ) {
+    std::lock_guard< std::mutex > g{ dumpersLock };
+    dumpers().push_back( dumper );
+}
+
+void dump( std::ostream &os ) {
+    std::stringstream ss;
+    ss << "latency [us]:" << std::endl;
+    for ( int i = 0; i < stageCount; ++i )
+        ss << "    " << std::setw( 20 ) << std::left << showStage( Stage( i ) ) << ": "
+           << histogram( Stage( i ) ).summary() << std::endl;
+    {
+        std::lock_guard< std::mutex > g{ dumpersLock };
+        for ( auto &d : dumpers() )
+            d( ss );
+    }
+    os << ss.str() << std::flush;
+}
+
+void dumpOnSignal( int signal ) {
+    static pid_t started = 0;
+    if ( started == getpid() )
+        return; // threads do not survive fork, so only check current process
+    started = getpid();
+
+    sigset_t set;
+    sigemptyset( &set );
+    sigaddset( &set, signal );
+    int r = pthread_sigmask( SIG_BLOCK, &set, nullptr );
+    assert_eq( r, 0, "cannot block dump signal" );
+
+    std::thread( [set]() {
+            while ( true ) {
+                int sig;
+                if ( sigwait( &set, &sig ) == 0 )
+                    dump( std::cerr );
+            }
+        } ).detach();
+}
+
+}
+}
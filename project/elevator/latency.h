@@ -0,0 +1,100 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Latency instrumentation
+ *
+ * Histogram is lock-free HDR-style histogram: values are sorted into
+ * power-of-two ranges each of which is split into 16 linear buckets, so
+ * relative error of reported values is at most 1/16 on whole range.
+ *
+ * There is one global histogram for each stage (in microseconds), they can
+ * be recorded from any thread and dumped on signal (SIGUSR1 by default).
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <functional>
+#include <signal.h>
+
+#include <elevator/time.h>
+
+#ifndef SRC_LATENCY_H
+#define SRC_LATENCY_H
+
+namespace elevator {
+
+struct Histogram {
+    static const int subBits = 4;
+    static const int subCount = 1 << subBits;
+    static const int maxExponent = 40; // values up to 2^41 - 1
+    static const int bucketCount = subCount * (maxExponent - subBits + 2);
+
+    Histogram() { reset(); }
+    Histogram( const Histogram & ) = delete;
+
+    /* negative values are recorded as 0, too large ones as maximum */
+    void record( int64_t value, int64_t count = 1 );
+    void reset();
+
+    int64_t count() const { return _count.load( std::memory_order_relaxed ); }
+    int64_t min() const;
+    int64_t max() const { return _max.load( std::memory_order_relaxed ); }
+    double mean() const;
+    /* upper bound of bucket with given percentile (0 - 100) */
+    int64_t percentile( double p ) const;
+
+    /* one line summary */
+    std::string summary() const;
+
+    static int bucket( int64_t value );
+    static int64_t lowerBound( int bucket );
+    static int64_t upperBound( int bucket ) { return lowerBound( bucket + 1 ) - 1; }
+
+  private:
+    std::atomic< int64_t > _buckets[ bucketCount ];
+    std::atomic< int64_t > _count;
+    std::atomic< int64_t > _sum;
+    std::atomic< int64_t > _min;
+    std::atomic< int64_t > _max;
+};
+
+namespace latency {
+
+enum class Stage {
+    ElevatorLoop,       // one iteration of Elevator::_loop
+    LocalStateQueue,    // local StateChange from creation to scheduler
+    RemoteStateDelivery, // remote StateChange from creation (on remote node) to scheduler
+    SchedulerUpdate,    // processing of one StateChange in scheduler
+    ButtonToCommand,    // button press to application of CallToFloor command
+};
+const int stageCount = int( Stage::ButtonToCommand ) + 1;
+
+const char *showStage( Stage );
+Histogram &histogram( Stage );
+
+/* record time elapsed since construction on destruction */
+struct StageTimer {
+    explicit StageTimer( Stage stage ) : _stage( stage ), _start( nowMicro() ) { }
+    ~StageTimer() { histogram( _stage ).record( nowMicro() - _start ); }
+
+  private:
+    Stage _stage;
+    MicrosecondTime _start;
+};
+
+void dump( std::ostream & );
+
+/* additional statistics to be written by dump, dumper must stay valid
+ * as long as dump can be called */
+void addDumper( std::function< void( std::ostream & ) > dumper );
+
+/* block signal in calling thread and start thread which dumps histograms to
+ * stderr when signal is received; must be called before other threads are
+ * started so that they inherit signal mask, at most once per process */
+void dumpOnSignal( int signal = SIGUSR1 );
+
+}
+}
+
+#endif // SRC_LATENCY_H
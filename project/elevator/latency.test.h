@@ -0,0 +1,40 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <elevator/latency.h>
+#include <elevator/test.h>
+#include <memory>
+
+using namespace elevator;
+
+struct TestLatency {
+    Test buckets() {
+        for ( int64_t v = 0; v < (int64_t( 1 ) << 20); v += 1 + v / 7 ) {
+            int b = Histogram::bucket( v );
+            assert_leq( Histogram::lowerBound( b ), v, "" );
+            assert_leq( v, Histogram::upperBound( b ), "" );
+            // relative error is bounded
+            assert_leq( (Histogram::upperBound( b ) - Histogram::lowerBound( b )) * 16, v, "" );
+        }
+        assert_eq( Histogram::bucket( -5 ), 0, "" );
+        assert_eq( Histogram::bucket( INT64_MAX ), Histogram::bucketCount - 1, "" );
+    }
+
+    Test percentiles() {
+        std::unique_ptr< Histogram > h( new Histogram() );
+        assert_eq( h->percentile( 50 ), 0, "" );
+        for ( int i = 1; i <= 1000; ++i )
+            h->record( i );
+        assert_eq( h->count(), 1000, "" );
+        assert_eq( h->min(), 1, "" );
+        assert_eq( h->max(), 1000, "" );
+        assert_eq( int( h->mean() ), 500, "" );
+        // at most 1/16 error
+        assert_leq( 500, h->percentile( 50 ), "" );
+        assert_leq( h->percentile( 50 ), 500 + 500 / 16, "" );
+        assert_leq( 990, h->percentile( 99 ), "" );
+        assert_eq( h->percentile( 100 ), 1000, "" );
+        h->reset();
+        assert_eq( h->count(), 0, "" );
+        assert_eq( h->max(), 0, "" );
+    }
+};
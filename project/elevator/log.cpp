@@ -0,0 +1,170 @@
+#include <elevator/log.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <pthread.h>
+#include <signal.h>
+
+namespace elevator {
+namespace log {
+
+const int Record::maxArgs;
+const size_t Ring::capacity;
+
+/* ring of current thread, it is marked orphaned when thread exits
+ * and dropped by drain thread once it is empty */
+struct RingHandle {
+    std::shared_ptr< Ring > ring;
+    ~RingHandle() {
+        if ( ring )
+            ring->orphaned.store( true, std::memory_order_release );
+    }
+};
+
+static thread_local RingHandle threadRing;
+
+Logger &Logger::instance() {
+    static Logger *logger = [] {
+        Logger *l = new Logger();
+        std::atexit( [] { Logger::instance().flush(); } );
+        return l;
+    }();
+    return *logger;
+}
+
+Logger::Logger() : _level( Level::Info ), _dropped( 0 ), _sink( &std::cerr ) {
+    // drain thread does not survive fork, make sure it is not holding
+    // locks at the time of fork and start new one in child
+    pthread_atfork(
+        [] {
+            Logger &l = Logger::instance();
+            l._drainLock.lock();
+            l._ringsLock.lock();
+        },
+        [] {
+            Logger &l = Logger::instance();
+            l._ringsLock.unlock();
+            l._drainLock.unlock();
+        },
+        [] {
+            Logger &l = Logger::instance();
+            l._ringsLock.unlock();
+            l._drainLock.unlock();
+            l._startDrain();
+        } );
+    _startDrain();
+}
+
+void Logger::_startDrain() {
+    // signals should be handled by threads which expect them
+    sigset_t all, old;
+    sigfillset( &all );
+    pthread_sigmask( SIG_BLOCK, &all, &old );
+    _thr = std::thread( &Logger::_loop, this );
+    _thr.detach();
+    pthread_sigmask( SIG_SETMASK, &old, nullptr );
+}
+
+void Logger::setSink( std::ostream &os ) {
+    std::lock_guard< std::mutex > g{ _drainLock };
+    _sink = &os;
+}
+
+Ring &Logger::_ring() {
+    if ( !threadRing.ring ) {
+        threadRing.ring = std::make_shared< Ring >();
+        std::lock_guard< std::mutex > g{ _ringsLock };
+        _rings.push_back( threadRing.ring );
+    }
+    return *threadRing.ring;
+}
+
+void Logger::push( const Record &r ) {
+    _ring().push( r );
+}
+
+static void appendArg( std::string &out, const Arg &a ) {
+    switch ( a.kind ) {
+        case Arg::Kind::Signed: out += std::to_string( a.i ); break;
+        case Arg::Kind::Unsigned: out += std::to_string( a.u ); break;
+        case Arg::Kind::Double: out += std::to_string( a.d ); break;
+        case Arg::Kind::String: out += a.s ? a.s : "(null)"; break;
+    }
+}
+
+static const char *showLevel( Level l ) {
+    switch ( l ) {
+        case Level::Debug: return "DEBUG: ";
+        case Level::Info: return "";
+        case Level::Notice: return "NOTICE: ";
+        case Level::Warning: return "WARNING: ";
+        case Level::Error: return "ERROR: ";
+    }
+    return "";
+}
+
+std::string format( const Record &r ) {
+    std::string out = showLevel( r.level );
+    int arg = 0;
+    for ( const char *f = r.format; *f; ++f ) {
+        if ( f[ 0 ] == '{' && f[ 1 ] == '}' && arg < r.argc ) {
+            appendArg( out, r.args[ arg++ ] );
+            ++f;
+        } else
+            out += *f;
+    }
+    return out;
+}
+
+void Logger::flush() {
+    std::lock_guard< std::mutex > g{ _drainLock };
+
+    std::vector< std::shared_ptr< Ring > > rings;
+    {
+        std::lock_guard< std::mutex > rg{ _ringsLock };
+        // orphaned ring will get no more records, so if it is empty now
+        // it can be dropped
+        auto it = std::remove_if( _rings.begin(), _rings.end(),
+                []( const std::shared_ptr< Ring > &r ) {
+                    return r->orphaned.load( std::memory_order_acquire ) && r->empty();
+                } );
+        _rings.erase( it, _rings.end() );
+        rings = _rings;
+    }
+
+    std::vector< Record > batch;
+    long dropped = 0;
+    for ( auto &r : rings ) {
+        r->popAll( [&]( const Record &rec ) { batch.push_back( rec ); } );
+        dropped += r->dropped.exchange( 0, std::memory_order_relaxed );
+    }
+    if ( batch.empty() && dropped == 0 )
+        return;
+
+    // records of one thread are ordered, merge threads by time
+    std::stable_sort( batch.begin(), batch.end(),
+            []( const Record &a, const Record &b ) { return a.time < b.time; } );
+    _buffer.clear();
+    for ( auto &rec : batch ) {
+        _buffer += format( rec );
+        _buffer += '\n';
+    }
+    if ( dropped ) {
+        _dropped.fetch_add( dropped, std::memory_order_relaxed );
+        _buffer += "WARNING: " + std::to_string( dropped ) + " log record(s) dropped\n";
+    }
+    _sink->write( _buffer.data(), _buffer.size() );
+    _sink->flush();
+}
+
+void Logger::_loop() {
+    while ( true ) {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        flush();
+    }
+}
+
+}
+}
@@ -0,0 +1,209 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Asynchronous logger
+ *
+ * Logging thread only checks level and copies format string pointer and
+ * binary encoded arguments into its own lock-free ring, formatting and
+ * writing is done by background drain thread. Format strings must be string
+ * literals (pointer to format identifies record) and so must be string
+ * arguments, arguments are substituted for {} in format. When ring is full,
+ * record is dropped and counted, logging never blocks.
+ *
+ *     log::warning( "re-sending request to {}, floor {}", id, floor );
+ */
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <type_traits>
+
+#include <elevator/time.h>
+
+#ifndef SRC_LOG_H
+#define SRC_LOG_H
+
+namespace elevator {
+namespace log {
+
+enum class Level : uint8_t { Debug, Info, Notice, Warning, Error };
+
+struct Arg {
+    enum class Kind : uint8_t { Signed, Unsigned, Double, String };
+
+    Arg() : kind( Kind::Signed ), i( 0 ) { }
+
+    Kind kind;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const char *s;
+    };
+};
+
+template< typename T >
+auto toArg( T v ) -> typename std::enable_if< std::is_integral< T >::value
+        && std::is_signed< T >::value, Arg >::type
+{
+    Arg a;
+    a.kind = Arg::Kind::Signed;
+    a.i = v;
+    return a;
+}
+
+template< typename T >
+auto toArg( T v ) -> typename std::enable_if< std::is_integral< T >::value
+        && !std::is_signed< T >::value, Arg >::type
+{
+    Arg a;
+    a.kind = Arg::Kind::Unsigned;
+    a.u = v;
+    return a;
+}
+
+template< typename T >
+auto toArg( T v ) -> typename std::enable_if< std::is_enum< T >::value, Arg >::type
+{
+    return toArg( typename std::underlying_type< T >::type( v ) );
+}
+
+template< typename T >
+auto toArg( T v ) -> typename std::enable_if< std::is_floating_point< T >::value, Arg >::type
+{
+    Arg a;
+    a.kind = Arg::Kind::Double;
+    a.d = v;
+    return a;
+}
+
+/* string must outlive drain, i.e. it should be literal */
+inline Arg toArg( const char *s ) {
+    Arg a;
+    a.kind = Arg::Kind::String;
+    a.s = s;
+    return a;
+}
+
+struct Record {
+    static const int maxArgs = 8;
+
+    const char *format;
+    Level level;
+    uint8_t argc;
+    MicrosecondTime time;
+    Arg args[ maxArgs ];
+};
+
+/* single producer, single consumer ring */
+struct Ring {
+    static const size_t capacity = 512;
+
+    Ring() : head( 0 ), tail( 0 ), orphaned( false ), dropped( 0 ) { }
+
+    bool push( const Record &r ) {
+        size_t h = head.load( std::memory_order_relaxed );
+        if ( h - tail.load( std::memory_order_acquire ) == capacity ) {
+            dropped.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+        records[ h % capacity ] = r;
+        head.store( h + 1, std::memory_order_release );
+        return true;
+    }
+
+    template< typename Yield >
+    void popAll( Yield yield ) {
+        size_t t = tail.load( std::memory_order_relaxed );
+        size_t h = head.load( std::memory_order_acquire );
+        for ( ; t != h; ++t )
+            yield( records[ t % capacity ] );
+        tail.store( t, std::memory_order_release );
+    }
+
+    bool empty() const {
+        return head.load( std::memory_order_acquire ) == tail.load( std::memory_order_acquire );
+    }
+
+    std::atomic< size_t > head; // written by producer
+    std::atomic< size_t > tail; // written by consumer
+    std::atomic< bool > orphaned; // producer thread exited
+    std::atomic< long > dropped;
+    Record records[ capacity ];
+};
+
+struct Logger {
+    /* logger is never destructed (threads can log during exit),
+     * it is flushed at exit */
+    static Logger &instance();
+
+    Level level() const { return _level.load( std::memory_order_relaxed ); }
+    void setLevel( Level l ) { _level.store( l, std::memory_order_relaxed ); }
+    void setSink( std::ostream & );
+
+    void push( const Record & );
+    /* synchronously write everything logged so far */
+    void flush();
+
+    long dropped() const { return _dropped.load( std::memory_order_relaxed ); }
+
+  private:
+    Logger();
+    Ring &_ring();
+    void _startDrain();
+    void _loop();
+
+    std::atomic< Level > _level;
+    std::atomic< long > _dropped;
+    std::mutex _ringsLock;
+    std::vector< std::shared_ptr< Ring > > _rings;
+    std::mutex _drainLock;
+    std::ostream *_sink;
+    std::string _buffer;
+    std::thread _thr;
+};
+
+inline void fill( Arg * ) { }
+
+template< typename T, typename... Ts >
+void fill( Arg *to, const T &v, const Ts &...vs ) {
+    *to = toArg( v );
+    fill( to + 1, vs... );
+}
+
+template< typename... Args >
+void write( Level level, const char *format, const Args &...args ) {
+    static_assert( sizeof...( Args ) <= Record::maxArgs, "too many arguments for log record" );
+    Logger &logger = Logger::instance();
+    if ( level < logger.level() )
+        return;
+    Record r;
+    r.format = format;
+    r.level = level;
+    r.argc = sizeof...( Args );
+    r.time = nowMicro();
+    fill( r.args, args... );
+    logger.push( r );
+}
+
+template< typename... Args >
+void debug( const char *format, const Args &...args ) { write( Level::Debug, format, args... ); }
+template< typename... Args >
+void info( const char *format, const Args &...args ) { write( Level::Info, format, args... ); }
+template< typename... Args >
+void notice( const char *format, const Args &...args ) { write( Level::Notice, format, args... ); }
+template< typename... Args >
+void warning( const char *format, const Args &...args ) { write( Level::Warning, format, args... ); }
+template< typename... Args >
+void error( const char *format, const Args &...args ) { write( Level::Error, format, args... ); }
+
+/* format record the way drain thread does */
+std::string format( const Record & );
+
+}
+}
+
+#endif // SRC_LOG_H
@@ -0,0 +1,75 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <elevator/log.h>
+#include <elevator/state.h>
+#include <elevator/test.h>
+#include <sstream>
+
+using namespace elevator;
+
+struct TestLog {
+    // logger is global, restore it after each test
+    struct Capture {
+        Capture() : logger( log::Logger::instance() ), level( logger.level() ) {
+            logger.flush();
+            logger.setSink( out );
+        }
+        ~Capture() {
+            logger.flush();
+            logger.setSink( std::cerr );
+            logger.setLevel( level );
+        }
+        std::string get() {
+            logger.flush();
+            return out.str();
+        }
+
+        log::Logger &logger;
+        log::Level level;
+        std::stringstream out;
+    };
+
+    Test format() {
+        log::Record r;
+        r.format = "a = {}, b = {}, c = {}, d = {}";
+        r.level = log::Level::Warning;
+        r.argc = 4;
+        r.args[ 0 ] = log::toArg( -1 );
+        r.args[ 1 ] = log::toArg( 2u );
+        r.args[ 2 ] = log::toArg( "x" );
+        r.args[ 3 ] = log::toArg( Direction::Down );
+        assert_eq( log::format( r ), "WARNING: a = -1, b = 2, c = x, d = "
+                + std::to_string( int( Direction::Down ) ), "" );
+    }
+
+    Test level() {
+        Capture c;
+        c.logger.setLevel( log::Level::Warning );
+        log::info( "hidden {}", 1 );
+        log::warning( "shown {}", 2 );
+        assert_eq( c.get(), "WARNING: shown 2\n", "" );
+    }
+
+    Test threads() {
+        Capture c;
+        c.logger.setLevel( log::Level::Info );
+        std::thread t( [] { log::info( "other" ); } );
+        t.join(); // ring of exited thread must still be drained
+        log::info( "this" );
+        assert_eq( c.get(), "other\nthis\n", "" );
+    }
+
+    Test overflow() {
+        std::unique_ptr< log::Ring > ring( new log::Ring() );
+        log::Record r;
+        r.format = "";
+        r.argc = 0;
+        for ( size_t i = 0; i < log::Ring::capacity + 10; ++i )
+            ring->push( r );
+        assert_eq( ring->dropped.load(), 10, "" );
+        size_t count = 0;
+        ring->popAll( [&]( const log::Record & ) { ++count; } );
+        assert_eq( count, log::Ring::capacity, "" );
+        assert( ring->empty(), "" );
+    }
+};
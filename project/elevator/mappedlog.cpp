@@ -0,0 +1,59 @@
+#include <elevator/mappedlog.h>
+#include <elevator/test.h>
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace elevator {
+
+MappedLog::MappedLog( std::string path, uint64_t magic, long size ) :
+    _path( path ), _size( size ), _start( nowMicro() ), _used( sizeof( Header ) ), _dropped( 0 )
+{
+    assert_leq( long( sizeof( Header ) ), size, "log too small" );
+    int fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    assert_leq( 0, fd, "cannot open log" );
+    int rc = ftruncate( fd, size );
+    assert_eq( rc, 0, "cannot resize log" );
+    using Mode = wibble::sys::MMap::ProtectMode;
+    using wibble::operator|;
+    _map.map( fd, Mode::Read | Mode::Write | Mode::Shared ); // takes ownership of fd
+
+    Header &h = _map.get< Header >( 0 );
+    h.start = _start;
+    h.magic = magic;
+}
+
+MappedLog::~MappedLog() {
+    long used = std::min( _used.load(), _size );
+    msync( &_map[ 0 ], used, MS_SYNC );
+    _map.unmap();
+    // records were reserved before they were written, but no one is
+    // writing now; drop unused tail of file
+    int rc = truncate( _path.c_str(), used );
+    if ( rc != 0 )
+        std::cerr << "WARNING: cannot truncate " << _path << std::endl;
+    if ( dropped() )
+        std::cerr << "WARNING: " << _path << " was full, " << dropped()
+                  << " records were not written" << std::endl;
+}
+
+char *MappedLog::reserve( long size ) {
+    long need = align( size );
+    long offset = _used.fetch_add( need, std::memory_order_relaxed );
+    if ( offset + need > _size ) {
+        _dropped.fetch_add( 1, std::memory_order_relaxed );
+        return nullptr;
+    }
+    return &_map[ offset ];
+}
+
+MappedLogReader::MappedLogReader( std::string path, uint64_t magic ) :
+    _map( path ), _offset( sizeof( MappedLog::Header ) )
+{
+    assert_leq( sizeof( MappedLog::Header ), _map.size(), "log too short" );
+    assert_eq( _map.get< MappedLog::Header >( 0 ).magic, magic, "unexpected log file" );
+}
+
+}
@@ -0,0 +1,93 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Append-only log of records in file mapped to memory
+ *
+ * Log has fixed maximal size, space for record is reserved by single atomic
+ * addition, so appending never blocks and can be done from any thread (or
+ * signal handler). When log fills up, further records are dropped and
+ * counted. On destruction file is truncated to the records actually
+ * written.
+ *
+ * Every record starts with uint32_t size of the whole record (including its
+ * header). Size is written last, by commit, and only then record becomes
+ * valid, so log of crashed process can be read up to the first torn record.
+ * Records are aligned to 8 bytes so that they can be read in place.
+ */
+
+#include <wibble/sys/mmap_v2.h>
+
+#include <string>
+#include <atomic>
+
+#include <elevator/time.h>
+
+#ifndef SRC_MAPPED_LOG_H
+#define SRC_MAPPED_LOG_H
+
+namespace elevator {
+
+struct MappedLog {
+    struct Header {
+        uint64_t magic;
+        MicrosecondTime start; // nowMicro() when log was created
+    };
+
+    /* creates (overwrites) log file of given maximal size */
+    MappedLog( std::string path, uint64_t magic, long size );
+    ~MappedLog();
+
+    /* space for record of given size (including its header), nullptr if
+     * log is full */
+    char *reserve( long size );
+    /* make record valid by writing its size */
+    static void commit( char *record, uint32_t size ) {
+        reinterpret_cast< std::atomic< uint32_t > * >( record )->store(
+                size, std::memory_order_release );
+    }
+
+    MicrosecondTime start() const { return _start; }
+    long used() const { return _used.load( std::memory_order_relaxed ); }
+    long dropped() const { return _dropped.load( std::memory_order_relaxed ); }
+
+    static constexpr long align( long size ) { return (size + 7) & ~7l; }
+
+  private:
+    std::string _path;
+    wibble::sys::MMap _map;
+    const long _size;
+    MicrosecondTime _start;
+    std::atomic< long > _used;
+    std::atomic< long > _dropped;
+};
+
+/* sequential reader of MappedLog */
+struct MappedLogReader {
+    MappedLogReader( std::string path, uint64_t magic );
+
+    MicrosecondTime start() const { return _map.get< MappedLog::Header >( 0 ).start; }
+
+    /* next record with its header of given type (data follow it), nullptr
+     * at the end of log (or at torn record) */
+    template< typename RecordHeader >
+    const RecordHeader *next() {
+        long size = _map.size();
+        if ( _offset + long( sizeof( RecordHeader ) ) > size )
+            return nullptr;
+        const auto *rh = &_map.cget< RecordHeader >( _offset );
+        uint32_t record = *reinterpret_cast< const uint32_t * >( rh );
+        if ( record < sizeof( RecordHeader ) || long( record ) > size - _offset )
+            return nullptr;
+        _offset += MappedLog::align( record );
+        return rh;
+    }
+
+    void rewind() { _offset = sizeof( MappedLog::Header ); }
+
+  private:
+    wibble::sys::MMap _map;
+    long _offset;
+};
+
+}
+
+#endif // SRC_MAPPED_LOG_H
@@ -0,0 +1,345 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Building blocks of lightweight reliable channel over UDP
+ *
+ * Every (sender, receiver) pair forms a stream with its own sequence
+ * numbers. Receiver delivers messages of each stream in order and exactly
+ * once and acknowledges them with cumulative ack plus selective ack bitmap
+ * of up to 64 messages after cumulative one. Sender retransmits messages
+ * which were not acknowledged within retransmit timeout, which is calculated
+ * from measured round trip times (RFC 6298 style).
+ *
+ * Everything in this file is pure logic without any networking or locking,
+ * see reliablequeue.h for actual sender and receiver.
+ */
+
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <deque>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+
+#include <elevator/test.h>
+#include <elevator/time.h>
+#include <elevator/serialization.h>
+
+#ifndef SRC_RELIABILITY_H
+#define SRC_RELIABILITY_H
+
+namespace elevator {
+namespace reliable {
+
+using Seq = uint32_t;
+
+/* messages targeted to this peer are broadcasted and not sequenced,
+ * it has the same value as Command::ANY_ID */
+static const int anyPeer = INT_MAX;
+
+/* maximal number of messages in flight (and width of SACK bitmap) */
+static const int window = 64;
+
+/* retransmit timeout bounds, in microseconds */
+static const MicrosecondTime initialRto = 20 * 1000;
+static const MicrosecondTime minRto = 2 * 1000;
+static const MicrosecondTime maxRto = 1000 * 1000;
+
+/* message is given up after so many transmissions, it is up to application
+ * to repair it then */
+static const int maxTransmissions = 8;
+
+/* messages waiting for window (i.e. for unresponsive peer) are dropped
+ * above this limit */
+static const int maxBacklog = 1024;
+
+/* sequence number comparison which survives wrap-around */
+static inline bool seqLess( Seq a, Seq b ) { return int32_t( a - b ) < 0; }
+
+/* epoch of sender which starts now; epochs are wall clock milliseconds, so
+ * incarnation of sender started later has newer epoch (compared by seqLess,
+ * which works for restarts less than 24 days apart) */
+static inline uint32_t newEpoch() { return uint32_t( wallMicro() / 1000 ); }
+
+template< typename T >
+struct DataFrame {
+    using Tuple = std::tuple< int, int, uint32_t, Seq, Seq, T >;
+
+    DataFrame() : source( INT_MIN ), target( INT_MIN ), epoch( 0 ), seq( 0 ), base( 0 ) { }
+    DataFrame( int source, int target, uint32_t epoch, Seq seq, Seq base, T payload ) :
+        source( source ), target( target ), epoch( epoch ), seq( seq ), base( base ),
+        payload( payload )
+    { }
+    explicit DataFrame( Tuple t ) :
+        DataFrame( std::get< 0 >( t ), std::get< 1 >( t ), std::get< 2 >( t ),
+                std::get< 3 >( t ), std::get< 4 >( t ), std::get< 5 >( t ) )
+    { }
+
+    Tuple tuple() const {
+        return std::make_tuple( source, target, epoch, seq, base, payload );
+    }
+    static serialization::TypeSignature type() {
+        return serialization::TypeSignature::ReliableData;
+    }
+    /* offset of target in packet (it follows source) */
+    static int targetOffset() {
+        return serialization::Serializer::dataOffset() + sizeof( int );
+    }
+
+    int source;
+    int target;
+    uint32_t epoch; // identifies incarnation of sender
+    Seq seq;
+    Seq base; // all messages before this will not be retransmitted any more
+    T payload;
+};
+
+struct AckFrame {
+    using Tuple = std::tuple< int, int, uint32_t, Seq, uint64_t >;
+
+    AckFrame() : source( INT_MIN ), target( INT_MIN ), epoch( 0 ), cumulative( 0 ), sack( 0 ) { }
+    AckFrame( int source, int target, uint32_t epoch, Seq cumulative, uint64_t sack ) :
+        source( source ), target( target ), epoch( epoch ),
+        cumulative( cumulative ), sack( sack )
+    { }
+    explicit AckFrame( Tuple t ) :
+        AckFrame( std::get< 0 >( t ), std::get< 1 >( t ), std::get< 2 >( t ),
+                std::get< 3 >( t ), std::get< 4 >( t ) )
+    { }
+
+    Tuple tuple() const {
+        return std::make_tuple( source, target, epoch, cumulative, sack );
+    }
+    static serialization::TypeSignature type() {
+        return serialization::TypeSignature::ReliableAck;
+    }
+    static int targetOffset() {
+        return serialization::Serializer::dataOffset() + sizeof( int );
+    }
+
+    int source; // the acknowledging receiver
+    int target; // sender of data
+    uint32_t epoch; // sender's epoch, to ignore acks from its previous life
+    Seq cumulative; // everything before this was received
+    uint64_t sack; // bit i: cumulative + 1 + i was received
+};
+
+/* retransmit timeout estimator, see RFC 6298 (all in microseconds) */
+struct RttEstimator {
+    RttEstimator() : _srtt( 0 ), _rttvar( 0 ), _rto( initialRto ) { }
+
+    void sample( MicrosecondTime rtt ) {
+        if ( rtt < 0 )
+            return;
+        if ( _srtt == 0 ) {
+            _srtt = std::max< MicrosecondTime >( rtt, 1 );
+            _rttvar = rtt / 2;
+        } else {
+            _rttvar = (3 * _rttvar + std::abs( _srtt - rtt )) / 4;
+            _srtt = (7 * _srtt + rtt) / 8;
+        }
+        _rto = std::min( maxRto, std::max( minRto, _srtt + 4 * _rttvar ) );
+    }
+
+    MicrosecondTime rto() const { return _rto; }
+    MicrosecondTime srtt() const { return _srtt; }
+
+  private:
+    MicrosecondTime _srtt;
+    MicrosecondTime _rttvar;
+    MicrosecondTime _rto;
+};
+
+/* sender side of one stream */
+template< typename T >
+struct SendWindow {
+    struct Outstanding {
+        Outstanding( Seq seq, T data, MicrosecondTime now, MicrosecondTime rto ) :
+            seq( seq ), data( data ), sent( now ), deadline( now + rto ),
+            transmissions( 1 )
+        { }
+
+        Seq seq;
+        T data;
+        MicrosecondTime sent;
+        MicrosecondTime deadline;
+        int transmissions;
+    };
+
+    SendWindow() : _next( 0 ), _givenUp( 0 ) { }
+
+    /* enqueue new message, it is sent by transmit as soon as window allows */
+    void push( T data ) {
+        if ( int( _backlog.size() ) >= maxBacklog ) {
+            _backlog.pop_front();
+            ++_givenUp;
+        }
+        _backlog.push_back( data );
+    }
+
+    /* move messages from backlog to window, returns those to be sent now */
+    std::vector< std::pair< Seq, T > > transmit( MicrosecondTime now ) {
+        std::vector< std::pair< Seq, T > > out;
+        while ( !_backlog.empty() && int( _outstanding.size() ) < window ) {
+            Seq seq = _next++;
+            _outstanding.emplace_back( seq, _backlog.front(), now, _rtt.rto() );
+            out.emplace_back( seq, _backlog.front() );
+            _backlog.pop_front();
+        }
+        return out;
+    }
+
+    void ack( Seq cumulative, uint64_t sack, MicrosecondTime now ) {
+        auto acked = [&]( const Outstanding &o ) {
+            if ( seqLess( o.seq, cumulative ) )
+                return true;
+            Seq off = o.seq - cumulative - 1;
+            return off < Seq( window ) && ((sack >> off) & 1);
+        };
+        auto it = std::remove_if( _outstanding.begin(), _outstanding.end(),
+                [&]( const Outstanding &o ) {
+                    if ( !acked( o ) )
+                        return false;
+                    // Karn's algorithm: ambiguous samples are not used
+                    if ( o.transmissions == 1 )
+                        _rtt.sample( now - o.sent );
+                    return true;
+                } );
+        _outstanding.erase( it, _outstanding.end() );
+    }
+
+    /* collect messages which should be retransmitted now, messages which
+     * were transmitted too many times are dropped */
+    std::vector< std::pair< Seq, T > > due( MicrosecondTime now ) {
+        std::vector< std::pair< Seq, T > > out;
+        auto it = std::remove_if( _outstanding.begin(), _outstanding.end(),
+                [&]( const Outstanding &o ) {
+                    if ( o.deadline > now )
+                        return false;
+                    if ( o.transmissions >= maxTransmissions ) {
+                        ++_givenUp;
+                        return true;
+                    }
+                    return false;
+                } );
+        _outstanding.erase( it, _outstanding.end() );
+
+        for ( auto &o : _outstanding ) {
+            if ( o.deadline <= now ) {
+                // exponential backoff
+                o.deadline = now + std::min( maxRto,
+                        _rtt.rto() << o.transmissions );
+                ++o.transmissions;
+                out.emplace_back( o.seq, o.data );
+            }
+        }
+        return out;
+    }
+
+    /* lowest sequence number which can still be retransmitted */
+    Seq base() const {
+        return _outstanding.empty() ? _next : _outstanding.front().seq;
+    }
+
+    /* time of next retransmission or INT64_MAX if there is nothing to wait for */
+    MicrosecondTime nextDeadline() const {
+        MicrosecondTime d = INT64_MAX;
+        for ( auto &o : _outstanding )
+            d = std::min( d, o.deadline );
+        return d;
+    }
+
+    int inFlight() const { return _outstanding.size(); }
+    int backlog() const { return _backlog.size(); }
+    long givenUp() const { return _givenUp; }
+    const RttEstimator &rtt() const { return _rtt; }
+
+  private:
+    Seq _next;
+    long _givenUp;
+    RttEstimator _rtt;
+    std::vector< Outstanding > _outstanding; // ordered by sequence number
+    std::deque< T > _backlog;
+};
+
+/* receiver side of one stream */
+template< typename T >
+struct ReceiveWindow {
+    ReceiveWindow() :
+        _initialized( false ), _epoch( 0 ), _expected( 0 ), _duplicates( 0 ), _stale( 0 )
+    { }
+
+    /* accept frame and return messages which can be delivered (in order) */
+    std::vector< T > receive( const DataFrame< T > &frame ) {
+        std::vector< T > out;
+        if ( _initialized && seqLess( frame.epoch, _epoch ) ) {
+            // delayed frame from previous incarnation of sender, its
+            // messages were either delivered or given up by restart
+            ++_stale;
+            return out;
+        }
+        if ( !_initialized || frame.epoch != _epoch ) {
+            // sender (or we) restarted, synchronize with its window
+            _initialized = true;
+            _epoch = frame.epoch;
+            _expected = frame.base;
+            _buffer.clear();
+        }
+        if ( seqLess( _expected, frame.base ) ) {
+            // sender has given up on some messages, it is pointless to wait for them
+            _buffer.erase( _buffer.begin(), _buffer.lower_bound( frame.base ) );
+            _expected = frame.base;
+        }
+
+        if ( seqLess( frame.seq, _expected ) || _buffer.count( frame.seq ) )
+            ++_duplicates;
+        else if ( frame.seq - _expected < Seq( window ) )
+            _buffer.emplace( frame.seq, frame.payload );
+        // else too far in future, it will be retransmitted
+
+        for ( auto it = _buffer.find( _expected ); it != _buffer.end();
+                it = _buffer.find( _expected ) )
+        {
+            out.push_back( it->second );
+            _buffer.erase( it );
+            ++_expected;
+        }
+        return out;
+    }
+
+    Seq cumulative() const { return _expected; }
+
+    uint64_t sack() const {
+        uint64_t bits = 0;
+        for ( auto &p : _buffer ) {
+            Seq off = p.first - _expected - 1;
+            if ( off < Seq( window ) )
+                bits |= uint64_t( 1 ) << off;
+        }
+        return bits;
+    }
+
+    uint32_t epoch() const { return _epoch; }
+    long duplicates() const { return _duplicates; }
+    long stale() const { return _stale; }
+
+  private:
+    /* sequence numbers can wrap around, but whole buffer is always
+     * within window after _expected, so comparison must be relative to it */
+    struct Compare {
+        bool operator()( Seq a, Seq b ) const { return seqLess( a, b ); }
+    };
+
+    bool _initialized;
+    uint32_t _epoch;
+    Seq _expected;
+    long _duplicates;
+    long _stale;
+    std::map< Seq, T, Compare > _buffer;
+};
+
+}
+}
+
+#endif // SRC_RELIABILITY_H
@@ -0,0 +1,163 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <elevator/reliability.h>
+#include <elevator/reliablequeue.h>
+#include <elevator/test.h>
+
+using namespace elevator;
+using namespace elevator::reliable;
+
+struct TestReliability {
+    using Frame = DataFrame< int >;
+
+    Test inOrder() {
+        ReceiveWindow< int > win;
+        for ( int i = 0; i < 10; ++i ) {
+            auto got = win.receive( Frame{ 1, 0, 42, Seq( i ), 0, i } );
+            assert_eq( got.size(), 1u, "should deliver immediately" );
+            assert_eq( got[ 0 ], i, "wrong data" );
+        }
+        assert_eq( win.cumulative(), 10u, "" );
+        assert_eq( win.sack(), 0u, "" );
+    }
+
+    Test reorderAndDuplicate() {
+        ReceiveWindow< int > win;
+        assert_eq( win.receive( Frame{ 1, 0, 42, 0, 0, 0 } ).size(), 1u, "" );
+        assert( win.receive( Frame{ 1, 0, 42, 2, 0, 2 } ).empty(), "gap, must wait" );
+        assert( win.receive( Frame{ 1, 0, 42, 3, 0, 3 } ).empty(), "gap, must wait" );
+        assert_eq( win.cumulative(), 1u, "" );
+        assert_eq( win.sack(), 0x3u, "2 and 3 should be selectively acked" );
+
+        auto got = win.receive( Frame{ 1, 0, 42, 1, 0, 1 } );
+        assert_eq( got.size(), 3u, "gap filled" );
+        for ( int i = 0; i < 3; ++i )
+            assert_eq( got[ i ], i + 1, "wrong order" );
+
+        assert( win.receive( Frame{ 1, 0, 42, 2, 0, 2 } ).empty(), "duplicate" );
+        assert_eq( win.duplicates(), 1, "" );
+    }
+
+    Test restartAndGiveUp() {
+        ReceiveWindow< int > win;
+        win.receive( Frame{ 1, 0, 42, 0, 0, 0 } );
+        // sender has given up on 1 and 2
+        auto got = win.receive( Frame{ 1, 0, 42, 3, 3, 3 } );
+        assert_eq( got.size(), 1u, "should skip given up" );
+        // sender restarted
+        got = win.receive( Frame{ 1, 0, 43, 0, 0, 10 } );
+        assert_eq( got.size(), 1u, "new epoch should resynchronize" );
+        assert_eq( got[ 0 ], 10, "" );
+        assert_eq( win.epoch(), 43u, "" );
+        // delayed frame from previous incarnation
+        assert( win.receive( Frame{ 1, 0, 42, 4, 3, 4 } ).empty(), "stale frame delivered" );
+        assert_eq( win.epoch(), 43u, "stale frame must not reset window" );
+        assert_eq( win.stale(), 1, "" );
+        assert( win.receive( Frame{ 1, 0, 43, 0, 0, 10 } ).empty(), "redelivered after stale frame" );
+    }
+
+    Test wrapAround() {
+        ReceiveWindow< int > win;
+        Seq start = UINT32_MAX - 1;
+        win.receive( Frame{ 1, 0, 42, start, start, 0 } );
+        assert( win.receive( Frame{ 1, 0, 42, start + 2, start, 2 } ).empty(), "" );
+        assert_eq( win.receive( Frame{ 1, 0, 42, start + 1, start, 1 } ).size(), 2u, "" );
+        assert_eq( win.cumulative(), start + 3, "" );
+    }
+
+    Test sendWindow() {
+        SendWindow< int > win;
+        for ( int i = 0; i < 4; ++i )
+            win.push( i );
+        assert_eq( win.transmit( 0 ).size(), 4u, "" );
+        assert_eq( win.inFlight(), 4, "" );
+        win.ack( 1, 0x1, 1000 ); // 0 cumulatively, 2 selectively
+        assert_eq( win.inFlight(), 2, "" );
+        assert_eq( win.base(), 1u, "" );
+
+        auto due = win.due( initialRto );
+        assert_eq( due.size(), 2u, "1 and 3 should be retransmitted" );
+        assert_eq( due[ 0 ].first, 1u, "" );
+        assert_eq( due[ 1 ].first, 3u, "" );
+        assert( win.due( initialRto + 1 ).empty(), "backoff" );
+
+        win.ack( 4, 0, 2 * initialRto );
+        assert_eq( win.inFlight(), 0, "" );
+        assert_eq( win.base(), 4u, "" );
+    }
+
+    Test giveUp() {
+        SendWindow< int > win;
+        win.push( 0 );
+        win.transmit( 0 );
+        MicrosecondTime t = 0;
+        while ( win.inFlight() ) {
+            t = win.nextDeadline();
+            win.due( t );
+        }
+        assert_eq( win.givenUp(), 1, "" );
+        assert_eq( win.base(), 1u, "" );
+    }
+
+    Test windowLimit() {
+        SendWindow< int > win;
+        for ( int i = 0; i < window + 10; ++i )
+            win.push( i );
+        assert_eq( win.transmit( 0 ).size(), unsigned( window ), "" );
+        assert_eq( win.backlog(), 10, "" );
+        win.ack( 5, 0, 1000 );
+        auto sent = win.transmit( 1000 );
+        assert_eq( sent.size(), 5u, "acks should open window" );
+        assert_eq( sent[ 0 ].first, Seq( window ), "" );
+        assert_eq( win.givenUp(), 0, "" );
+    }
+
+    Test rtt() {
+        RttEstimator est;
+        assert_eq( est.rto(), initialRto, "" );
+        for ( int i = 0; i < 100; ++i )
+            est.sample( 100 );
+        assert_eq( est.rto(), minRto, "should be clamped" );
+        assert_leq( est.srtt(), 101, "" );
+        est.sample( 10 * maxRto );
+        assert_eq( est.rto(), maxRto, "should be clamped" );
+    }
+
+    Test loopback() {
+        ConcurrentQueue< int > in, out;
+        udp::Address rcvAddr{ udp::IPv4Address::localhost, udp::Port( test::port( 64131 ) ) };
+        ReliableReceiver< int > receiver{ 1, rcvAddr, out };
+        ReliableSender< int > sender{ 0, udp::Address{ udp::IPv4Address::localhost, udp::Port( test::port( 64132 ) ) },
+            rcvAddr, in, []( const int & ) { return 1; } };
+        receiver.run();
+        sender.run();
+        for ( int i = 0; i < 100; ++i )
+            in.enqueue( i );
+        for ( int i = 0; i < 100; ++i ) {
+            auto x = out.timeoutDequeue( 1000 );
+            assert( !x.isNothing(), "message lost" );
+            assert_eq( x.value(), i, "wrong order" );
+        }
+        assert_eq( sender.givenUp(), 0, "" );
+    }
+
+    Test unicastRouting() {
+        ConcurrentQueue< int > in, out;
+        udp::Port port( test::port( 64133 ) );
+        ReliableReceiver< int > receiver{ 1, udp::Address{ udp::IPv4Address::localhost, port }, out };
+        // without resolver this would be broadcasted and never reach receiver
+        ReliableSender< int > sender{ 0, udp::Address{ udp::IPv4Address::localhost, udp::Port( test::port( 64134 ) ) },
+            udp::Address{ udp::IPv4Address::broadcast, port }, in,
+            []( const int & ) { return 1; },
+            []( int id ) {
+                assert_eq( id, 1, "wrong target" );
+                return wibble::Maybe< udp::IPv4Address >::Just( udp::IPv4Address::localhost );
+            } };
+        receiver.run();
+        sender.run();
+        in.enqueue( 42 );
+        auto x = out.timeoutDequeue( 1000 );
+        assert( !x.isNothing(), "message lost" );
+        assert_eq( x.value(), 42, "" );
+    }
+};
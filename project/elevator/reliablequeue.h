@@ -0,0 +1,244 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <wibble/maybe.h>
+#include <elevator/udptools.h>
+#include <elevator/concurrentqueue.h>
+#include <elevator/restartwrapper.h>
+#include <elevator/serialization.h>
+#include <elevator/reliability.h>
+#include <elevator/log.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <functional>
+
+#ifndef ELEVATOR_RELIABLE_QUEUE_H
+#define ELEVATOR_RELIABLE_QUEUE_H
+
+namespace elevator {
+
+/* Reliable counterparts of QueueSender and QueueReceiver (see udpqueue.h)
+ *
+ * Sender keeps separate stream for each target peer (as given by target
+ * function), messages for reliable::anyPeer are just broadcasted without
+ * any guarantees. If resolve function is given and it knows address of
+ * target peer, stream is unicasted to that address (to port of sendAddr),
+ * otherwise it is sent to sendAddr. Acknowledgements are sent back to the
+ * address data came from, so sender's bind address must be unique for it
+ * (it must not be shared by other sockets using reuseAddr).
+ */
+template< typename T >
+struct ReliableSender {
+    using Resolver = std::function< wibble::Maybe< udp::IPv4Address >( int ) >;
+
+    ReliableSender( int localId, udp::Address bindAddr, udp::Address sendAddr,
+            ConcurrentQueue< T > &queue, std::function< int( const T & ) > target,
+            Resolver resolve = Resolver() ) :
+        _localId( localId ), _sock( bindAddr, true ), _sendAddr( sendAddr ),
+        _queue( queue ), _target( target ), _resolve( resolve ),
+        _epoch( reliable::newEpoch() ),
+        _terminate( false )
+    {
+        _sock.enableBroadcast();
+        _sock.attachFilter( serialization::Serializer::typeFilter( reliable::AckFrame::type() )
+                .requireWord( reliable::AckFrame::targetOffset(), localId ) );
+    }
+
+    ~ReliableSender() {
+        if ( _thrSend.joinable() ) {
+            _terminate = true;
+            _thrSend.join();
+            _thrAck.join();
+        }
+    }
+
+    void run() {
+        _thrSend = std::thread( restartWrapper( &ReliableSender::_sendLoop, ThreadClass::Network, "reliable send" ), this );
+        _thrAck = std::thread( restartWrapper( &ReliableSender::_ackLoop, ThreadClass::Network, "reliable ack" ), this );
+    }
+
+    long givenUp() {
+        Guard g{ _lock };
+        long cnt = 0;
+        for ( auto &w : _windows )
+            cnt += w.second.givenUp();
+        return cnt;
+    }
+
+  private:
+    using Frame = reliable::DataFrame< T >;
+    using Guard = std::unique_lock< std::mutex >;
+
+    int _localId;
+    udp::Socket _sock;
+    udp::Address _sendAddr;
+    ConcurrentQueue< T > &_queue;
+    std::function< int( const T & ) > _target;
+    Resolver _resolve;
+    const uint32_t _epoch;
+    std::atomic< bool > _terminate;
+    std::thread _thrSend;
+    std::thread _thrAck;
+
+    std::mutex _lock;
+    std::unordered_map< int, reliable::SendWindow< T > > _windows;
+
+    void _send( const Frame &frame ) {
+        auto pack = serialization::Serializer::toPacket( frame );
+        pack.address() = _sendAddr;
+        if ( frame.target != reliable::anyPeer && _resolve ) {
+            auto addr = _resolve( frame.target );
+            if ( !addr.isNothing() )
+                pack.address() = udp::Address( addr.value(), _sendAddr.port() );
+        }
+        _sock.sendPacket( pack );
+    }
+
+    void _collect( std::vector< Frame > &frames, int target,
+            const std::vector< std::pair< reliable::Seq, T > > &data, reliable::Seq base )
+    {
+        for ( auto &d : data )
+            frames.emplace_back( _localId, target, _epoch, d.first, base, d.second );
+    }
+
+    void _sendLoop();
+    void _ackLoop();
+};
+
+template< typename T >
+struct ReliableReceiver {
+    ReliableReceiver( int localId, udp::Address bindAddr, ConcurrentQueue< T > &queue ) :
+        _localId( localId ), _sock( bindAddr, true ), _queue( queue ), _terminate( false )
+    {
+        _sock.enableBroadcast();
+        // other peers' streams are dropped by kernel
+        _sock.attachFilter( serialization::Serializer::typeFilter( reliable::DataFrame< T >::type() )
+                .requireWord( reliable::DataFrame< T >::targetOffset(),
+                    { uint32_t( localId ), uint32_t( reliable::anyPeer ) } ) );
+    }
+
+    ~ReliableReceiver() {
+        if ( _thr.joinable() ) {
+            _terminate = true;
+            _thr.join();
+        }
+    }
+
+    void run() {
+        _thr = std::thread( restartWrapper( &ReliableReceiver::_runLocal, ThreadClass::Network, "reliable receive" ), this );
+    }
+
+  private:
+    int _localId;
+    udp::Socket _sock;
+    ConcurrentQueue< T > &_queue;
+    std::atomic< bool > _terminate;
+    std::thread _thr;
+    std::unordered_map< int, reliable::ReceiveWindow< T > > _windows;
+
+    void _runLocal();
+};
+
+template< typename T >
+void ReliableSender< T >::_sendLoop() {
+    while ( !_terminate.load( std::memory_order_relaxed ) ) {
+        auto mx = _queue.timeoutDequeue( 100 );
+        if ( mx.isNothing() )
+            continue;
+        int target = _target( mx.value() );
+        if ( target == reliable::anyPeer ) {
+            _send( Frame{ _localId, target, _epoch, 0, 0, mx.value() } );
+            continue;
+        }
+        std::vector< Frame > frames;
+        {
+            Guard g{ _lock };
+            auto &win = _windows[ target ];
+            win.push( mx.value() );
+            _collect( frames, target, win.transmit( nowMicro() ), win.base() );
+        }
+        for ( auto &f : frames )
+            _send( f );
+    }
+}
+
+template< typename T >
+void ReliableSender< T >::_ackLoop() {
+    while ( !_terminate.load( std::memory_order_relaxed ) ) {
+        MicrosecondTime deadline = INT64_MAX;
+        {
+            Guard g{ _lock };
+            for ( auto &w : _windows )
+                deadline = std::min( deadline, w.second.nextDeadline() );
+        }
+        // granularity of socket timeout is millisecond, round up
+        MicrosecondTime wait = std::max< MicrosecondTime >( 1,
+                std::min< MicrosecondTime >( 100, (deadline - nowMicro() + 999) / 1000 ) );
+
+        // socket filter passes only acks for us
+        auto pack = _sock.recvPacketWithTimeout( wait );
+        auto mack = pack.size() != 0
+            ? serialization::Serializer::fromPacket< reliable::AckFrame >( pack )
+            : wibble::Maybe< reliable::AckFrame >::Nothing();
+        if ( !mack.isNothing() ) { // malformed acks are dropped
+            auto ack = mack.value();
+            if ( ack.target == _localId && ack.epoch == _epoch ) {
+                Guard g{ _lock };
+                auto it = _windows.find( ack.source );
+                if ( it != _windows.end() )
+                    it->second.ack( ack.cumulative, ack.sack, nowMicro() );
+            }
+        }
+
+        std::vector< Frame > resend;
+        {
+            Guard g{ _lock };
+            MicrosecondTime now = nowMicro();
+            for ( auto &w : _windows ) {
+                long given = w.second.givenUp();
+                _collect( resend, w.first, w.second.due( now ), w.second.base() );
+                // acks might have opened window
+                _collect( resend, w.first, w.second.transmit( now ), w.second.base() );
+                if ( w.second.givenUp() != given )
+                    log::warning( "reliable channel to {} gave up {} message(s)",
+                            w.first, w.second.givenUp() - given );
+            }
+        }
+        for ( auto &f : resend )
+            _send( f );
+    }
+}
+
+template< typename T >
+void ReliableReceiver< T >::_runLocal() {
+    while ( !_terminate.load( std::memory_order_relaxed ) ) {
+        // socket filter passes only our and anyPeer frames of right type
+        auto pack = _sock.recvPacketWithTimeout( 100 );
+        if ( pack.size() == 0 )
+            continue;
+        auto mframe = serialization::Serializer::fromPacket< reliable::DataFrame< T > >( pack );
+        if ( mframe.isNothing() ) // malformed, sender will retransmit
+            continue;
+        auto frame = mframe.value();
+
+        if ( frame.target == reliable::anyPeer ) {
+            _queue.enqueue( frame.payload );
+            continue;
+        }
+
+        auto &win = _windows[ frame.source ];
+        for ( auto &x : win.receive( frame ) )
+            _queue.enqueue( x );
+
+        // acknowledge even duplicates, our previous ack might have been lost
+        auto ack = serialization::Serializer::toPacket( reliable::AckFrame{
+                _localId, frame.source, win.epoch(), win.cumulative(), win.sack() } );
+        ack.address() = pack.address();
+        _sock.sendPacket( ack );
+    }
+}
+
+}
+
+#endif // ELEVATOR_RELIABLE_QUEUE_H
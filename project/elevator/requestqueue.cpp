@@ -11,7 +11,10 @@ TimePoint RequestQueue::_earliestDeadline( const Guard &, TimePoint extra ) cons
 wibble::Maybe< Request > RequestQueue::waitForEarliestDeadline( MillisecondTime timeout ) {
     TimePoint d0 = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout );
     Guard g{ _lock };
-    return _waitForEarliestDeadline( g, d0 );
+    auto req = _waitForEarliestDeadline( g, d0 );
+    g.unlock();
+    _notify();
+    return req;
 }
 
 wibble::Maybe< Request > RequestQueue::_waitForEarliestDeadline( Guard &g, TimePoint d0 ) {
@@ -26,7 +29,9 @@ wibble::Maybe< Request > RequestQueue::_waitForEarliestDeadline( Guard &g, TimeP
             // clean done requests
             while ( !_queue.empty() && _queue.top().type == RequestType::Done ) {
                 cleaned = false;
+                _event( g, false, _queue.top().command );
                 _queue.pop();
+                ++_version;
             }
             // reschedule request if required
             while ( !_queue.empty() && !_queue.top()._tweakedDeadline.isNothing() ) {
@@ -51,6 +56,7 @@ wibble::Maybe< Request > RequestQueue::_waitForEarliestDeadline( Guard &g, TimeP
     if ( !_queue.empty() && _queue.top().deadline() <= now ) {
         auto val = _queue.top();
         _queue.pop();
+        ++_version;
         assert( val._tweakedDeadline.isNothing(), "invalid deadline" );
         return wibble::Maybe< Request >::Just( val );
     }
@@ -59,15 +65,50 @@ wibble::Maybe< Request > RequestQueue::_waitForEarliestDeadline( Guard &g, TimeP
 
 void RequestQueue::push( Request r ) {
     Guard g{ _lock };
+    _event( g, true, r.command );
+    _push( g, r );
+    g.unlock();
+    _notify();
+}
+
+void RequestQueue::repush( Request r, const Command &previous ) {
+    Guard g{ _lock };
+    if ( r.command.tuple() != previous.tuple() ) {
+        _event( g, true, r.command );
+        _event( g, false, previous );
+    }
+    _push( g, r );
+    g.unlock();
+    _notify();
+}
+
+void RequestQueue::_push( const Guard &, Request r ) {
     TimePoint oldDeadline;
     if ( !_queue.empty() )
         oldDeadline = _queue.top().deadline();
     _queue.push( r );
+    ++_version;
     // we need to recalculate deadline at waiter
     if ( _queue.size() == 1 || (_queue.size() > 1 && r.deadline() < oldDeadline) )
         _signal.notify_all();
 }
 
+void RequestQueue::_event( const Guard &, bool added, const Command &comm ) {
+    if ( _observer )
+        _events.emplace_back( added, comm );
+}
+
+void RequestQueue::_notify() {
+    std::unique_lock< std::mutex > n{ _notifyLock };
+    std::vector< std::pair< bool, Command > > events;
+    {
+        Guard g{ _lock };
+        events.swap( _events );
+    }
+    for ( auto &e : events )
+        _observer( e.first, e.second );
+}
+
 void RequestQueue::ackRequest( StateChange change, MillisecondTime newDeadlineDelta ) {
     auto newDeadline = newDeadlineDelta == 0
         ? wibble::Maybe< TimePoint >::Nothing()
@@ -82,8 +123,10 @@ void RequestQueue::ackRequest( StateChange change, MillisecondTime newDeadlineDe
         {
             if ( req.type == RequestType::NotAcknowledged )
                 req.type = RequestType::NotDone;
-            else if ( req.type == RequestType::NotDone )
+            else if ( req.type == RequestType::NotDone ) {
                 req.type = RequestType::Done;
+                ++_version; // not pending any more
+            }
             if ( !newDeadline.isNothing() ) {
                 req._tweakedDeadline = newDeadline;
                 req._deadlineDelta = newDeadlineDelta;
@@ -97,6 +140,36 @@ void RequestQueue::ackRequest( StateChange change, MillisecondTime newDeadlineDe
     // waitForEarliestDeadline
 }
 
+void RequestQueue::expireTarget( int elevatorId ) {
+    Guard g{ _lock };
+    // deadlines change, so queue has to be rebuilt
+    std::vector< Request > all;
+    for ( ; !_queue.empty(); _queue.pop() )
+        all.push_back( _queue.top() );
+    auto now = std::chrono::steady_clock::now();
+    for ( auto &req : all ) {
+        if ( req.elevatorId() == elevatorId && req.type != RequestType::Done ) {
+            // fresh request has no tweaked deadline
+            Request expired( req.command, req._deadlineDelta );
+            expired.type = req.type;
+            expired.repeated = req.repeated;
+            expired._deadline = now;
+            _queue.push( expired );
+        } else
+            _queue.push( req );
+    }
+    _signal.notify_all();
+}
+
+std::vector< Command > RequestQueue::pendingCommands() {
+    Guard g{ _lock };
+    std::vector< Command > out;
+    for ( auto &req : _queue )
+        if ( req.type != RequestType::Done )
+            out.push_back( req.command );
+    return out;
+}
+
 int RequestQueue::size() { Guard g{ _lock }; return _queue.size(); };
 
 } // namespace elevator
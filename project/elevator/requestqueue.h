@@ -2,6 +2,8 @@
 #include <condition_variable>
 #include <queue>
 #include <vector>
+#include <functional>
+#include <atomic>
 
 #include <wibble/maybe.h>
 
@@ -78,9 +80,35 @@ struct RequestCompare {
 
 struct RequestQueue {
 
+    /* request which is due is popped, but it is still considered pending
+     * (observer is not told about it) until it is returned by repush */
     wibble::Maybe< Request > waitForEarliestDeadline( MillisecondTime timeout );
     void push( Request );
+    /* push request returned by waitForEarliestDeadline (possibly changed),
+     * observer sees new command added before previous one is removed */
+    void repush( Request, const Command &previous );
     void ackRequest( StateChange change, MillisecondTime newDeadline = 0 );
+    /* make all pending requests targeted to given elevator due now */
+    void expireTarget( int elevatorId );
+    /* commands of all requests which are not done yet */
+    std::vector< Command > pendingCommands();
+    /* calls f with command of every request which is not done yet, under
+     * lock of queue */
+    template< typename F >
+    void eachPending( F f ) {
+        Guard g{ _lock };
+        for ( auto &req : _queue )
+            if ( req.type != RequestType::Done )
+                f( req.command );
+    }
+    /* changes whenever content of queue changes (can be read without lock) */
+    long version() const { return _version.load( std::memory_order_acquire ); }
+
+    /* observer is called (after lock of queue is released, but in order of
+     * changes) when request is pushed (added = true) or popped from queue,
+     * so that it can mirror content of queue */
+    using Observer = std::function< void( bool added, const Command & ) >;
+    void observe( Observer obs ) { Guard g{ _lock }; _observer = obs; }
     int size();
 
   private:
@@ -107,9 +135,16 @@ struct RequestQueue {
     using Guard = std::unique_lock< std::mutex >;
     std::mutex _lock;
     std::condition_variable _signal;
+    Observer _observer;
+    std::vector< std::pair< bool, Command > > _events; // for observer, under _lock
+    std::mutex _notifyLock; // keeps events in order
+    std::atomic< long > _version{ 0 };
 
     TimePoint _earliestDeadline( const Guard &, TimePoint ) const;
     wibble::Maybe< Request > _waitForEarliestDeadline( Guard &, TimePoint );
+    void _push( const Guard &, Request );
+    void _event( const Guard &, bool added, const Command & );
+    void _notify();
 };
 
 }
@@ -0,0 +1,32 @@
+#include <elevator/restartwrapper.h>
+#include <deque>
+#include <mutex>
+#include <cstring>
+
+namespace elevator {
+
+// deque does not move its elements, so references to counters stay valid
+static std::mutex countersMutex;
+static std::deque< RestartCounter > counters;
+
+RestartCounter &restartCounter( const char *name ) {
+    std::lock_guard< std::mutex > guard( countersMutex );
+    for ( auto &c : counters )
+        if ( std::strcmp( c.name, name ) == 0 )
+            return c;
+    counters.emplace_back( name );
+    return counters.back();
+}
+
+static thread_local int consecutive = 0;
+
+int consecutiveFailures() { return consecutive; }
+void setConsecutiveFailures( int n ) { consecutive = n; }
+
+void eachRestartCounter( std::function< void( const RestartCounter & ) > yield ) {
+    std::lock_guard< std::mutex > guard( countersMutex );
+    for ( auto &c : counters )
+        yield( c );
+}
+
+}
@@ -1,7 +1,16 @@
 // C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
 
 #include <functional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
 #include <elevator/test.h>
+#include <elevator/time.h>
+#include <elevator/threadconfig.h>
 
 /* might look a bit magical, but the only thing this does is that is wraps
  * functions in such a way it is automatically restarted if it had thrown
@@ -15,6 +24,16 @@
  * std::thread constructor when passed member function pointers
  * (it auto calls them on first argument ontionally dereferencing it
  * if it is a pointer)
+ *
+ * before first run, thread configuration of given class is applied to
+ * calling thread (see threadconfig.h)
+ *
+ * first restart is immediate, repeated failures are delayed by exponential
+ * backoff given by RestartPolicy, every restart is counted in counter of
+ * given name (which is exported by status server), thread is named by it too
+ *
+ * loops which want to resume quickly after restart can keep their local
+ * state in LoopCheckpoint
  */
 
 #ifndef SRC_THREAD_RESTART_WRAPPER_H
@@ -22,16 +41,90 @@
 
 namespace elevator {
 
+struct RestartPolicy {
+    RestartPolicy() :
+        initialBackoff( 1 ), maxBackoff( 50 ), resetAfter( 1000 ), maxRestarts( 0 )
+    { }
+
+    MillisecondTime initialBackoff; // delay before second consecutive restart
+    MillisecondTime maxBackoff;     // delay is doubled up to this value
+    MillisecondTime resetAfter;     // failure after this long run is not consecutive
+    int maxRestarts; // consecutive restarts before exception is rethrown, 0 = unlimited
+
+    /* delay before n-th consecutive restart (counted from 1) */
+    MillisecondTime backoff( int n ) const {
+        if ( n <= 1 )
+            return 0;
+        MillisecondTime delay = initialBackoff;
+        for ( int i = 2; i < n && delay < maxBackoff; ++i )
+            delay *= 2;
+        return std::min( delay, maxBackoff );
+    }
+};
+
+struct RestartCounter {
+    explicit RestartCounter( const char *name ) : name( name ), restarts( 0 ) { }
+
+    const char *name;
+    std::atomic< long > restarts;
+};
+
+/* counter for given name, loops of same name share counter; counters are
+ * never destroyed */
+RestartCounter &restartCounter( const char *name );
+void eachRestartCounter( std::function< void( const RestartCounter & ) > yield );
+
+/* consecutive failures (as counted by RestartPolicy) of loop which is run
+ * by restartWrapper in calling thread, 0 if it has not failed */
+int consecutiveFailures();
+void setConsecutiveFailures( int ); // for RestartWrapper
+
+/* local state of loop which survives restart, loop saves it at the end of
+ * every iteration and after restart it can resume from it instead of
+ * initializing from scratch; to be used only by thread running the loop
+ *
+ * state itself can be what makes loop fail, therefore checkpoint is not
+ * valid after more than maxResumes consecutive failures, loop initializes
+ * from scratch then */
+template< typename T >
+struct LoopCheckpoint {
+    explicit LoopCheckpoint( int maxResumes = 2 ) : _valid( false ), _maxResumes( maxResumes ) { }
+
+    void save( const T &state ) {
+        _state = state;
+        _valid = true;
+    }
+    bool valid() const { return _valid && consecutiveFailures() <= _maxResumes; }
+    const T &state() const { return _state; }
+    void invalidate() { _valid = false; }
+
+  private:
+    T _state;
+    bool _valid;
+    int _maxResumes;
+};
+
 template< typename Exception, typename Function >
 class RestartWrapper {
     Function f;
+    ThreadClass threadClass;
+    RestartPolicy policy;
+    RestartCounter *counter;
+    int consecutive;
+    MillisecondTime lastFailure;
   public:
-    RestartWrapper( Function &&f ) : f( std::forward< Function >( f ) ) { }
+    RestartWrapper( Function &&f, ThreadClass threadClass, const char *name,
+            RestartPolicy policy ) :
+        f( std::forward< Function >( f ) ), threadClass( threadClass ), policy( policy ),
+        counter( &restartCounter( name ) ), consecutive( 0 ), lastFailure( 0 )
+    { }
 
     template< typename... Args >
     auto operator()( Args ...args )
         -> decltype( (this->f)( args... ) )
     {
+        ThreadConfig::get( threadClass ).apply();
+        _started();
         for ( ;; ) {
             try {
                 return f( args... );
@@ -43,9 +136,12 @@ class RestartWrapper {
     auto operator()( That that, Args ...args )
         -> decltype( (that.*(this->f))( args... ) )
     {
+        ThreadConfig::get( threadClass ).apply();
+        _started();
+        const Function method = f; // compiler can see it does not change between restarts
         for ( ;; ) {
             try {
-                return (that.*f)( args... );
+                return (that.*method)( args... );
             } catch ( Exception &ex ) { _catched( ex );  }
         }
     }
@@ -54,23 +150,63 @@ class RestartWrapper {
     auto operator()( That that, Args ...args )
         -> decltype( (that->*(this->f))( args... ) )
     {
+        ThreadConfig::get( threadClass ).apply();
+        _started();
+        const Function method = f; // compiler can see it does not change between restarts
         for ( ;; ) {
             try {
-                return (that->*f)( args... );
+                return (that->*method)( args... );
             } catch ( Exception &ex ) { _catched( ex );  }
         }
     }
 
   private:
+    void _started() {
+        // name shows in top and /proc/<pid>/task/*/comm (at most 15 characters)
+        char name[ 16 ];
+        std::strncpy( name, counter->name, sizeof( name ) - 1 );
+        name[ sizeof( name ) - 1 ] = 0;
+        pthread_setname_np( pthread_self(), name );
+        consecutive = 0;
+        setConsecutiveFailures( 0 );
+        lastFailure = now();
+    }
+
+    // called from catch block, so it can rethrow
     void _catched( Exception &ex ) {
-        std::cout << "Catched: " << ex.what() << " restarting." << std::endl;
+        MillisecondTime t = now();
+        if ( t - lastFailure >= policy.resetAfter )
+            consecutive = 0;
+        lastFailure = t;
+        setConsecutiveFailures( ++consecutive );
+        if ( policy.maxRestarts && consecutive > policy.maxRestarts ) {
+            std::cerr << "WARNING: " << counter->name << " failed " << consecutive
+                      << " times in row, giving up: " << ex.what() << std::endl;
+            throw;
+        }
+        counter->restarts.fetch_add( 1, std::memory_order_relaxed );
+
+        MillisecondTime delay = policy.backoff( consecutive );
+        std::cerr << "WARNING: " << counter->name << " restarting after: " << ex.what();
+        if ( delay )
+            std::cerr << " (in " << delay << " ms)";
+        std::cerr << std::endl;
+        if ( delay ) {
+            std::this_thread::sleep_for( std::chrono::milliseconds( delay ) );
+            // time spent waiting is not time of successful run
+            lastFailure = now();
+        }
     }
 };
 
 template< typename Exception = test::GenerallAssertionFailed,
           typename Function >
-RestartWrapper< Exception, Function > restartWrapper( Function &&f ) {
-    return RestartWrapper< Exception, Function >( std::forward< Function >( f ) );
+RestartWrapper< Exception, Function > restartWrapper( Function &&f,
+        ThreadClass threadClass = ThreadClass::Background,
+        const char *name = "unnamed", RestartPolicy policy = RestartPolicy() )
+{
+    return RestartWrapper< Exception, Function >( std::forward< Function >( f ),
+            threadClass, name, policy );
 }
 
 
@@ -19,4 +19,85 @@ struct TestRestartWrapper {
     Test methodWithPtr() {
         restartWrapper( &TestRestartWrapper::f )( this, 1 );
     }
+
+    Test counted() {
+        int runs = 0;
+        auto &counter = restartCounter( "test counted" );
+        long before = counter.restarts;
+        restartWrapper( [&runs]() { assert_lt( 2, ++runs, "" ); },
+                ThreadClass::Background, "test counted" )();
+        assert_eq( runs, 3, "" );
+        assert_eq( counter.restarts - before, 2, "" );
+
+        bool found = false;
+        eachRestartCounter( [&]( const RestartCounter &c ) {
+                found = found || &c == &counter;
+            } );
+        assert( found, "counter not listed" );
+    }
+
+    Test giveUp() {
+        RestartPolicy policy;
+        policy.maxRestarts = 2;
+        int runs = 0;
+        bool thrown = false;
+        try {
+            restartWrapper( [&runs]() { ++runs; assert( false, "always fails" ); },
+                    ThreadClass::Background, "test give up", policy )();
+        } catch ( test::GenerallAssertionFailed & ) {
+            thrown = true;
+        }
+        assert( thrown, "exception not rethrown" );
+        assert_eq( runs, 3, "" );
+    }
+
+    Test backoff() {
+        RestartPolicy policy;
+        policy.initialBackoff = 2;
+        policy.maxBackoff = 10;
+        assert_eq( policy.backoff( 1 ), 0, "first restart must be immediate" );
+        assert_eq( policy.backoff( 2 ), 2, "" );
+        assert_eq( policy.backoff( 3 ), 4, "" );
+        assert_eq( policy.backoff( 4 ), 8, "" );
+        assert_eq( policy.backoff( 5 ), 10, "" );
+        assert_eq( policy.backoff( 100 ), 10, "" );
+    }
+
+    Test checkpoint() {
+        LoopCheckpoint< int > cp;
+        int runs = 0, resumedFrom = -1;
+        // loop counts iterations and fails once in the middle, second run
+        // must continue where the first one ended
+        restartWrapper( [&]() {
+                int i = cp.valid() ? cp.state() : 0;
+                if ( cp.valid() )
+                    resumedFrom = i;
+                ++runs;
+                for ( ; i < 10; ++i ) {
+                    assert( runs > 1 || i != 5, "failure" );
+                    cp.save( i + 1 );
+                }
+            } )();
+        assert_eq( runs, 2, "" );
+        assert_eq( resumedFrom, 5, "" );
+        assert_eq( cp.state(), 10, "" );
+    }
+
+    Test checkpointGivenUp() {
+        LoopCheckpoint< int > cp( 2 );
+        int runs = 0, fresh = 0;
+        // checkpointed state itself makes loop fail, only re-initialization
+        // helps
+        restartWrapper( [&]() {
+                int i = cp.valid() ? cp.state() : ( ++fresh, 0 );
+                ++runs;
+                for ( ; i < 10; ++i ) {
+                    assert( fresh > 1 || i != 5, "bad state" );
+                    cp.save( i + 1 );
+                }
+            } )();
+        assert_eq( runs, 4, "two resumes, then initialization" );
+        assert_eq( fresh, 2, "" );
+        assert_eq( cp.state(), 10, "" );
+    }
 };
@@ -1,6 +1,9 @@
 #include <elevator/scheduler.h>
 #include <elevator/restartwrapper.h>
 #include <elevator/elevator.h>
+#include <elevator/log.h>
+#include <elevator/latency.h>
+#include <algorithm>
 
 namespace elevator {
 
@@ -16,7 +19,13 @@ Scheduler::Scheduler( int localId, BasicDriverInfo info, GlobalState &global,
     _stateUpdateOut( stateUpdateOut ),
     _commandsToRemote( commandsToRemote ),
     _commandsToLocal( commandsToLocal ),
-    _terminate( false )
+    _terminate( false ),
+    _checkpoints( nullptr ),
+    _checkpointedRequests( -1 ),
+    _journal( nullptr ),
+    _status( nullptr ),
+    _trace( nullptr ),
+    _clock( &elevator::now )
 { }
 
 Scheduler::~Scheduler() {
@@ -28,12 +37,18 @@ Scheduler::~Scheduler() {
 }
 
 void Scheduler::run( HeartBeat &shed, HeartBeat &req ) {
-    _thrSched = std::thread( restartWrapper( &Scheduler::_schedLoop ), this, &shed );
-    _thrReq = std::thread( restartWrapper( &Scheduler::_reqCheckLoop ), this, &req );
+    _thrSched = std::thread( restartWrapper( &Scheduler::_schedLoop, ThreadClass::Control, "scheduler" ), this, &shed );
+    _thrReq = std::thread( restartWrapper( &Scheduler::_reqCheckLoop, ThreadClass::Control, "request check" ), this, &req );
+}
+
+void Scheduler::journalTo( Journal &journal ) {
+    _journal = &journal;
+    _globalState.requests().observe( [&journal]( bool added, const Command &comm ) {
+            journal.record( RequestEvent( added, comm ) );
+        } );
 }
 
 const char *showChange( ChangeType );
-const char *showCommand( CommandType );
 
 void Scheduler::_forwardToTargets( Command comm ) {
     if ( comm.targetElevatorId == Command::ANY_ID || comm.targetElevatorId == _localElevId )
@@ -43,31 +58,37 @@ void Scheduler::_forwardToTargets( Command comm ) {
 }
 
 int Scheduler::_optimalElevator( ButtonType type, int floor ) {
-    int minDistance = INT_MAX;
+    int minCost = INT_MAX;
     int minId = INT_MIN;
 
-    MillisecondTime now = elevator::now();
+    MillisecondTime now = _clock();
     // somawhat arbitrary thresholds for time-aware scheduling
     MillisecondTime outdatedThresh = Elevator::keepAlive * 1.2;
     MillisecondTime deadThresh = Elevator::keepAlive * 3;
+    int span = _bounds.maxFloor() - _bounds.minFloor();
 
-    for ( auto &statepair : _globalState.elevators() ) {
+    auto elevators = _globalState.elevators();
+    DispatchTrace::Candidate *trace = _trace ? _trace->dispatch( elevators.size() ) : nullptr;
+    for ( auto &statepair : elevators ) {
         const ElevatorState &state = statepair.second;
 
-        MillisecondTime age = now - state.timestamp;
-
-        int dist = std::abs( state.lastFloor - floor );
+        DispatchTrace::Candidate c = DispatchTrace::Candidate();
+        c.id = state.id;
+        c.lastFloor = state.lastFloor;
+        c.direction = int8_t( state.direction );
+        c.age = now - state.timestamp;
+        c.distance = std::abs( state.lastFloor - floor );
 
         // time-aware penasisation
-        if ( age > outdatedThresh )
-            dist += 10 * (_bounds.maxFloor() - _bounds.minFloor());
-        if ( age > deadThresh )
-            continue; // skip this one completely, it is most likely dead
+        if ( c.age > outdatedThresh )
+            c.outdated = 10 * span;
+        // most likely dead, it is never chosen (only traced)
         // note: At least local cannot be dead so we should always find minumum
+        c.dead = c.age > deadThresh;
 
         // penalizations for non-idle elevators
         if ( state.stopped )
-            dist += 10 * (_bounds.maxFloor() - _bounds.minFloor()); // stopped penalization
+            c.stopped = 10 * span; // stopped penalization
 
         if (    ( state.direction == Direction::Up
                         && ( (type == ButtonType::CallUp && floor > state.lastFloor )
@@ -77,29 +98,37 @@ int Scheduler::_optimalElevator( ButtonType type, int floor ) {
                         && ( (type == ButtonType::CallDown && floor < state.lastFloor )
                             || floor == _bounds.minFloor() ) )
            )
-            dist += _bounds.maxFloor() - _bounds.minFloor() + 1; // busy penalization
+            c.busy = span + 1; // busy penalization
         else if ( state.direction != Direction::None ) // not idle
             // as a last resort we can schedule floor even to elevator which is
             // running in different direction
-            dist += 2 * (_bounds.maxFloor() - _bounds.minFloor() + 1); // penalization
+            c.opposite = 2 * (span + 1); // penalization
 
-        if ( dist < minDistance ) {
-            minDistance = dist;
+        if ( trace )
+            *trace++ = c;
+        if ( !c.dead && c.cost() < minCost ) {
+            minCost = c.cost();
             minId = state.id;
         }
     }
+    if ( trace )
+        _trace->finish( trace - elevators.size(), now, type, floor, minId );
     assert_leq( 0, minId, "no minimal distance found" );
     return minId;
 }
 
 void Scheduler::_resendRequest( Request r ) {
-    std::cerr << "WARNING: re-sending request: { type = "
-              << (r.type == RequestType::NotAcknowledged ? "NotAcknowledged" : "NotDone")
-              << ", repeated = " << r.repeated << ", command = { elevator = "
-              << r.command.targetElevatorId << ", floor = " << r.command.targetFloor
-              << ", type = " << showCommand( r.command.commandType ) << " } }" << std::endl;
+    log::warning( "re-sending request: { type = {}, repeated = {}, command = "
+                  "{ elevator = {}, floor = {}, type = {} } }",
+                  r.type == RequestType::NotAcknowledged ? "NotAcknowledged" : "NotDone",
+                  r.repeated, r.command.targetElevatorId, r.command.targetFloor,
+                  showCommand( r.command.commandType ) );
+    Command previous = r.command;
     ++r.repeated;
-    if ( r.repeated > 3 || r.type == RequestType::NotDone ) {
+    // target might have left or failed, there is no point in waiting for it
+    if ( r.repeated > 3 || r.type == RequestType::NotDone
+            || !_globalState.has( r.command.targetElevatorId ) )
+    {
         // reschedule
         r.command.targetElevatorId = _optimalElevator(
                 r.command.commandType == CommandType::CallToFloorAndGoUp
@@ -108,7 +137,7 @@ void Scheduler::_resendRequest( Request r ) {
         r.type = RequestType::NotAcknowledged;
     }
     r.updateDeadline();
-    _globalState.requests().push( r );
+    _globalState.requests().repush( r, previous );
     _forwardToTargets( r.command );
 }
 
@@ -118,7 +147,9 @@ void Scheduler::_addAndForwardRequest( Command comm ) {
     _forwardToTargets( comm );
 }
 
-void Scheduler::_handleButtonPress( int updateElId, ButtonType type, int floor ) {
+void Scheduler::_handleButtonPress( int updateElId, ButtonType type, int floor,
+        MicrosecondTime origin )
+{
     // first setup lights
     Command lights{ type == ButtonType::CallUp
                       ? CommandType::TurnOnLightUp : CommandType::TurnOnLightDown,
@@ -132,7 +163,7 @@ void Scheduler::_handleButtonPress( int updateElId, ButtonType type, int floor )
         Command comm{ type == ButtonType::CallUp
                           ? CommandType::CallToFloorAndGoUp
                           : CommandType::CallToFloorAndGoDown,
-                      minId, floor };
+                      minId, floor, origin };
         _addAndForwardRequest( comm );
     }
 }
@@ -140,58 +171,102 @@ void Scheduler::_handleButtonPress( int updateElId, ButtonType type, int floor )
 void Scheduler::_schedLoop( HeartBeat *heartbeat ) {
     while ( !_terminate.load( std::memory_order::memory_order_relaxed ) ) {
         auto maybeUpdate = _stateUpdateIn.timeoutDequeue( heartbeat->threshold() / 10 );
-        if ( !maybeUpdate.isNothing() ) {
-            auto update = maybeUpdate.value();
-            _globalState.update( update.state );
-            std::cerr << "state update: { id = " << update.state.id
-                << ", timestamp = " << update.state.timestamp
-                << ", changeType = " << showChange( update.changeType )
-                << ", changeFloor = " << update.changeFloor
-                << ", stopped = " << update.state.stopped
-                << ", direction = " << int( update.state.direction )
-                << " }" << std::endl;
-
-            if ( update.state.id == _localElevId ) {
-                _stateUpdateOut.enqueue( update ); // propagate update
-            }
-
-            // each elevator is responsible for scheduling commnads from its hardware
-            switch ( update.changeType ) {
-                case ChangeType::None:
-                case ChangeType::KeepAlive:
-                case ChangeType::OtherChange:
-                case ChangeType::InsideButtonPresed:
-                case ChangeType::Served:
-                    break;
-                case ChangeType::ButtonUpPressed:
-                    _handleButtonPress( update.state.id, ButtonType::CallUp, update.changeFloor );
-                    break;
-                case ChangeType::ButtonDownPressed:
-                    _handleButtonPress( update.state.id, ButtonType::CallDown, update.changeFloor );
-                    break;
-                case ChangeType::ServedDown:
-                    _forwardToTargets( Command{ CommandType::TurnOffLightDown,
-                            _localElevId, update.changeFloor } );
-                    _globalState.requests().ackRequest( update );
-                    break;
-                case ChangeType::ServedUp:
-                    _forwardToTargets( Command{ CommandType::TurnOffLightUp,
-                            _localElevId, update.changeFloor } );
-                    _globalState.requests().ackRequest( update );
-                    break;
-                case ChangeType::GoingToServeUp:
-                case ChangeType::GoingToServeDown:
-                    // the deadline here is quite high, because it takes time
-                    // to do the job
-                    _globalState.requests().ackRequest( update, 30 * 1000 );
-                    break;
-            }
-        }
+        if ( !maybeUpdate.isNothing() )
+            _handleUpdate( maybeUpdate.value() );
 
         heartbeat->beat();
     }
 }
 
+void Scheduler::_handleUpdate( const StateChange &update ) {
+    latency::histogram( update.state.id == _localElevId
+                ? latency::Stage::LocalStateQueue
+                : latency::Stage::RemoteStateDelivery )
+        .record( wallMicro() - update.created );
+    latency::StageTimer updateTimer{ latency::Stage::SchedulerUpdate };
+
+    _globalState.update( update.state );
+    if ( test::assertLevel >= test::assertLevelParanoid )
+        _globalState.assertConsistency( _bounds );
+    log::info( "state update: { id = {}, timestamp = {}, changeType = {}, "
+               "changeFloor = {}, stopped = {}, direction = {} }",
+               update.state.id, update.state.timestamp,
+               showChange( update.changeType ), update.changeFloor,
+               update.state.stopped, update.state.direction );
+
+    if ( update.state.id == _localElevId ) {
+        _stateUpdateOut.enqueue( update ); // propagate update
+        if ( _journal )
+            _journal->record( update );
+    }
+
+    // each elevator is responsible for scheduling commnads from its hardware
+    switch ( update.changeType ) {
+        case ChangeType::None:
+        case ChangeType::KeepAlive:
+        case ChangeType::OtherChange:
+        case ChangeType::InsideButtonPresed:
+        case ChangeType::Served:
+            break;
+        case ChangeType::ButtonUpPressed:
+            _handleButtonPress( update.state.id, ButtonType::CallUp, update.changeFloor,
+                    update.created );
+            break;
+        case ChangeType::ButtonDownPressed:
+            _handleButtonPress( update.state.id, ButtonType::CallDown, update.changeFloor,
+                    update.created );
+            break;
+        case ChangeType::ServedDown:
+            _forwardToTargets( Command{ CommandType::TurnOffLightDown,
+                    _localElevId, update.changeFloor } );
+            _globalState.requests().ackRequest( update );
+            if ( _trace )
+                _trace->served( _clock(), ButtonType::CallDown, update.changeFloor,
+                        update.state.id );
+            break;
+        case ChangeType::ServedUp:
+            _forwardToTargets( Command{ CommandType::TurnOffLightUp,
+                    _localElevId, update.changeFloor } );
+            _globalState.requests().ackRequest( update );
+            if ( _trace )
+                _trace->served( _clock(), ButtonType::CallUp, update.changeFloor,
+                        update.state.id );
+            break;
+        case ChangeType::GoingToServeUp:
+        case ChangeType::GoingToServeDown:
+            // the deadline here is quite high, because it takes time
+            // to do the job
+            _globalState.requests().ackRequest( update, 30 * 1000 );
+            break;
+    }
+
+    if ( _checkpoints && update.state.id == _localElevId ) {
+        // keep-alive changes only timestamp, copy of queue is not worth it
+        long requests = _globalState.requests().version();
+        if ( update.changeType != ChangeType::KeepAlive || requests != _checkpointedRequests ) {
+            _checkpointedRequests = requests;
+            _checkpoints->write( Checkpoint( update.state,
+                        _globalState.requests().pendingCommands() ) );
+        }
+    }
+    if ( _status )
+        _publishStatus();
+}
+
+void Scheduler::_publishStatus() {
+    if ( !_status->due( now() ) )
+        return;
+    StatusSnapshot &snapshot = _status->begin();
+    snapshot.time = wallMicro();
+    _globalState.eachElevator( [&snapshot]( const ElevatorState &e ) {
+            snapshot.addElevator( e );
+        } );
+    _globalState.requests().eachPending( [&snapshot]( const Command &c ) {
+            snapshot.addRequest( c );
+        } );
+    _status->publish();
+}
+
 void Scheduler::_reqCheckLoop( HeartBeat *heartbeat ) {
     while ( !_terminate.load( std::memory_order::memory_order_relaxed ) ) {
 
@@ -2,6 +2,10 @@
 #include <elevator/globalstate.h>
 #include <elevator/command.h>
 #include <elevator/heartbeat.h>
+#include <elevator/checkpoint.h>
+#include <elevator/journal.h>
+#include <elevator/status.h>
+#include <elevator/dispatchtrace.h>
 #include <thread>
 #include <atomic>
 
@@ -19,6 +23,29 @@ struct Scheduler {
     ~Scheduler();
 
     void run( HeartBeat &, HeartBeat & );
+    /* write checkpoint on every local state change, keep-alive only if
+     * requests changed since last checkpoint (must be called before run) */
+    void checkpointTo( CheckpointRing &ring ) { _checkpoints = &ring; }
+    /* journal local state changes and all request queue mutations
+     * (must be called before run) */
+    void journalTo( Journal & );
+    /* publish status snapshot after state update, at most once per
+     * StatusBoard::interval (must be called before run) */
+    void publishTo( StatusBoard &board ) { _status = &board; }
+    /* trace every dispatch with costs of all candidates and every served
+     * call (must be called before run) */
+    void traceTo( DispatchTrace &trace ) { _trace = &trace; }
+
+    /* id of elevator which should serve call, does not change any state
+     * (exposed for benchmarks) */
+    int optimalElevator( ButtonType type, int floor ) { return _optimalElevator( type, floor ); }
+
+    /* process state update synchronously, just like scheduler thread does
+     * with updates from its input queue (exposed for replay of captures) */
+    void update( const StateChange &change ) { _handleUpdate( change ); }
+    /* clock against which age of states is measured, replay uses time of
+     * capture so that decisions do not depend on replay speed */
+    void useClock( MillisecondTime (*clock)() ) { _clock = clock; }
 
   private:
     int _localElevId;
@@ -31,11 +58,19 @@ struct Scheduler {
     std::thread _thrSched;
     std::thread _thrReq;
     std::atomic< bool > _terminate;
+    CheckpointRing *_checkpoints;
+    long _checkpointedRequests; // RequestQueue::version of last checkpoint
+    Journal *_journal;
+    StatusBoard *_status;
+    DispatchTrace *_trace;
+    MillisecondTime (*_clock)();
 
     void _schedLoop( HeartBeat * );
+    void _handleUpdate( const StateChange & );
+    void _publishStatus();
     void _reqCheckLoop( HeartBeat * );
 
-    void _handleButtonPress( int, ButtonType, int );
+    void _handleButtonPress( int, ButtonType, int, MicrosecondTime origin );
     void _resendRequest( Request );
     void _addAndForwardRequest( Command );
     void _forwardToTargets( Command );
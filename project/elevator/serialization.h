@@ -1,12 +1,20 @@
 // C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
 
 /* serialization support for network
+ *
+ * Packet is frame of header (type signature, frame version and size of
+ * data) followed by serialized data. Data are positional encoding of
+ * type's tuple, optionally followed by tagged extension fields (see
+ * Extension below) which allow adding fields without breaking older nodes.
  */
 
 #include <tuple>
 #include <type_traits>
 #include <memory>
 #include <utility>
+#include <array>
+#include <vector>
+#include <cstdint>
 #include <wibble/maybe.h>
 
 #include <elevator/test.h>
@@ -28,7 +36,16 @@ enum class TypeSignature {
     InitialPacket,
     ElevatorReady,
     RecoveryState,
-    RecoveryPeers
+    RecoveryPeers,
+
+    ReliableData,
+    ReliableAck,
+
+    ElevatorLeave,
+    ElevatorAlive,
+
+    Checkpoint,
+    RequestEvent
 };
 
 template< typename T >
@@ -41,6 +58,86 @@ struct Serializable :
     _internal::Serializable< T, _internal::trait< T >() >
 { };
 
+/* size of serialized T if it is same for all values, that is T is built
+ * only from fundamental types, enums, tuples and std::arrays, -1 otherwise */
+template< typename T >
+constexpr long fixedSize() { return Serializable< T >::fixedSize(); }
+
+template< typename T >
+constexpr bool isFixedSize() { return fixedSize< T >() >= 0; }
+
+/* Schema evolution: tuple encoding of type must never change once deployed,
+ * new fields are added as optional extensions with unique tag which follow
+ * it. Type opts in by providing
+ *     void writeExtensions( serialization::ExtensionWriter & ) const;
+ *     void readExtension( const serialization::Extension & );
+ * readExtension is called for every extension found in data and it must
+ * ignore tags it does not know (written by newer version); fields missing
+ * in data (written by older version) keep their default. Types without
+ * extensions are encoded exactly as before and extensions sent to them are
+ * skipped as whole without looking at them.
+ */
+struct Extension {
+    /* frame is cursor of enclosing data, malformed extension invalidates it */
+    Extension( uint16_t tag, const char *data, long size, Cursor *frame ) :
+        _tag( tag ), _data( data ), _size( size ), _frame( frame )
+    { }
+
+    uint16_t tag() const { return _tag; }
+    long size() const { return _size; }
+
+    template< typename T >
+    T as() const {
+        Cursor cursor{ _data, _size };
+        T value = Serializable< T >::deserialize( &cursor );
+        if ( !cursor.valid() || cursor.left() != 0 )
+            _frame->invalidate();
+        return value;
+    }
+
+  private:
+    uint16_t _tag;
+    const char *_data;
+    long _size;
+    Cursor *_frame;
+};
+
+/* extension is stored as 16 bit tag, 16 bit size and serialized value */
+struct ExtensionWriter {
+    static constexpr long headerSize() { return 2 * sizeof( uint16_t ); }
+
+    template< typename T >
+    void add( uint16_t tag, const T &value ) {
+        long size = Serializable< T >::size( value );
+        assert_leq( size, long( UINT16_MAX ), "extension too big" );
+        size_t at = _data.size();
+        _data.resize( at + headerSize() + size );
+        char *ptr = &_data[ at ];
+        *reinterpret_cast< uint16_t * >( ptr ) = tag;
+        *reinterpret_cast< uint16_t * >( ptr + sizeof( uint16_t ) ) = size;
+        ptr += headerSize();
+        Serializable< T >::serialize( value, &ptr );
+    }
+
+    const std::vector< char > &data() const { return _data; }
+
+  private:
+    std::vector< char > _data;
+};
+
+template< typename T >
+constexpr auto hasExtensions_( wibble::Preferred ) ->
+    decltype( std::declval< const T & >().writeExtensions( std::declval< ExtensionWriter & >() ),
+            std::declval< T & >().readExtension( std::declval< const Extension & >() ),
+            bool() )
+{ return true; }
+
+template< typename T >
+constexpr bool hasExtensions_( wibble::NotPreferred ) { return false; }
+
+template< typename T >
+constexpr bool hasExtensions() { return hasExtensions_< T >( wibble::Preferred() ); }
+
 struct Serialized {
     long size() const { return _datasize; }
     TypeSignature type() const { return _datatype; }
@@ -68,23 +165,50 @@ struct Serialized {
 };
 
 struct Serializer {
+    template< typename What >
+    using FixedBuffer = std::array< char, isFixedSize< What >() ? fixedSize< What >() : 0 >;
+
+    /* fixed size types can be serialized into array on stack, without any
+     * allocation */
+    template< typename What >
+    static FixedBuffer< What > serializeFixed( const What &w ) {
+        static_assert( isFixedSize< What >(), "serializeFixed needs fixed size type" );
+        FixedBuffer< What > buffer;
+        char *ptr = buffer.data();
+        Serializable< What >::serialize( w, &ptr );
+        assert_debug_eq( ptr, buffer.data() + buffer.size(), "wrong size" );
+        return buffer;
+    }
+
     template< typename What >
     static Serialized serialize( const What &w ) {
-        Serialized serial{ w.type(), Serializable< What >::size( w ) };
+        ExtensionWriter ext;
+        _writeExtensions( w, ext, HasExtensions< What >() );
+        long size = Serializable< What >::size( w );
+        Serialized serial{ w.type(), size + long( ext.data().size() ) };
         char *ptr = serial.rawDataRW();
         Serializable< What >::serialize( w, &ptr );
-        assert_eq( ptr, serial.rawData() + Serializable< What >::size( w ), "wrong size" );
+        assert_eq( ptr, serial.rawData() + size, "wrong size" );
+        std::copy( ext.data().begin(), ext.data().end(), ptr );
         return serial;
     }
 
+    /* serialized data are trusted (produced locally), malformed data are
+     * error, Nothing means wrong type */
     template< typename What >
     static wibble::Maybe< What > deserialize( Serialized &s ) {
         if ( What::type() != s.type() )
             return wibble::Maybe< What >::Nothing();
-        const char *ptr = s.rawData();
-        auto data = Serializable< What >::deserialize( &ptr );
-        assert_eq( s.size(), Serializable< What >::size( data ), "wrong size" );
-        return wibble::Maybe< What >::Just( data );
+        auto data = decode< What >( s.rawData(), s.size() );
+        assert( !data.isNothing(), "malformed data" );
+        return data;
+    }
+
+    /* decode data (without header) of untrusted origin, no read goes
+     * outside of data, Nothing if data are malformed */
+    template< typename What >
+    static wibble::Maybe< What > decode( const char *data, long size ) {
+        return _decode< What >( data, size, std::integral_constant< bool, isFixedSize< What >() >() );
     }
 
     template< typename What >
@@ -96,24 +220,45 @@ struct Serializer {
 
     template< typename What >
     static udp::Packet toPacket( const What &w ) {
-        Serialized serial = serialize( w );
-        udp::Packet packet{ packetSize( serial ) };
-        packet.get< TypeSignature >() = serial.type();
-        packet.get< int >( sizeof( TypeSignature ) ) = serial.size();
-        std::copy( serial.rawData(), serial.rawData() + serial.size(),
-                packet.data() + packet_data_offset );
-        return packet;
+        return _toPacket( w, std::integral_constant< bool,
+                isFixedSize< What >() && !hasExtensions< What >() >() );
     }
 
     static TypeSignature packetType( const udp::Packet &packet ) {
+        if ( packet.size() < packet_data_offset )
+            return TypeSignature::NoType;
         return packet.get< TypeSignature >();
     }
 
+    /* packet layout, for kernel-side filtering (see udp::PacketFilter) */
+    static constexpr int typeOffset() { return 0; }
+    static constexpr int versionOffset() { return sizeof( TypeSignature ); }
+    static constexpr int sizeOffset() { return versionOffset() + sizeof( uint32_t ); }
+    static constexpr int dataOffset() { return packet_data_offset; }
+
+    /* version of framing (header and extension encoding), frames of other
+     * versions are ignored */
+    static constexpr uint32_t frameVersion() { return 1; }
+
+    static udp::PacketFilter typeFilter( TypeSignature type ) {
+        static_assert( sizeof( TypeSignature ) == sizeof( uint32_t ),
+                "type signature must fit into filter word" );
+        return udp::PacketFilter().requireWord( typeOffset(), uint32_t( type ) )
+                                  .requireWord( versionOffset(), frameVersion() );
+    }
+
+    /* packet is untrusted, Nothing if it is of other type or version or it
+     * is malformed */
     template< typename What >
     static wibble::Maybe< What > fromPacket( const udp::Packet &packet ) {
-        Serialized serial{ packet.get< TypeSignature >(), packet.cdata() + packet_data_offset,
-            packet.get< int >( sizeof( TypeSignature ) ) };
-        return deserialize< What >( serial );
+        if ( packet.size() < packet_data_offset
+                || packet.get< uint32_t >( versionOffset() ) != frameVersion()
+                || packet.get< TypeSignature >() != What::type() )
+            return wibble::Maybe< What >::Nothing();
+        int size = packet.get< int >( sizeOffset() );
+        if ( size < 0 || size > packet.size() - packet_data_offset )
+            return wibble::Maybe< What >::Nothing();
+        return decode< What >( packet.cdata() + packet_data_offset, size );
     }
 
     template< typename What >
@@ -124,10 +269,85 @@ struct Serializer {
     }
 
   private:
-    static constexpr int packet_data_offset = sizeof( TypeSignature ) + sizeof( int );
+    static constexpr int packet_data_offset = sizeof( TypeSignature ) + sizeof( uint32_t ) + sizeof( int );
     static int packetSize( const Serialized& serial ) {
         return packet_data_offset + serial.size();
     }
+
+    template< typename What >
+    using HasExtensions = std::integral_constant< bool, hasExtensions< What >() >;
+
+    template< typename What >
+    static void _writeExtensions( const What &w, ExtensionWriter &ext, std::true_type ) {
+        w.writeExtensions( ext );
+    }
+    template< typename What >
+    static void _writeExtensions( const What &, ExtensionWriter &, std::false_type ) { }
+
+    template< typename What >
+    static void _readExtensions( What &w, Cursor &cursor, std::true_type ) {
+        while ( cursor.left() > 0 ) {
+            uint16_t tag = cursor.read< uint16_t >();
+            long size = cursor.read< uint16_t >();
+            const char *data = cursor.ptr();
+            if ( !cursor.take( size ) )
+                return;
+            w.readExtension( Extension( tag, data, size, &cursor ) );
+        }
+    }
+    // type without extensions skips them all
+    template< typename What >
+    static void _readExtensions( What &, Cursor &, std::false_type ) { }
+
+    // fixed size: single bounds check, then decoded without further checks
+    template< typename What >
+    static wibble::Maybe< What > _decode( const char *data, long size, std::true_type ) {
+        if ( size < fixedSize< What >() )
+            return wibble::Maybe< What >::Nothing();
+        const char *ptr = data;
+        What value = Serializable< What >::deserialize( &ptr );
+        Cursor rest{ ptr, size - fixedSize< What >() };
+        _readExtensions( value, rest, HasExtensions< What >() );
+        return rest.valid()
+            ? wibble::Maybe< What >::Just( value )
+            : wibble::Maybe< What >::Nothing();
+    }
+
+    template< typename What >
+    static wibble::Maybe< What > _decode( const char *data, long size, std::false_type ) {
+        Cursor cursor{ data, size };
+        What value = Serializable< What >::deserialize( &cursor );
+        _readExtensions( value, cursor, HasExtensions< What >() );
+        return cursor.valid()
+            ? wibble::Maybe< What >::Just( value )
+            : wibble::Maybe< What >::Nothing();
+    }
+
+    // fixed size: serialized directly into packet, size known at compile time
+    template< typename What >
+    static udp::Packet _toPacket( const What &w, std::true_type ) {
+        udp::Packet packet{ packet_data_offset + int( fixedSize< What >() ) };
+        packet.get< TypeSignature >() = w.type();
+        packet.get< uint32_t >( versionOffset() ) = frameVersion();
+        packet.get< int >( sizeOffset() ) = fixedSize< What >();
+        char *ptr = packet.data() + packet_data_offset;
+        Serializable< What >::serialize( w, &ptr );
+        assert_debug_eq( ptr, packet.data() + packet.size(), "wrong size" );
+        return packet;
+    }
+
+    template< typename What >
+    static udp::Packet _toPacket( const What &w, std::false_type ) {
+        Serialized serial = serialize( w );
+        udp::Packet packet{ packetSize( serial ) };
+        packet.get< TypeSignature >() = serial.type();
+        packet.get< uint32_t >( versionOffset() ) = frameVersion();
+        packet.get< int >( sizeOffset() ) = serial.size();
+        std::copy( serial.rawData(), serial.rawData() + serial.size(),
+                packet.data() + packet_data_offset );
+        return packet;
+    }
+
 };
 
 }
@@ -135,12 +135,61 @@ struct TestSerializationInternal {
         assert_eq( size_t( buff.get() + size ), size_t( ptr ), "" );
         assert_eq( set, set2, "" );
     }
+
+    Test cursor() {
+        using Type = std::tuple< int, std::set< int > >;
+        Type t{ 7, { 1, 2, 3 } };
+        long size = Serializable< Type >::size( t );
+        std::unique_ptr< char[] > buff{ new char[ size ] };
+        char *ptr = buff.get();
+        Serializable< Type >::serialize( t, &ptr );
+
+        Cursor whole{ buff.get(), size };
+        assert( Serializable< Type >::deserialize( &whole ) == t, "" );
+        assert( whole.valid(), "" );
+        assert_eq( whole.left(), 0, "" );
+
+        for ( long i = 0; i < size; ++i ) {
+            Cursor truncated{ buff.get(), i };
+            Serializable< Type >::deserialize( &truncated );
+            assert( !truncated.valid(), "truncated data accepted" );
+        }
+
+        // count which cannot fit is rejected without reading elements
+        *reinterpret_cast< long * >( buff.get() + sizeof( int ) ) = 1L << 60;
+        Cursor huge{ buff.get(), size };
+        assert( std::get< 1 >( Serializable< Type >::deserialize( &huge ) ).empty(), "" );
+        assert( !huge.valid(), "huge count accepted" );
+
+        *reinterpret_cast< long * >( buff.get() + sizeof( int ) ) = -1;
+        Cursor negative{ buff.get(), size };
+        Serializable< Type >::deserialize( &negative );
+        assert( !negative.valid(), "negative count accepted" );
+    }
+
+    Test fixedSize() {
+        enum class E : int16_t { A };
+        static_assert( serialization::fixedSize< int >() == sizeof( int ), "" );
+        static_assert( serialization::fixedSize< E >() == sizeof( int16_t ), "" );
+        static_assert( serialization::fixedSize< std::tuple< int, bool, long > >()
+                == sizeof( int ) + sizeof( bool ) + sizeof( long ), "" );
+        static_assert( serialization::fixedSize< std::array< int, 4 > >() == 4 * sizeof( int ), "" );
+        static_assert( !isFixedSize< std::set< int > >(), "" );
+        static_assert( !isFixedSize< std::tuple< int, std::vector< int > > >(), "" );
+
+        // size of variable types is still computed from value
+        using Tup = std::tuple< int, std::vector< int > >;
+        Tup t{ 1, { 1, 2, 3 } };
+        assert_eq( Serializable< Tup >::size( t ), long( 2 * sizeof( int ) + sizeof( long )
+                    + 2 * sizeof( int ) ), "" );
+    }
 };
 
 struct TestSerialization {
 
+    using Tuple = std::tuple< long, long, bool >;
+
     struct _TestData {
-        using Tuple = std::tuple< long, long, bool >;
         static TypeSignature type() { return TypeSignature::TestType; }
         static int size() { return sizeof( Tuple ); }
         Tuple tuple() const { return std::make_tuple( x, y, p ); }
@@ -157,6 +206,37 @@ struct TestSerialization {
         bool p;
     };
 
+    /* newer version of _TestData, with two added fields */
+    struct _Extended : _TestData {
+        using _TestData::_TestData;
+        _Extended() = default;
+
+        void writeExtensions( ExtensionWriter &ext ) const {
+            ext.add( 1, z );
+            ext.add( 2, list );
+        }
+        void readExtension( const Extension &ext ) {
+            if ( ext.tag() == 1 )
+                z = ext.as< int >();
+            if ( ext.tag() == 2 )
+                list = ext.as< std::vector< int > >();
+        }
+
+        int z = -1; // default for data from older version
+        std::vector< int > list;
+    };
+
+    /* yet newer version, adds field _Extended does not know */
+    struct _Newest : _Extended {
+        using _Extended::_Extended;
+
+        void writeExtensions( ExtensionWriter &ext ) const {
+            ext.add( 1, z );
+            ext.add( 7, std::make_tuple( 1.5, 42L ) );
+            ext.add( 2, list );
+        }
+    };
+
     Test typed() {
         _TestData data{ 0x7700ff770077ff00, 0x0077ff770077ff00, true };
         Serialized serial = Serializer::serialize( data );
@@ -174,6 +254,99 @@ struct TestSerialization {
         assert_eq( data.y, deser.y, "serialization-deserialization error" );
         assert_eq( data.p, deser.p, "serialization-deserialization error" );
     }
+
+    Test fixed() {
+        static_assert( isFixedSize< _TestData >(), "" );
+        _TestData data{ 0x7700ff770077ff00, 0x0077ff770077ff00, true };
+        auto buffer = Serializer::serializeFixed( data );
+        assert_eq( long( buffer.size() ), 2 * long( sizeof( long ) ) + long( sizeof( bool ) ), "" );
+        const char *ptr = buffer.data();
+        _TestData deser = Serializable< _TestData >::deserialize( &ptr );
+        assert_eq( data.x, deser.x, "serialization-deserialization error" );
+        assert_eq( data.p, deser.p, "serialization-deserialization error" );
+
+        udp::Packet packet = Serializer::toPacket( data );
+        assert_eq( packet.size(), Serializer::dataOffset() + int( buffer.size() ), "" );
+        assert( std::equal( buffer.begin(), buffer.end(), packet.cdata() + Serializer::dataOffset() ),
+                "packet differs from fixed buffer" );
+    }
+
+    Test extensions() {
+        static_assert( !hasExtensions< _TestData >(), "" );
+        static_assert( hasExtensions< _Extended >(), "" );
+        _Extended ext{ Tuple( 1, 2, true ) };
+        ext.z = 3;
+        ext.list = { 4, 5 };
+
+        // older receiver skips extensions
+        auto old = Serializer::unsafeFromPacket< _TestData >( Serializer::toPacket( ext ) );
+        assert_eq( old.x, 1, "" );
+        assert_eq( old.y, 2, "" );
+
+        // newer receiver of older data keeps defaults
+        auto fromOld = Serializer::unsafeFromPacket< _Extended >(
+                Serializer::toPacket( _TestData{ 1, 2, true } ) );
+        assert_eq( fromOld.y, 2, "" );
+        assert_eq( fromOld.z, -1, "" );
+        assert( fromOld.list.empty(), "" );
+
+        auto same = Serializer::unsafeFromPacket< _Extended >( Serializer::toPacket( ext ) );
+        assert_eq( same.z, 3, "" );
+        assert( same.list == ext.list, "" );
+
+        _Newest newest{ Tuple( 1, 2, true ) };
+        newest.z = 6;
+        newest.list = { 7 };
+        Serialized serial = Serializer::serialize( newest );
+        auto fromNewer = Serializer::unsafeDeserialize< _Extended >( serial );
+        assert_eq( fromNewer.z, 6, "" );
+        assert( fromNewer.list == newest.list, "unknown tag not skipped" );
+    }
+
+    Test malformed() {
+        _Extended ext{ Tuple( 1, 2, true ) };
+        ext.list = { 4, 5 };
+        udp::Packet good = Serializer::toPacket( ext );
+        // every truncation is either rejected or decodes without extensions
+        // which did not fit, but never reads outside of packet
+        for ( int i = 1; i < good.size(); ++i ) {
+            udp::Packet cut{ good.cdata(), i };
+            assert( Serializer::fromPacket< _Extended >( cut ).isNothing(),
+                    "truncated packet accepted" );
+            if ( i >= Serializer::dataOffset() )
+                cut.get< int >( Serializer::sizeOffset() ) = i - Serializer::dataOffset();
+            auto part = Serializer::fromPacket< _Extended >( cut );
+            assert( part.isNothing() || part.value().list.size() < ext.list.size(), "" );
+        }
+
+        udp::Packet bad{ good.cdata(), good.size() };
+        bad.get< int >( Serializer::sizeOffset() ) = -5;
+        assert( Serializer::fromPacket< _Extended >( bad ).isNothing(), "negative size" );
+        bad.get< int >( Serializer::sizeOffset() ) = good.size();
+        assert( Serializer::fromPacket< _Extended >( bad ).isNothing(), "size over packet" );
+
+        // extension of wrong size for its tag
+        ExtensionWriter w;
+        w.add( 1, 42L );
+        std::vector< char > data( sizeof( Tuple ) );
+        char *ptr = data.data();
+        Serializable< Tuple >::serialize( Tuple( 1, 2, true ), &ptr );
+        data.resize( fixedSize< Tuple >() );
+        data.insert( data.end(), w.data().begin(), w.data().end() );
+        assert( Serializer::decode< _Extended >( data.data(), data.size() ).isNothing(),
+                "malformed extension accepted" );
+        // but type which does not know it skips it
+        assert( !Serializer::decode< _TestData >( data.data(), data.size() ).isNothing(), "" );
+    }
+
+    Test version() {
+        udp::Packet packet = Serializer::toPacket( _TestData{ 1, 2, true } );
+        assert_eq( packet.get< uint32_t >( Serializer::versionOffset() ),
+                Serializer::frameVersion(), "" );
+        packet.get< uint32_t >( Serializer::versionOffset() ) = Serializer::frameVersion() + 1;
+        assert( Serializer::fromPacket< _TestData >( packet ).isNothing(),
+                "other frame version accepted" );
+    }
 };
 
 
@@ -1,209 +1,312 @@
 #include <elevator/sessionmanager.h>
+#include <elevator/sessionprotocol.h>
 #include <elevator/serialization.h>
 #include <elevator/restartwrapper.h>
 
 namespace elevator {
 
 using namespace serialization;
+using namespace session;
 
 const udp::Address SessionManager::commSend{ udp::IPv4Address::any, udp::Port{ 64032 } };
 const udp::Address SessionManager::commRcv{ udp::IPv4Address::any, udp::Port{ 64033 } };
 const udp::Address SessionManager::commBroadcast{ udp::IPv4Address::broadcast, udp::Port{ 64033 } };
+const MillisecondTime SessionManager::minAnnounceInterval;
+const MillisecondTime SessionManager::maxAnnounceInterval;
+const MillisecondTime SessionManager::settleTime;
+const MillisecondTime SessionManager::aliveInterval;
+const MillisecondTime SessionManager::failureTimeout;
 
-struct Initial {
-    Initial() = default;
-    Initial( std::tuple<> ) { };
-    std::tuple<> tuple() const { return std::tuple<>(); }
-    static TypeSignature type() {
-        return TypeSignature::InitialPacket;
-    }
-};
-
-struct Ready {
-    Ready() = default;
-    Ready( std::tuple<> ) { };
-    std::tuple<> tuple() const { return std::tuple<>(); }
-    static TypeSignature type() {
-        return TypeSignature::ElevatorReady;
-    }
-};
-
-struct RecoveryPeers {
-    RecoveryPeers() = default;
-    RecoveryPeers( std::set< udp::IPv4Address > peers ) : peers( peers ) { }
-    RecoveryPeers( std::tuple< std::set< udp::IPv4Address > > t )
-        : RecoveryPeers( std::get< 0 >( t ) )
-    { }
-    static TypeSignature type() { return TypeSignature::RecoveryPeers; }
-    std::tuple< std::set< udp::IPv4Address > > tuple() const {
-        return std::make_tuple( peers );
-    }
-
-    std::set< udp::IPv4Address > peers;
-};
-
-struct RecoveryState {
-    RecoveryState() = default;
-    RecoveryState( ElevatorState state, std::set< udp::IPv4Address > peers ) :
-        state( state ), peers( peers )
-    { }
-    RecoveryState( std::tuple< ElevatorState, std::set< udp::IPv4Address > > t )
-        : RecoveryState( std::get< 0 >( t ), std::get< 1 >( t ) )
-    { }
-    static TypeSignature type() { return TypeSignature::RecoveryState; }
-    std::tuple< ElevatorState, std::set< udp::IPv4Address > > tuple() const {
-        return std::make_tuple( state, peers );
-    }
-
-    ElevatorState state;
-    std::set< udp::IPv4Address > peers;
-};
+static std::vector< Peer > toPeers( const std::map< int, udp::IPv4Address > &peers ) {
+    std::vector< Peer > out;
+    for ( auto &p : peers )
+        out.emplace_back( p.first, p.second );
+    return out;
+}
 
-SessionManager::SessionManager( GlobalState &glo ) : _state( glo ),
+SessionManager::SessionManager( GlobalState &glo, int id ) : _state( glo ),
+    _id( id ), _connected( false ),
     _recoveryState( wibble::Maybe< ElevatorState >::Nothing() ),
-    _sendSock{ commSend, true }, _recvSock{ commRcv, true }
-{ }
+    _sendSock{ commSend, true }, _recvSock{ commRcv, true },
+    _leavePacket( Serializer::toPacket( Leave( id ) ) )
+{
+    assert_leq( 0, id, "invalid id" );
+    assert_neq( id, INT_MAX, "invalid id" ); // reserved for Command::ANY_ID
+    _leavePacket.address() = commBroadcast;
+}
 
-void SessionManager::_initSender( std::atomic< int > *initPhase ) {
-    _sendSock.enableBroadcast();
-    while( *initPhase < 2 ) {
-          udp::Packet pack;
-          switch ( *initPhase ) {
-                case 0: {
-                    pack = Serializer::toPacket( Initial() );
-                    break; }
-                case 1: {
-                    pack = Serializer::toPacket( Ready() );
-                    break; }
-          }
-          pack.address() = commBroadcast;
-          bool sent = _sendSock.sendPacket( pack );
-          assert( sent, "send failed" );
-          std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
+int SessionManager::defaultId() {
+    auto macs = udp::IPv4Address::getHardwareAddresses();
+    assert( !macs.empty(), "no hardware address to derive id from, please set it explicitly" );
+    uint64_t mac = *macs.begin();
+    // fold 48 bits to 31, the lower (device specific) part is kept intact
+    int id = int( (mac ^ (mac >> 31)) & 0x7fffffff );
+    return id == INT_MAX ? 0 : id;
+}
+
+void SessionManager::_addPeer( int id, udp::IPv4Address addr ) {
+    Guard g{ _lock };
+    auto it = _peers.find( id );
+    if ( it == _peers.end() ) {
+        if ( _connected )
+            std::cerr << "NOTICE: elevator " << id << " (" << addr << ") joined" << std::endl;
+        _peers.emplace( id, addr );
+    } else if ( it->second != addr ) {
+        std::cerr << "NOTICE: elevator " << id << " moved from " << it->second
+                  << " to " << addr << std::endl;
+        it->second = addr;
     }
+    _lastSeen[ id ] = now();
 }
 
-void SessionManager::_initListener( std::atomic< int > *initPhase, int count ) {
-    std::set< udp::IPv4Address > barrier;
-
-    while ( *initPhase < 2 ) {
-        udp::Packet pack = _recvSock.recvPacketWithTimeout( 300 );
-        if ( pack.size() != 0 ) {
-            switch ( Serializer::packetType( pack ) ) {
-                case TypeSignature::InitialPacket: {
-                    _peers.insert( pack.address().ip() );
-                    break; }
-                case TypeSignature::ElevatorReady: {
-                    _peers.insert( pack.address().ip() ); // it might still be that we dont know
-                    barrier.insert( pack.address().ip() );
-                    break; }
-                case TypeSignature::RecoveryPeers: {
-                    auto maybePeers = Serializer::fromPacket< RecoveryPeers >( pack );
-                    assert( !maybePeers.isNothing(), "error deserializing Peers" );
-                    RecoveryPeers recovered = maybePeers.value();
-                    barrier = _peers = recovered.peers;
-                    *initPhase = 2;
-                    break; }
-                case TypeSignature::RecoveryState: {
-                    auto maybeRecovered = Serializer::fromPacket< RecoveryState >( pack );
-                    assert( !maybeRecovered.isNothing(), "error deserializing Recovery" );
-                    RecoveryState recovered = maybeRecovered.value();
-                    _state.update( recovered.state );
-                    _recoveryState = wibble::Maybe< ElevatorState >::Just( recovered.state );
-                    barrier = _peers = recovered.peers;
-                    *initPhase = 2;
-                    break; }
-                default:
-                    std::cerr << "Unknown packet received on service channel" << std::endl;
-            }
-            if ( int( barrier.size() ) == count )
-                *initPhase = 2;
-            else if ( int( _peers.size() ) == count )
-                *initPhase = 1;
-        }
+void SessionManager::_removePeer( int id, bool failed ) {
+    Guard g{ _lock };
+    if ( id == _id || !_peers.erase( id ) )
+        return;
+    _lastSeen.erase( id );
+    std::cerr << "NOTICE: elevator " << id << (failed ? " failed" : " left") << std::endl;
+    if ( failed && _state.has( id ) )
+        _departed[ id ] = _state.get( id ); // it might come back and need recovery
+    _state.remove( id );
+}
+
+void SessionManager::_detectFailures() {
+    std::vector< int > failed;
+    {
+        Guard g{ _lock };
+        MillisecondTime t = now();
+        for ( auto &p : _lastSeen )
+            if ( p.first != _id && t - p.second > failureTimeout )
+                failed.push_back( p.first );
     }
+    for ( int id : failed )
+        _removePeer( id, true );
 }
 
-void SessionManager::connect( HeartBeat &heartbeat, int count ) {
-    // first continue sending Initial messages untill we have count peers
+void SessionManager::_bootstrap( int minCount ) {
+    _sendSock.enableBroadcast();
+    std::set< int > ready;
+
+    auto knownPeers = [&]() { Guard g{ _lock }; return int( _peers.size() ); };
+    auto announcement = [&]( bool reply ) {
+        return knownPeers() >= minCount
+            ? Serializer::toPacket( Ready( _id, reply ) )
+            : Serializer::toPacket( Initial( _id, reply ) );
+    };
+    auto recover = [&]( const std::vector< Peer > &peers ) {
+        for ( auto &p : peers )
+            _addPeer( p.id, p.addr );
+    };
 
-    std::atomic< int > initPhase{ 0 };
-    std::thread findPeers( &SessionManager::_initSender, this, &initPhase );
-    _initListener( &initPhase, count );
-    findPeers.join();
+    MillisecondTime backoff = minAnnounceInterval;
+    MillisecondTime nextAnnounce = now();
+    const MillisecondTime settled = now() + settleTime;
 
-    auto localAddrs = udp::IPv4Address::getMachineAddresses();
-    int i = 0;
+    while ( int( ready.size() ) < minCount || now() < settled ) {
+        if ( now() >= nextAnnounce ) {
+            udp::Packet pack = announcement( false );
+            pack.address() = commBroadcast;
+            bool sent = _sendSock.sendPacket( pack );
+            assert( sent, "send failed" );
+            nextAnnounce = now() + backoff;
+            backoff = std::min( 2 * backoff, maxAnnounceInterval );
+        }
+
+        MillisecondTime wake = int( ready.size() ) < minCount
+            ? nextAnnounce : std::min( nextAnnounce, settled );
+        udp::Packet pack = _recvSock.recvPacketWithTimeout(
+                std::max< MillisecondTime >( 1, wake - now() ) );
+        if ( pack.size() == 0 )
+            continue;
+
+        udp::IPv4Address from = pack.address().ip();
+        int known = knownPeers() + ready.size();
+        int peer = _id;
+        bool reply = false;
+        switch ( Serializer::packetType( pack ) ) {
+            case TypeSignature::InitialPacket: {
+                auto maybeInitial = Serializer::fromPacket< Initial >( pack );
+                if ( maybeInitial.isNothing() )
+                    break;
+                peer = maybeInitial.value().id;
+                _addPeer( peer, from );
+                reply = !maybeInitial.value().reply;
+                break; }
+            case TypeSignature::ElevatorReady: {
+                auto maybeReady = Serializer::fromPacket< Ready >( pack );
+                if ( maybeReady.isNothing() )
+                    break;
+                peer = maybeReady.value().id;
+                _addPeer( peer, from ); // it might still be that we dont know
+                ready.insert( peer );
+                reply = !maybeReady.value().reply;
+                break; }
+            case TypeSignature::ElevatorAlive: {
+                // peer which is already running, it will answer our Initial
+                auto maybeAlive = Serializer::fromPacket< Alive >( pack );
+                if ( maybeAlive.isNothing() )
+                    break;
+                _addPeer( maybeAlive.value().id, from );
+                break; }
+            case TypeSignature::ElevatorLeave:
+                break;
+            case TypeSignature::RecoveryPeers: {
+                auto maybePeers = Serializer::fromPacket< RecoveryPeers >( pack );
+                if ( maybePeers.isNothing() )
+                    break;
+                recover( maybePeers.value().peers );
+                return; }
+            case TypeSignature::RecoveryState: {
+                auto maybeRecovered = Serializer::fromPacket< RecoveryState >( pack );
+                if ( maybeRecovered.isNothing() )
+                    break;
+                RecoveryState recovered = maybeRecovered.value();
+                _state.update( recovered.state );
+                _recoveryState = wibble::Maybe< ElevatorState >::Just( recovered.state );
+                recover( recovered.peers );
+                return; }
+            default:
+                std::cerr << "Unknown packet received on service channel" << std::endl;
+        }
 
-    // the set is sorted (guaranteed by C++) and therefore same on all elevators
-    for ( auto addr : _peers ) {
-        if ( localAddrs.find( addr ) != localAddrs.end() ) {
-            _id = i;
-            break;
+        // answer right away so that sender does not have to wait for our
+        // next announcement (our own broadcasts are looped back to us)
+        if ( reply && peer != _id ) {
+            udp::Packet answer = announcement( true );
+            answer.address() = udp::Address( from, commRcv.port() );
+            _sendSock.sendPacket( answer );
+        }
+        // learning something new might have changed our state, let others
+        // know immediately
+        if ( knownPeers() + int( ready.size() ) != known ) {
+            backoff = minAnnounceInterval;
+            nextAnnounce = now();
         }
-        ++i;
     }
-    assert_leq( 0, _id, "Could not assing ID" );
-    std::cout << "detected id " << _id << std::endl;
+}
+
+void SessionManager::connect( HeartBeat &heartbeat, int minCount ) {
+    // announce Initial untill we have minCount peers, then Ready untill
+    // minCount peers are ready (or someone sends us recovery)
+    _bootstrap( minCount );
+    std::cout << "connected as " << _id << ", " << peerAddresses().size()
+              << " peer(s) known" << std::endl;
+    _start( heartbeat );
+}
+
+void SessionManager::rejoin( HeartBeat &heartbeat ) {
+    _sendSock.enableBroadcast();
+    std::cout << "rejoining as " << _id << std::endl;
+    _start( heartbeat );
+}
+
+void SessionManager::_start( HeartBeat &heartbeat ) {
+    _connected = true;
+    // now start thread which maintains membership
+    _thr = std::thread( restartWrapper( &SessionManager::_loop, ThreadClass::Network, "session" ), this, std::ref( heartbeat ) );
+}
+
+void SessionManager::leave() {
+    _sendSock.sendPacket( _leavePacket );
+}
 
-    // if RecoveryState is received use it for initialization, save it
-    // and save recovery flag
+std::map< int, udp::IPv4Address > SessionManager::peerAddresses() const {
+    Guard g{ _lock };
+    return _peers;
+}
 
-    // when we have count peers start sending Ready message untill we have
-    // count peers in ready set
+wibble::Maybe< udp::IPv4Address > SessionManager::peerAddress( int id ) const {
+    Guard g{ _lock };
+    auto it = _peers.find( id );
+    if ( it == _peers.end() )
+        return wibble::Maybe< udp::IPv4Address >::Nothing();
+    return wibble::Maybe< udp::IPv4Address >::Just( it->second );
+}
 
-    // if Ready is received add to ready set
+void SessionManager::_answerJoin( int id, udp::IPv4Address addr ) {
+    // we cannot use broadcast here: it would cause infinite recovery loop
+    udp::Address target{ addr, commBroadcast.port() };
+    _addPeer( id, addr );
 
-    // now start monitoring thread
-    _thr = std::thread( restartWrapper( &SessionManager::_loop ), this, std::ref( heartbeat ) );
+    Guard g{ _lock };
+    auto departed = _departed.find( id );
+    udp::Packet answer;
+    if ( _state.has( id ) || departed != _departed.end() ) {
+        ElevatorState state = _state.has( id ) ? _state.get( id ) : departed->second;
+        std::cerr << "NOTICE: Sending recovery to elevator " << id << ", ("
+                  << addr << ")" << std::endl;
+        answer = Serializer::toPacket( RecoveryState( state, toPeers( _peers ) ) );
+        if ( departed != _departed.end() )
+            _departed.erase( departed );
+    } else {
+        // new elevator, or one which failed before sending any state, it
+        // just needs to know about others (if it resends initial or ready,
+        // then we would resend peers anyway in this loop)
+        answer = Serializer::toPacket( RecoveryPeers( toPeers( _peers ) ) );
+    }
+    answer.address() = target;
+    _sendSock.sendPacket( answer );
 }
 
 void SessionManager::_loop( HeartBeat &heartbeat ) {
+    udp::Packet alive = Serializer::toPacket( Alive( _id ) );
+    alive.address() = commBroadcast;
+    MillisecondTime nextAlive = now();
 
     while ( true ) {
-        udp::Packet pack = _recvSock.recvPacketWithTimeout( heartbeat.threshold() / 10 );
-        if ( pack.size() != 0
-                && Serializer::packetType( pack ) == TypeSignature::InitialPacket )
-        {
-            int i = 0;
-            bool found = false;
-            for ( auto addr : _peers ) {
-                if ( addr == pack.address().ip() ) {
-                    found = true;
+        if ( now() >= nextAlive ) {
+            _sendSock.sendPacket( alive );
+            nextAlive = now() + aliveInterval;
+            _detectFailures();
+        }
+
+        udp::Packet pack = _recvSock.recvPacketWithTimeout( std::max< MillisecondTime >( 1,
+                    std::min( heartbeat.threshold() / 10, nextAlive - now() ) ) );
+        heartbeat.beat();
+        if ( pack.size() == 0 )
+            continue;
+
+        udp::IPv4Address from = pack.address().ip();
+        switch ( Serializer::packetType( pack ) ) {
+            case TypeSignature::InitialPacket: {
+                auto maybeInitial = Serializer::fromPacket< Initial >( pack );
+                if ( !maybeInitial.isNothing() && maybeInitial.value().id != _id )
+                    _answerJoin( maybeInitial.value().id, from );
+                break; }
+            case TypeSignature::ElevatorReady: {
+                // peer which have not seen our Ready yet, we are not announcing
+                // any more so it has to be answered here
+                auto maybeReady = Serializer::fromPacket< Ready >( pack );
+                if ( maybeReady.isNothing() || maybeReady.value().id == _id )
                     break;
+                _addPeer( maybeReady.value().id, from );
+                if ( !maybeReady.value().reply ) {
+                    udp::Packet answer = Serializer::toPacket( Ready( _id, true ) );
+                    answer.address() = udp::Address( from, commRcv.port() );
+                    _sendSock.sendPacket( answer );
                 }
-                ++i;
-            }
-            if ( !found ) {
-                /* NOTE: we can't add unknown elevator, it would change IDs and make
-                 * mess in recovery mechanisms */
-                std::cerr << "WARNING: Attempt to socialization from unknown IP "
-                          << pack.address().ip() << ". It will be ignored." << std::endl;
-                continue;
-            }
-
-            // we cannot use broadcast here: it would cause infinite recovery loop
-            udp::Address target{ pack.address().ip(), commBroadcast.port() };
-
-            if ( _state.has( i ) ) {
-                std::cerr << "NOTICE: Sending recovery to elevator " << i << ", ("
-                          << pack.address().ip() << ")" << std::endl;
-                udp::Packet recovery = Serializer::toPacket( RecoveryState( _state.get( i ), _peers ) );
-                recovery.address() = target;
-                _sendSock.sendPacket( recovery );
-            } else {
-                std::cerr << "NOTICE: Late initialization of elevator " << i << ", ("
-                          << pack.address().ip() << ")" << std::endl;
-                // this is rare case when elevator initializes and then fails before
-                // sending state, it is so rare we will no wait for it to confirm
-                // explicitly (if it resends initial or ready, then we would
-                // resend ready anyway in this loop)
-                udp::Packet ready = Serializer::toPacket( RecoveryPeers( _peers ) );
-                ready.address() = target;
-                _sendSock.sendPacket( ready );
-            }
+                break; }
+            case TypeSignature::ElevatorAlive: {
+                auto maybeAlive = Serializer::fromPacket< Alive >( pack );
+                if ( !maybeAlive.isNothing() )
+                    _addPeer( maybeAlive.value().id, from );
+                break; }
+            case TypeSignature::ElevatorLeave: {
+                auto maybeLeave = Serializer::fromPacket< Leave >( pack );
+                if ( !maybeLeave.isNothing() )
+                    _removePeer( maybeLeave.value().id, false );
+                break; }
+            case TypeSignature::RecoveryPeers: {
+                // late answer to our bootstrap
+                auto maybePeers = Serializer::fromPacket< RecoveryPeers >( pack );
+                if ( !maybePeers.isNothing() )
+                    for ( auto &p : maybePeers.value().peers )
+                        if ( p.id != _id )
+                            _addPeer( p.id, p.addr );
+                break; }
+            default:
+                break;
         }
-        heartbeat.beat();
     }
 }
 
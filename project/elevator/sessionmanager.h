@@ -1,4 +1,6 @@
 #include <thread>
+#include <mutex>
+#include <map>
 #include <elevator/udptools.h>
 #include <elevator/heartbeat.h>
 #include <elevator/globalstate.h>
@@ -8,36 +10,81 @@
 
 namespace elevator {
 
+/* Cluster membership
+ *
+ * Every peer has stable id (configured or derived from its MAC address),
+ * peers can join and leave at any time. Joining peer is told about others
+ * (and possibly about its state before restart), leaving peer announces it
+ * and peer which is not heard for failureTimeout is considered failed.
+ * Failed and left peers are removed from GlobalState, so that Scheduler
+ * stops using them and reschedules requests they were supposed to serve.
+ */
 struct SessionManager {
     static const udp::Address commSend;
     static const udp::Address commRcv;
     static const udp::Address commBroadcast;
+    static const MillisecondTime minAnnounceInterval = 10;
+    static const MillisecondTime maxAnnounceInterval = 500;
+    /* bootstrap takes at least this long so that running peers have chance
+     * to answer (and send us recovery) */
+    static const MillisecondTime settleTime = 50;
+    static const MillisecondTime aliveInterval = 100;
+    static const MillisecondTime failureTimeout = 1000;
 
-    SessionManager( GlobalState & );
+    SessionManager( GlobalState &, int id );
 
-    /* initializes connection (blocking) with count members and then spawns
-     * thread for recovery assistance if count > 1 */
-    void connect( HeartBeat &, int count );
-    bool connected() const { return _id != INT_MIN; }
+    /* id derived from hardware address of this machine */
+    static int defaultId();
+
+    /* initializes connection (blocking) with at least minCount members
+     * (including this one) and then spawns thread which maintains membership
+     *
+     * Peers announce themselves by broadcast, starting with short interval
+     * which is doubled up to maxAnnounceInterval while nothing new is learned.
+     * Announcements are answered immediately by unicast and peer sends Ready
+     * as soon as it knows minCount peers. */
+    void connect( HeartBeat &, int minCount );
+    /* joins without bootstrap, for backup which takes over from primary
+     * which was already connected (peers know its id and they are learned
+     * from their alive announcements) */
+    void rejoin( HeartBeat & );
+    bool connected() const { return _connected; }
     bool needRecoveryState() const { return !_recoveryState.isNothing(); }
     ElevatorState recoveryState() const { return _recoveryState.value(); }
 
+    /* announce departure to others (single send, no locks) */
+    void leave();
+
     int id() const { return _id; }
 
+    /* addresses of all currently known peers (including this one) by their IDs */
+    std::map< int, udp::IPv4Address > peerAddresses() const;
+    wibble::Maybe< udp::IPv4Address > peerAddress( int id ) const;
+
   private:
+    using Guard = std::unique_lock< std::mutex >;
+
     GlobalState &_state;
-    std::set< udp::IPv4Address > _peers;
-    int _id;
-    bool _initialized;
+    const int _id;
+    bool _connected;
+    mutable std::mutex _lock;
+    std::map< int, udp::IPv4Address > _peers;
+    std::map< int, MillisecondTime > _lastSeen;
+    std::map< int, ElevatorState > _departed; // last states of failed peers
     wibble::Maybe< ElevatorState > _recoveryState;
     udp::Socket _sendSock;
     udp::Socket _recvSock;
+    udp::Packet _leavePacket;
 
     std::thread _thr;
 
+    void _start( HeartBeat & );
     void _loop( HeartBeat & );
-    void _initSender( std::atomic< int > * );
-    void _initListener( std::atomic< int > *, int );
+    void _bootstrap( int );
+    void _addPeer( int, udp::IPv4Address );
+    void _removePeer( int, bool );
+    void _detectFailures();
+    void _answerJoin( int, udp::IPv4Address );
 };
 
 }
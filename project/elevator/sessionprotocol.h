@@ -0,0 +1,112 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Messages of cluster membership protocol (see SessionManager), they are
+ * sent on service channel and distinguished by their type signature
+ */
+
+#include <tuple>
+#include <vector>
+#include <elevator/udptools.h>
+#include <elevator/state.h>
+#include <elevator/serialization.h>
+
+#ifndef ELEVATOR_SESSION_PROTOCOL_H
+#define ELEVATOR_SESSION_PROTOCOL_H
+
+namespace elevator {
+namespace session {
+
+using serialization::TypeSignature;
+
+/* announcement of joining peer */
+struct Initial {
+    Initial() = default;
+    Initial( int id, bool reply ) : id( id ), reply( reply ) { }
+    Initial( std::tuple< int, bool > t ) : Initial( std::get< 0 >( t ), std::get< 1 >( t ) ) { };
+    std::tuple< int, bool > tuple() const { return std::make_tuple( id, reply ); }
+    static TypeSignature type() {
+        return TypeSignature::InitialPacket;
+    }
+
+    int id;
+    bool reply; // replies are not answered
+};
+
+struct Ready {
+    Ready() = default;
+    Ready( int id, bool reply ) : id( id ), reply( reply ) { }
+    Ready( std::tuple< int, bool > t ) : Ready( std::get< 0 >( t ), std::get< 1 >( t ) ) { };
+    std::tuple< int, bool > tuple() const { return std::make_tuple( id, reply ); }
+    static TypeSignature type() {
+        return TypeSignature::ElevatorReady;
+    }
+
+    int id;
+    bool reply;
+};
+
+struct Leave {
+    Leave() = default;
+    Leave( int id ) : id( id ) { }
+    Leave( std::tuple< int > t ) : Leave( std::get< 0 >( t ) ) { };
+    std::tuple< int > tuple() const { return std::make_tuple( id ); }
+    static TypeSignature type() { return TypeSignature::ElevatorLeave; }
+
+    int id;
+};
+
+struct Alive {
+    Alive() = default;
+    Alive( int id ) : id( id ) { }
+    Alive( std::tuple< int > t ) : Alive( std::get< 0 >( t ) ) { };
+    std::tuple< int > tuple() const { return std::make_tuple( id ); }
+    static TypeSignature type() { return TypeSignature::ElevatorAlive; }
+
+    int id;
+};
+
+struct Peer {
+    Peer() = default;
+    Peer( int id, udp::IPv4Address addr ) : id( id ), addr( addr ) { }
+    Peer( std::tuple< int, udp::IPv4Address > t ) : Peer( std::get< 0 >( t ), std::get< 1 >( t ) ) { }
+    std::tuple< int, udp::IPv4Address > tuple() const { return std::make_tuple( id, addr ); }
+
+    int id;
+    udp::IPv4Address addr;
+};
+
+struct RecoveryPeers {
+    RecoveryPeers() = default;
+    RecoveryPeers( std::vector< Peer > peers ) : peers( peers ) { }
+    RecoveryPeers( std::tuple< std::vector< Peer > > t )
+        : RecoveryPeers( std::get< 0 >( t ) )
+    { }
+    static TypeSignature type() { return TypeSignature::RecoveryPeers; }
+    std::tuple< std::vector< Peer > > tuple() const {
+        return std::make_tuple( peers );
+    }
+
+    std::vector< Peer > peers;
+};
+
+struct RecoveryState {
+    RecoveryState() = default;
+    RecoveryState( ElevatorState state, std::vector< Peer > peers ) :
+        state( state ), peers( peers )
+    { }
+    RecoveryState( std::tuple< ElevatorState, std::vector< Peer > > t )
+        : RecoveryState( std::get< 0 >( t ), std::get< 1 >( t ) )
+    { }
+    static TypeSignature type() { return TypeSignature::RecoveryState; }
+    std::tuple< ElevatorState, std::vector< Peer > > tuple() const {
+        return std::make_tuple( state, peers );
+    }
+
+    ElevatorState state;
+    std::vector< Peer > peers;
+};
+
+}
+}
+
+#endif // ELEVATOR_SESSION_PROTOCOL_H
@@ -0,0 +1,123 @@
+#include <elevator/simulator.h>
+#include <elevator/channels.h>
+
+#include <thread>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace lowlevel {
+
+const int Simulator::floors;
+const elevator::MillisecondTime Simulator::floorTravel;
+const elevator::MillisecondTime Simulator::pressDuration;
+
+static const int sensors[ Simulator::floors ] = { SENSOR1, SENSOR2, SENSOR3, SENSOR4 };
+// part of floor around each floor in which sensor is active
+static const double sensorWidth = 0.05;
+
+Simulator *Simulator::instance() {
+    static std::mutex lock;
+    static Simulator *sim = nullptr;
+    static pid_t pid = 0;
+
+    std::lock_guard< std::mutex > guard( lock );
+    // listening thread does not survive fork, so child gets its own
+    // simulator (old one is leaked, it is used by nobody)
+    if ( pid != getpid() ) {
+        pid = getpid();
+        const char *port = std::getenv( "ELEVATOR_SIMULATOR" );
+        sim = port ? new Simulator( std::atoi( port ) ) : nullptr;
+    }
+    return sim;
+}
+
+Simulator::Simulator( int port ) :
+    _position( 0 ), _motor( 0 ), _lastUpdate( elevator::now() )
+{
+    int fd = socket( AF_INET, SOCK_DGRAM, 0 );
+    sockaddr_in addr;
+    std::memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons( port );
+    addr.sin_addr.s_addr = htonl( INADDR_ANY );
+    if ( fd < 0 || bind( fd, reinterpret_cast< sockaddr * >( &addr ), sizeof( addr ) ) != 0 ) {
+        std::cerr << "WARNING: simulator cannot listen on port " << port << ": "
+                  << std::strerror( errno ) << ", buttons will not work" << std::endl;
+        if ( fd >= 0 )
+            close( fd );
+        return;
+    }
+
+    // signals should be handled by threads which expect them
+    sigset_t all, old;
+    sigfillset( &all );
+    pthread_sigmask( SIG_BLOCK, &all, &old );
+    std::thread( &Simulator::_listen, this, fd ).detach();
+    pthread_sigmask( SIG_SETMASK, &old, nullptr );
+}
+
+void Simulator::_listen( int fd ) {
+    for ( ;; ) {
+        uint32_t channel;
+        if ( recv( fd, &channel, sizeof( channel ), 0 ) == sizeof( channel ) )
+            press( ntohl( channel ) );
+    }
+}
+
+void Simulator::press( int channel ) {
+    std::lock_guard< std::mutex > guard( _lock );
+    _pressedUntil[ channel ] = elevator::now() + pressDuration;
+}
+
+void Simulator::_advance() {
+    elevator::MillisecondTime t = elevator::now();
+    if ( _motor > 0 ) {
+        double delta = double( t - _lastUpdate ) / floorTravel;
+        _position += _bits[ MOTORDIR ] ? -delta : delta;
+        _position = std::max( 0.0, std::min( double( floors - 1 ), _position ) );
+    }
+    _lastUpdate = t;
+}
+
+bool Simulator::_sensor( int floor ) const {
+    return std::abs( _position - floor ) <= sensorWidth;
+}
+
+void Simulator::setBit( int channel, bool value ) {
+    std::lock_guard< std::mutex > guard( _lock );
+    if ( channel == MOTORDIR )
+        _advance(); // change of direction applies from now
+    _bits[ channel ] = value;
+}
+
+bool Simulator::readBit( int channel ) {
+    std::lock_guard< std::mutex > guard( _lock );
+    for ( int i = 0; i < floors; ++i )
+        if ( channel == sensors[ i ] ) {
+            _advance();
+            return _sensor( i );
+        }
+    auto pressed = _pressedUntil.find( channel );
+    if ( pressed != _pressedUntil.end() && pressed->second >= elevator::now() )
+        return true;
+    auto it = _bits.find( channel );
+    return it != _bits.end() && it->second;
+}
+
+void Simulator::writeAnalog( int channel, int value ) {
+    std::lock_guard< std::mutex > guard( _lock );
+    if ( channel == MOTOR ) {
+        _advance();
+        _motor = value;
+    }
+}
+
+}
@@ -0,0 +1,54 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Simulated elevator hardware for builds without libComedi
+ *
+ * Enabled by setting ELEVATOR_SIMULATOR environment variable to UDP port,
+ * then all IO of the process goes to one simulated elevator: car moves
+ * with constant speed while motor runs, floor sensors are active near
+ * floors and car stops at ends of shaft. Buttons are pressed by sending
+ * datagram with IO channel (32 bit, network byte order) to the port,
+ * button stays pressed for pressDuration. Used by tools/soak.cpp.
+ */
+
+#include <map>
+#include <mutex>
+#include <elevator/time.h>
+
+#ifndef SRC_SIMULATOR_H
+#define SRC_SIMULATOR_H
+
+namespace lowlevel {
+
+struct Simulator {
+    static const int floors = 4;
+    static const elevator::MillisecondTime floorTravel = 1000; // ms per floor
+    static const elevator::MillisecondTime pressDuration = 100;
+
+    /* simulator of this process (created on first call after fork),
+     * nullptr if not enabled */
+    static Simulator *instance();
+
+    void setBit( int channel, bool value );
+    bool readBit( int channel );
+    void writeAnalog( int channel, int value );
+    void press( int channel );
+
+  private:
+    explicit Simulator( int port );
+    Simulator( const Simulator & ) = delete;
+
+    void _advance();
+    bool _sensor( int floor ) const;
+    void _listen( int fd );
+
+    std::mutex _lock;
+    std::map< int, bool > _bits;
+    std::map< int, elevator::MillisecondTime > _pressedUntil;
+    double _position; // in floors, lowest floor is 0
+    int _motor;       // last analog value written to motor
+    elevator::MillisecondTime _lastUpdate;
+};
+
+}
+
+#endif // SRC_SIMULATOR_H
@@ -6,6 +6,7 @@
 #include <elevator/driver.h>
 #include <elevator/serialization.h>
 #include <elevator/floorset.h>
+#include <elevator/time.h>
 
 #ifndef SRC_STATE_H
 #define SRC_STATE_H
@@ -76,24 +77,29 @@ struct ElevatorState {
 };
 
 struct StateChange {
-    using Tuple = std::tuple< ChangeType, int, ElevatorState >;
+    using Tuple = std::tuple< ChangeType, int, ElevatorState, MicrosecondTime >;
 
-    StateChange() : changeType( ChangeType::None ), changeFloor( INT_MIN ) { }
+    StateChange() : changeType( ChangeType::None ), changeFloor( INT_MIN ), created( 0 ) { }
     StateChange( Tuple tuple ) :
         changeType( std::get< 0 >( tuple ) ),
         changeFloor( std::get< 1 >( tuple ) ),
-        state( std::get< 2 >( tuple ) )
+        state( std::get< 2 >( tuple ) ),
+        created( std::get< 3 >( tuple ) )
     { }
 
-    Tuple tuple() const { return std::make_tuple( changeType, changeFloor, state ); }
+    Tuple tuple() const { return std::make_tuple( changeType, changeFloor, state, created ); }
     static constexpr serialization::TypeSignature type() {
         return serialization::TypeSignature::ElevatorState;
     }
-
+    /* offset of state.id in packet (after changeType and changeFloor) */
+    static int idOffset() {
+        return serialization::Serializer::dataOffset() + sizeof( ChangeType ) + sizeof( int );
+    }
 
     ChangeType changeType;
     int changeFloor;
     ElevatorState state;
+    MicrosecondTime created; // wallMicro() at the time of change
 };
 
 }
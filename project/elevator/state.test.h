@@ -1,4 +1,5 @@
 #include <elevator/state.h>
+#include <elevator/globalstate.h>
 #include <elevator/test.h>
 #include <elevator/serialization.h>
 #include <elevator/udptools.h>
@@ -11,4 +12,36 @@ struct TestState {
         auto st2 = serialization::Serializer::fromPacket< elevator::StateChange >( pck );
     }
 
+    Test removeExpires() {
+        using namespace elevator;
+        GlobalState global;
+        ElevatorState st;
+        st.id = 7;
+        global.update( st );
+        global.requests().push( Request( Command{ CommandType::CallToFloorAndGoUp, 7, 1 }, 10000 ) );
+        global.requests().push( Request( Command{ CommandType::CallToFloorAndGoUp, 8, 2 }, 10000 ) );
+        assert( global.requests().waitForEarliestDeadline( 10 ).isNothing(), "nothing is due yet" );
+
+        global.remove( 7 );
+        assert( !global.has( 7 ), "" );
+        auto r = global.requests().waitForEarliestDeadline( 10 );
+        assert( !r.isNothing(), "request of removed elevator should expire" );
+        assert_eq( r.value().elevatorId(), 7, "" );
+        assert( global.requests().waitForEarliestDeadline( 10 ).isNothing(), "others should wait" );
+    }
+
+    Test floorSetBounds() {
+        using namespace elevator;
+        BasicDriverInfo info( 1, 4 );
+        FloorSet set;
+        bool thrown = false;
+        try {
+            set.get( 5, info );
+        } catch ( test::GenerallAssertionFailed & ) {
+            thrown = true;
+        }
+        assert_eq( thrown, test::assertLevel >= test::assertLevelDebug,
+                "bounds are checked only with debug assertions" );
+    }
+
 };
@@ -0,0 +1,123 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include <elevator/state.h>
+#include <elevator/command.h>
+#include <elevator/time.h>
+
+#ifndef SRC_STATUS_H
+#define SRC_STATUS_H
+
+namespace elevator {
+
+/* what scheduler knew after processing some state update, it has fixed size
+ * so that it can be published without allocation */
+struct StatusSnapshot {
+    static const int maxElevators = 16;
+    static const int maxRequests = 64;
+
+    StatusSnapshot() : time( 0 ), elevatorCount( 0 ), requestCount( 0 ) { }
+
+    MicrosecondTime time; // wallMicro()
+    int elevatorCount;    // elevators are sorted by id
+    int requestCount;     // of all pending requests, only maxRequests are kept
+    ElevatorState elevators[ maxElevators ];
+    Command requests[ maxRequests ];
+
+    int keptRequests() const { return std::min( requestCount, maxRequests ); }
+
+    void addElevator( const ElevatorState &state ) {
+        if ( elevatorCount == maxElevators )
+            return;
+        int i = elevatorCount++;
+        for ( ; i > 0 && elevators[ i - 1 ].id > state.id; --i )
+            elevators[ i ] = elevators[ i - 1 ];
+        elevators[ i ] = state;
+    }
+
+    void addRequest( const Command &comm ) {
+        if ( requestCount < maxRequests )
+            requests[ requestCount ] = comm;
+        ++requestCount;
+    }
+};
+
+/* Snapshot is published by scheduler and read by status server through
+ * double buffer in which every slot is protected by sequence lock (like
+ * CheckpointRing), so publishing never waits for readers and readers never
+ * touch any lock (of board, GlobalState or RequestQueue); reader retries if
+ * the slot it copied was overwritten meanwhile. Scheduler publishes at most
+ * once per interval, status is polled much less often. */
+struct StatusBoard {
+    static const MillisecondTime interval = 100;
+
+    StatusBoard() : _published( 0 ), _next( 0 ) {
+        for ( auto &s : _slots )
+            s.seq.store( 0, std::memory_order_relaxed );
+    }
+
+    /* true if it is time to publish new snapshot (single writer) */
+    bool due( MillisecondTime t ) {
+        if ( t < _next )
+            return false;
+        _next = t + interval;
+        return true;
+    }
+
+    /* empty snapshot to be filled by writer, readers see it after publish */
+    StatusSnapshot &begin() {
+        Slot &slot = _slots[ _published.load( std::memory_order_relaxed ) % 2 ];
+        slot.seq.store( slot.seq.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+        slot.snapshot.time = 0;
+        slot.snapshot.elevatorCount = 0;
+        slot.snapshot.requestCount = 0;
+        return slot.snapshot;
+    }
+
+    void publish() {
+        long p = _published.load( std::memory_order_relaxed );
+        Slot &slot = _slots[ p % 2 ];
+        slot.seq.store( slot.seq.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+        _published.store( p + 1, std::memory_order_release );
+    }
+
+    /* copy of newest snapshot, false if nothing was published yet */
+    bool current( StatusSnapshot &out ) const {
+        while ( true ) {
+            long p = _published.load( std::memory_order_acquire );
+            if ( p == 0 )
+                return false;
+            const Slot &slot = _slots[ (p - 1) % 2 ];
+            uint32_t seq = slot.seq.load( std::memory_order_acquire );
+            if ( seq & 1 )
+                continue;
+            std::memcpy( static_cast< void * >( &out ), &slot.snapshot, sizeof( StatusSnapshot ) );
+            std::atomic_thread_fence( std::memory_order_acquire );
+            if ( slot.seq.load( std::memory_order_relaxed ) == seq )
+                return true;
+        }
+    }
+
+  private:
+    static_assert( std::is_trivially_copyable< ElevatorState >::value
+            && std::is_trivially_copyable< Command >::value,
+            "snapshot is copied by memcpy" );
+
+    struct Slot {
+        std::atomic< uint32_t > seq; // odd while being written
+        StatusSnapshot snapshot;
+    };
+
+    Slot _slots[ 2 ];
+    std::atomic< long > _published; // number of published snapshots
+    MillisecondTime _next; // of writer
+};
+
+}
+
+#endif // SRC_STATUS_H
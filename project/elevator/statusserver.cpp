@@ -0,0 +1,203 @@
+#include <wibble/net/http.h>
+#include <wibble/exception.h>
+
+#include <elevator/statusserver.h>
+#include <elevator/latency.h>
+#include <elevator/restartwrapper.h>
+#include <elevator/test.h>
+
+#include <sstream>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+namespace elevator {
+
+StatusServer::StatusServer( const StatusBoard &board, int port, const char *host ) :
+    _board( board ), _heartbeats( nullptr )
+{
+    // elevator has its own handling of SIGINT and SIGTERM, server must not
+    // replace it
+    stop_signals.clear();
+    bind( std::to_string( port ).c_str(), host );
+    listen();
+    set_sock_cloexec();
+}
+
+StatusServer::~StatusServer() {
+    if ( _thr.joinable() ) {
+        // makes accept fail, which ends loop
+        ::shutdown( sock, SHUT_RDWR );
+        _thr.join();
+    }
+}
+
+void StatusServer::run() {
+    assert( !_thr.joinable(), "status server already running" );
+    _thr = std::thread( &StatusServer::_loop, this );
+}
+
+void StatusServer::_loop() {
+    // signals belong to other threads, blocked SIGPIPE makes writes to
+    // closed client return error instead of killing process
+    sigset_t all;
+    sigfillset( &all );
+    pthread_sigmask( SIG_BLOCK, &all, nullptr );
+    struct sched_param param;
+    param.sched_priority = 0;
+    pthread_setschedparam( pthread_self(), SCHED_IDLE, &param ); // best effort
+
+    try {
+        accept_loop();
+    } catch ( wibble::exception::System & ) {
+        // socket was shut down
+    }
+}
+
+void StatusServer::handle_client( int sock, const std::string &peerHostname,
+        const std::string &peerHostaddr, const std::string &peerPort )
+{
+    // stalled client must not block server forever
+    struct timeval timeout{ 1, 0 };
+    setsockopt( sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+    setsockopt( sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+
+    wibble::net::http::Request req;
+    req.sock = sock;
+    req.peer_hostname = peerHostname;
+    req.peer_hostaddr = peerHostaddr;
+    req.peer_port = peerPort;
+    req.server_software = "elevator";
+    try {
+        if ( req.read_request() ) {
+            if ( req.path_info == "/status" || req.path_info == "/" )
+                req.send_result( json(), "application/json" );
+            else if ( req.path_info == "/metrics" )
+                req.send_result( prometheus(), "text/plain; version=0.0.4" );
+            else
+                wibble::net::http::error404().send( req );
+        }
+    } catch ( std::exception &ex ) {
+        std::cerr << "WARNING: status request failed: " << ex.what() << std::endl;
+    }
+    close( sock );
+}
+
+static const char *showDirection( Direction d ) {
+    switch ( d ) {
+        case Direction::Up: return "up";
+        case Direction::Down: return "down";
+        case Direction::None: return "none";
+    }
+    return "unknown";
+}
+
+std::string StatusServer::json() const {
+    StatusSnapshot snapshot;
+    std::stringstream ss;
+    ss << "{\n";
+    if ( _board.current( snapshot ) ) {
+        ss << "  \"time\": " << snapshot.time << ",\n"
+           << "  \"elevators\": [";
+        bool first = true;
+        for ( int i = 0; i < snapshot.elevatorCount; ++i ) {
+            const ElevatorState &e = snapshot.elevators[ i ];
+            ss << (first ? "\n" : ",\n")
+               << "    { \"id\": " << e.id << ", \"timestamp\": " << e.timestamp
+               << ", \"lastFloor\": " << e.lastFloor
+               << ", \"direction\": \"" << showDirection( e.direction ) << "\""
+               << ", \"stopped\": " << (e.stopped ? "true" : "false")
+               << ", \"doorOpen\": " << (e.doorOpen ? "true" : "false") << " }";
+            first = false;
+        }
+        ss << " ],\n  \"requests\": {\n    \"size\": " << snapshot.requestCount
+           << ",\n    \"pending\": [";
+        first = true;
+        for ( int i = 0; i < snapshot.keptRequests(); ++i ) {
+            const Command &c = snapshot.requests[ i ];
+            ss << (first ? "\n" : ",\n")
+               << "      { \"type\": \"" << showCommand( c.commandType ) << "\""
+               << ", \"elevator\": " << c.targetElevatorId
+               << ", \"floor\": " << c.targetFloor << " }";
+            first = false;
+        }
+        ss << " ]\n  },\n";
+    }
+
+    ss << "  \"queues\": {";
+    bool first = true;
+    for ( auto &q : _queues ) {
+        ss << (first ? " " : ", ") << "\"" << q.first << "\": " << q.second();
+        first = false;
+    }
+    ss << " },\n  \"heartbeats\": [";
+    first = true;
+    if ( _heartbeats )
+        _heartbeats->each( [&]( const HeartBeat &hb ) {
+                ss << (first ? "\n" : ",\n")
+                   << "    { \"name\": \"" << hb.name() << "\", \"threshold\": " << hb.threshold()
+                   << ", \"worst\": " << hb.worst() << ", \"slack\": " << hb.slack() << " }";
+                first = false;
+            } );
+    ss << " ],\n  \"restarts\": {";
+    first = true;
+    eachRestartCounter( [&]( const RestartCounter &c ) {
+            ss << (first ? " " : ", ") << "\"" << c.name << "\": " << c.restarts.load();
+            first = false;
+        } );
+    ss << " },\n  \"latency\": {";
+    for ( int i = 0; i < latency::stageCount; ++i ) {
+        auto stage = latency::Stage( i );
+        auto &h = latency::histogram( stage );
+        ss << (i ? ",\n" : "\n")
+           << "    \"" << latency::showStage( stage ) << "\": { \"count\": " << h.count()
+           << ", \"p50\": " << h.percentile( 50 ) << ", \"p99\": " << h.percentile( 99 )
+           << ", \"p999\": " << h.percentile( 99.9 ) << ", \"max\": " << h.max() << " }";
+    }
+    ss << "\n  }\n}\n";
+    return ss.str();
+}
+
+std::string StatusServer::prometheus() const {
+    StatusSnapshot snapshot;
+    std::stringstream ss;
+    if ( _board.current( snapshot ) ) {
+        ss << "# TYPE elevator_requests gauge\n"
+           << "elevator_requests " << snapshot.requestCount << "\n"
+           << "# TYPE elevator_last_floor gauge\n";
+        for ( int i = 0; i < snapshot.elevatorCount; ++i )
+            ss << "elevator_last_floor{elevator=\"" << snapshot.elevators[ i ].id << "\"} "
+               << snapshot.elevators[ i ].lastFloor << "\n";
+    }
+    ss << "# TYPE elevator_queue_depth gauge\n";
+    for ( auto &q : _queues )
+        ss << "elevator_queue_depth{queue=\"" << q.first << "\"} " << q.second() << "\n";
+    if ( _heartbeats ) {
+        ss << "# TYPE elevator_heartbeat_slack_ms gauge\n";
+        _heartbeats->each( [&]( const HeartBeat &hb ) {
+                ss << "elevator_heartbeat_slack_ms{heartbeat=\"" << hb.name() << "\"} "
+                   << hb.slack() << "\n";
+            } );
+    }
+    ss << "# TYPE elevator_restarts_total counter\n";
+    eachRestartCounter( [&]( const RestartCounter &c ) {
+            ss << "elevator_restarts_total{loop=\"" << c.name << "\"} " << c.restarts.load() << "\n";
+        } );
+    ss << "# TYPE elevator_latency_us summary\n";
+    for ( int i = 0; i < latency::stageCount; ++i ) {
+        auto stage = latency::Stage( i );
+        auto &h = latency::histogram( stage );
+        const char *name = latency::showStage( stage );
+        for ( double q : { 50.0, 90.0, 99.0, 99.9 } )
+            ss << "elevator_latency_us{stage=\"" << name << "\",quantile=\"" << q / 100 << "\"} "
+               << h.percentile( q ) << "\n";
+        ss << "elevator_latency_us_count{stage=\"" << name << "\"} " << h.count() << "\n";
+    }
+    return ss.str();
+}
+
+}
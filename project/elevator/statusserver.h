@@ -0,0 +1,62 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* HTTP status endpoint
+ *
+ * Serves status snapshot published by scheduler, queue depths, heartbeat
+ * telemetry, restart counters and latency histograms:
+ *   /status   JSON
+ *   /metrics  Prometheus text format
+ *
+ * Server runs on its own SCHED_IDLE thread and reads only published
+ * snapshot and atomic counters, it never takes locks of control path.
+ */
+
+#include <wibble/net/server.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+
+#include <elevator/status.h>
+#include <elevator/concurrentqueue.h>
+#include <elevator/heartbeat.h>
+
+#ifndef SRC_STATUS_SERVER_H
+#define SRC_STATUS_SERVER_H
+
+namespace elevator {
+
+struct StatusServer : wibble::net::TCPServer {
+    /* binds to port on host (localhost by default) */
+    StatusServer( const StatusBoard &board, int port, const char *host = "127.0.0.1" );
+    ~StatusServer();
+
+    /* all watches must be set before run */
+    template< typename T >
+    void watchQueue( const char *name, const ConcurrentQueue< T > &queue ) {
+        _queues.emplace_back( name, [&queue]() { return queue.approxSize(); } );
+    }
+    void watchHeartBeats( const HeartBeatManager &manager ) { _heartbeats = &manager; }
+
+    /* spawn server thread */
+    void run();
+
+    std::string json() const;
+    std::string prometheus() const;
+
+    void handle_client( int sock, const std::string &peerHostname,
+            const std::string &peerHostaddr, const std::string &peerPort ) override;
+
+  private:
+    const StatusBoard &_board;
+    std::vector< std::pair< const char *, std::function< size_t() > > > _queues;
+    const HeartBeatManager *_heartbeats;
+    std::thread _thr;
+
+    void _loop();
+};
+
+}
+
+#endif // SRC_STATUS_SERVER_H
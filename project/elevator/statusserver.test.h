@@ -0,0 +1,93 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <elevator/statusserver.h>
+#include <elevator/test.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace elevator;
+
+struct TestStatusServer {
+    static int port() { return test::port( 64127 ); }
+
+    static std::string get( std::string path ) {
+        int fd = socket( AF_INET, SOCK_STREAM, 0 );
+        assert_leq( 0, fd, "socket" );
+        sockaddr_in addr;
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons( port() );
+        addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+        int r = connect( fd, reinterpret_cast< sockaddr * >( &addr ), sizeof( addr ) );
+        assert_eq( r, 0, "connect" );
+        std::string req = "GET " + path + " HTTP/1.0\r\n\r\n";
+        assert_eq( write( fd, req.data(), req.size() ), ssize_t( req.size() ), "write" );
+        std::string resp;
+        char buf[ 1024 ];
+        ssize_t n;
+        while ( (n = read( fd, buf, sizeof( buf ) )) > 0 )
+            resp.append( buf, n );
+        close( fd );
+        return resp;
+    }
+
+    Test board() {
+        StatusBoard board;
+        StatusSnapshot snapshot;
+        assert( !board.current( snapshot ), "nothing published yet" );
+        assert( board.due( 1000 ), "" );
+        assert( !board.due( 1000 + StatusBoard::interval - 1 ), "publishing is throttled" );
+
+        for ( int round = 0; round < 3; ++round ) {
+            StatusSnapshot &s = board.begin();
+            for ( int id : { 5, 3, 9 } ) {
+                ElevatorState state;
+                state.id = id;
+                state.lastFloor = round;
+                s.addElevator( state );
+            }
+            for ( int i = 0; i < StatusSnapshot::maxRequests + 2; ++i )
+                s.addRequest( Command( CommandType::CallToFloorAndGoUp, 3, i ) );
+            board.publish();
+        }
+        assert( board.current( snapshot ), "" );
+        assert_eq( snapshot.elevatorCount, 3, "" );
+        assert_eq( snapshot.elevators[ 0 ].id, 3, "elevators are sorted" );
+        assert_eq( snapshot.elevators[ 2 ].id, 9, "elevators are sorted" );
+        assert_eq( snapshot.elevators[ 1 ].lastFloor, 2, "newest snapshot" );
+        assert_eq( snapshot.requestCount, StatusSnapshot::maxRequests + 2, "" );
+        assert_eq( snapshot.keptRequests(), StatusSnapshot::maxRequests, "" );
+    }
+
+    Test serve() {
+        StatusBoard board;
+        ConcurrentQueue< int > queue;
+        queue.enqueue( 1 );
+        queue.enqueue( 2 );
+
+        StatusSnapshot &snapshot = board.begin();
+        ElevatorState state;
+        state.id = 7;
+        state.lastFloor = 2;
+        snapshot.addElevator( state );
+        snapshot.addRequest( Command( CommandType::CallToFloorAndGoUp, 7, 3 ) );
+        board.publish();
+
+        StatusServer server{ board, port() };
+        server.watchQueue( "test", queue );
+        server.run();
+
+        std::string metrics = get( "/metrics" );
+        assert_neq( metrics.find( "200 OK" ), std::string::npos, "" );
+        assert_neq( metrics.find( "elevator_requests 1\n" ), std::string::npos, "" );
+        assert_neq( metrics.find( "elevator_last_floor{elevator=\"7\"} 2\n" ), std::string::npos, "" );
+        assert_neq( metrics.find( "elevator_queue_depth{queue=\"test\"} 2\n" ), std::string::npos, "" );
+
+        std::string status = get( "/status" );
+        assert_neq( status.find( "\"lastFloor\": 2" ), std::string::npos, "" );
+        assert_neq( status.find( "CallToFloorAndGoUp" ), std::string::npos, "" );
+
+        assert_neq( get( "/nothing" ).find( "404" ), std::string::npos, "" );
+    }
+};
@@ -3,7 +3,10 @@
 #include <cstdlib>
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <stdexcept>
 #include <type_traits>
+#include <unistd.h>
 
 #define CODE_LOCATION test::Location( __FILE__, __LINE__, __func__ )
 
@@ -14,6 +17,31 @@
 #undef assert_le
 #undef assert_unimplemented
 #undef assert_unreachable
+#undef assert_debug
+#undef assert_debug_eq
+#undef assert_debug_neq
+#undef assert_debug_leq
+#undef assert_debug_lt
+#undef assert_paranoid
+#undef assert_paranoid_eq
+#undef assert_paranoid_neq
+#undef assert_paranoid_leq
+#undef assert_paranoid_lt
+
+/* Assertion tiers, selected by O_ASSERT_LEVEL (set by build, see ASSERT_LEVEL
+ * in CMakeLists.txt):
+ *   assert*           always checked (safety), even with NDEBUG
+ *   assert_debug*     checked if O_ASSERT_LEVEL >= 1 (default in Debug builds)
+ *   assert_paranoid*  checked if O_ASSERT_LEVEL >= 2
+ * Disabled assertions do not evaluate their arguments.
+ */
+#ifndef O_ASSERT_LEVEL
+#ifdef NDEBUG
+#define O_ASSERT_LEVEL 0
+#else
+#define O_ASSERT_LEVEL 1
+#endif
+#endif
 
 #define assert( X, MSG ) test::assert_fn( !!(X), #X " (" MSG ")", CODE_LOCATION )
 #define assert_eq( X, Y, MSG ) test::assert_eq_fn( X, Y, #X " == " #Y " (" MSG ")", CODE_LOCATION )
@@ -23,6 +51,38 @@
 #define assert_unimplemented()  test::assert_unimplemented_fn( CODE_LOCATION )
 #define assert_unreachable( MSG )    test::assert_unreachable_fn( "unreachable: " MSG, CODE_LOCATION )
 
+// arguments are only named in unevaluated context to avoid unused warnings
+#define ASSERT_DISABLED_( X ) static_cast< void >( sizeof( !!(X) ) )
+#define ASSERT_DISABLED2_( X, Y ) static_cast< void >( sizeof( X ) + sizeof( Y ) )
+
+#if O_ASSERT_LEVEL >= 1
+#define assert_debug( X, MSG ) assert( X, MSG )
+#define assert_debug_eq( X, Y, MSG ) assert_eq( X, Y, MSG )
+#define assert_debug_neq( X, Y, MSG ) assert_neq( X, Y, MSG )
+#define assert_debug_leq( X, Y, MSG ) assert_leq( X, Y, MSG )
+#define assert_debug_lt( X, Y, MSG ) assert_lt( X, Y, MSG )
+#else
+#define assert_debug( X, MSG ) ASSERT_DISABLED_( X )
+#define assert_debug_eq( X, Y, MSG ) ASSERT_DISABLED2_( X, Y )
+#define assert_debug_neq( X, Y, MSG ) ASSERT_DISABLED2_( X, Y )
+#define assert_debug_leq( X, Y, MSG ) ASSERT_DISABLED2_( X, Y )
+#define assert_debug_lt( X, Y, MSG ) ASSERT_DISABLED2_( X, Y )
+#endif
+
+#if O_ASSERT_LEVEL >= 2
+#define assert_paranoid( X, MSG ) assert( X, MSG )
+#define assert_paranoid_eq( X, Y, MSG ) assert_eq( X, Y, MSG )
+#define assert_paranoid_neq( X, Y, MSG ) assert_neq( X, Y, MSG )
+#define assert_paranoid_leq( X, Y, MSG ) assert_leq( X, Y, MSG )
+#define assert_paranoid_lt( X, Y, MSG ) assert_lt( X, Y, MSG )
+#else
+#define assert_paranoid( X, MSG ) ASSERT_DISABLED_( X )
+#define assert_paranoid_eq( X, Y, MSG ) ASSERT_DISABLED2_( X, Y )
+#define assert_paranoid_neq( X, Y, MSG ) ASSERT_DISABLED2_( X, Y )
+#define assert_paranoid_leq( X, Y, MSG ) ASSERT_DISABLED2_( X, Y )
+#define assert_paranoid_lt( X, Y, MSG ) ASSERT_DISABLED2_( X, Y )
+#endif
+
 #ifndef SRC_TEST_H
 #define SRC_TEST_H
 
@@ -30,6 +90,41 @@ using Test = void;
 
 namespace test {
 
+/* for checks which are more than single assertion, such as consistency
+ * scans: if ( test::assertLevel >= test::assertLevelDebug ) ... */
+static constexpr int assertLevel = O_ASSERT_LEVEL;
+static constexpr int assertLevelDebug = 1;
+static constexpr int assertLevelParanoid = 2;
+
+/* port for network test: parallel test runner gives every worker distinct
+ * WIBBLE_TEST_PORT_OFFSET (multiple of 16, see wibble/test-main.h), so tests
+ * running at the same time get distinct ports as long as all fixed test ports
+ * lie within 64123 -- 64138 */
+static inline int port( int base ) {
+    const char *offset = std::getenv( "WIBBLE_TEST_PORT_OFFSET" );
+    return base + ( offset ? std::atoi( offset ) : 0 );
+}
+
+/* unique file in $TMPDIR (or /tmp) for tests, it is removed when TempFile
+ * goes out of scope, even if test fails */
+struct TempFile {
+    explicit TempFile( std::string name ) {
+        const char *dir = std::getenv( "TMPDIR" );
+        std::string templ = std::string( dir && *dir ? dir : "/tmp" )
+            + "/elevator-test-" + name + ".XXXXXX";
+        int fd = mkstemp( &templ[ 0 ] );
+        if ( fd < 0 )
+            throw std::runtime_error( "cannot create temporary file " + templ );
+        close( fd );
+        path = templ;
+    }
+    ~TempFile() { unlink( path.c_str() ); }
+    TempFile( const TempFile & ) = delete;
+    TempFile &operator=( const TempFile & ) = delete;
+
+    std::string path;
+};
+
 enum class AssertionTag {
     Generall,
     Unimplemented,
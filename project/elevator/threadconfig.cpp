@@ -0,0 +1,108 @@
+#include <wibble/commandline/core.h>
+
+#include <elevator/threadconfig.h>
+#include <elevator/test.h>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <alloca.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace elevator {
+
+const size_t ThreadConfig::defaultStackPrefault;
+
+static ThreadConfig configs[ 3 ];
+
+const ThreadConfig &ThreadConfig::get( ThreadClass c ) {
+    return configs[ int( c ) ];
+}
+
+void ThreadConfig::set( ThreadClass c, const ThreadConfig &config ) {
+    assert( c != ThreadClass::Background, "background threads are not configurable" );
+    configs[ int( c ) ] = config;
+}
+
+void ThreadConfig::apply() const {
+    if ( isDefault() )
+        return;
+
+    if ( stackPrefault )
+        prefaultStack( stackPrefault );
+
+    if ( policy != SCHED_OTHER ) {
+        struct sched_param param;
+        param.sched_priority = priority;
+        int r = pthread_setschedparam( pthread_self(), policy, &param );
+        if ( r != 0 )
+            std::cerr << "WARNING: cannot set scheduling policy: " << std::strerror( r ) << std::endl;
+    }
+
+    if ( !cpus.empty() ) {
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        for ( int cpu : cpus )
+            CPU_SET( cpu, &set );
+        int r = pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+        if ( r != 0 )
+            std::cerr << "WARNING: cannot set CPU affinity: " << std::strerror( r ) << std::endl;
+    }
+}
+
+int ThreadConfig::parsePolicy( std::string str ) {
+    if ( str == "other" )
+        return SCHED_OTHER;
+    if ( str == "fifo" )
+        return SCHED_FIFO;
+    if ( str == "rr" )
+        return SCHED_RR;
+    throw wibble::exception::BadOption( "invalid scheduling policy: " + str,
+            "parsing --sched" );
+}
+
+static void badCpus( std::string str ) {
+    throw wibble::exception::BadOption( "invalid CPU list: " + str, "parsing --cpus" );
+}
+
+std::vector< int > ThreadConfig::parseCpus( std::string str ) {
+    std::vector< int > cpus;
+    const char *p = str.c_str();
+    while ( *p ) {
+        char *end;
+        long from = std::strtol( p, &end, 10 );
+        if ( end == p || from < 0 || from >= CPU_SETSIZE )
+            badCpus( str );
+        long to = from;
+        p = end;
+        if ( *p == '-' ) {
+            to = std::strtol( p + 1, &end, 10 );
+            if ( end == p + 1 || to < from || to >= CPU_SETSIZE )
+                badCpus( str );
+            p = end;
+        }
+        for ( long i = from; i <= to; ++i )
+            cpus.push_back( i );
+        if ( *p != ',' && *p != 0 )
+            badCpus( str );
+        if ( *p == ',' )
+            ++p;
+    }
+    return cpus;
+}
+
+void lockMemory() {
+    if ( mlockall( MCL_CURRENT | MCL_FUTURE ) != 0 )
+        std::cerr << "WARNING: cannot lock memory: " << std::strerror( errno ) << std::endl;
+}
+
+void __attribute__(( noinline )) prefaultStack( size_t bytes ) {
+    volatile char *stack = static_cast< volatile char * >( alloca( bytes ) );
+    // one write per page is enough
+    static const size_t page = sysconf( _SC_PAGESIZE );
+    for ( size_t i = 0; i < bytes; i += page )
+        stack[ i ] = 0;
+}
+
+}
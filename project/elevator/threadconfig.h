@@ -0,0 +1,63 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+/* Scheduling configuration of threads
+ *
+ * Threads are divided into classes, each of which has its own scheduling
+ * policy, priority and CPU set. Configuration is set globally (from command
+ * line) before threads are started and threads spawned by restartWrapper
+ * apply configuration of their class when they start.
+ */
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <sched.h>
+
+#ifndef SRC_THREAD_CONFIG_H
+#define SRC_THREAD_CONFIG_H
+
+namespace elevator {
+
+enum class ThreadClass {
+    Control,   // elevator and scheduler loops
+    Network,   // sending and receiving threads
+    Background // everything else, never reconfigured
+};
+
+struct ThreadConfig {
+    static const size_t defaultStackPrefault = 256 * 1024;
+
+    ThreadConfig() : policy( SCHED_OTHER ), priority( 0 ), stackPrefault( 0 ) { }
+
+    int policy;         // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int priority;       // for SCHED_FIFO and SCHED_RR
+    std::vector< int > cpus; // empty means any
+    size_t stackPrefault; // bytes of stack to touch on start, 0 = none
+
+    bool isDefault() const {
+        return policy == SCHED_OTHER && cpus.empty() && stackPrefault == 0;
+    }
+
+    /* apply to calling thread, failures (such as missing privileges) are
+     * reported as warnings, thread continues with what was possible */
+    void apply() const;
+
+    static const ThreadConfig &get( ThreadClass );
+    /* must be called before threads of given class start */
+    static void set( ThreadClass, const ThreadConfig & );
+
+    /* parses "other", "fifo" or "rr", throws wibble::exception::BadOption */
+    static int parsePolicy( std::string );
+    /* parses list like "0,2-3", throws wibble::exception::BadOption */
+    static std::vector< int > parseCpus( std::string );
+};
+
+/* lock current and future pages of process to memory (not inherited by fork) */
+void lockMemory();
+
+/* touch given amount of stack of calling thread so that it is mapped */
+void prefaultStack( size_t bytes );
+
+}
+
+#endif // SRC_THREAD_CONFIG_H
@@ -0,0 +1,62 @@
+// C++11    (c) 2014 Vladimír Štill <xstill@fi.muni.cz>
+
+#include <wibble/commandline/core.h>
+
+#include <elevator/threadconfig.h>
+#include <elevator/restartwrapper.h>
+#include <elevator/test.h>
+#include <thread>
+#include <pthread.h>
+
+using namespace elevator;
+
+struct TestThreadConfig {
+    Test parseCpus() {
+        auto cpus = ThreadConfig::parseCpus( "0,2-4,7" );
+        assert_eq( cpus.size(), 5u, "" );
+        assert_eq( cpus[ 0 ], 0, "" );
+        assert_eq( cpus[ 1 ], 2, "" );
+        assert_eq( cpus[ 3 ], 4, "" );
+        assert_eq( cpus[ 4 ], 7, "" );
+        assert( ThreadConfig::parseCpus( "" ).empty(), "" );
+        for ( auto bad : { "x", "1-", "3-1", "1;2", "-1" } ) {
+            bool thrown = false;
+            try {
+                ThreadConfig::parseCpus( bad );
+            } catch ( wibble::exception::BadOption & ) {
+                thrown = true;
+            }
+            assert( thrown, "invalid CPU list accepted" );
+        }
+    }
+
+    Test parsePolicy() {
+        assert_eq( ThreadConfig::parsePolicy( "fifo" ), SCHED_FIFO, "" );
+        assert_eq( ThreadConfig::parsePolicy( "rr" ), SCHED_RR, "" );
+        assert_eq( ThreadConfig::parsePolicy( "other" ), SCHED_OTHER, "" );
+        bool thrown = false;
+        try {
+            ThreadConfig::parsePolicy( "deadline" );
+        } catch ( wibble::exception::BadOption & ) {
+            thrown = true;
+        }
+        assert( thrown, "invalid policy accepted" );
+    }
+
+    static void affinity( int *count ) {
+        cpu_set_t set;
+        pthread_getaffinity_np( pthread_self(), sizeof( set ), &set );
+        *count = CPU_COUNT( &set );
+    }
+
+    Test restartWrapperApplies() {
+        ThreadConfig config;
+        config.cpus = { 0 };
+        config.stackPrefault = ThreadConfig::defaultStackPrefault;
+        ThreadConfig::set( ThreadClass::Network, config );
+        int count = 0;
+        std::thread( restartWrapper( &affinity, ThreadClass::Network ), &count ).join();
+        ThreadConfig::set( ThreadClass::Network, ThreadConfig() );
+        assert_eq( count, 1, "" );
+    }
+};
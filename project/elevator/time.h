@@ -7,12 +7,26 @@
 namespace elevator {
 
 using MillisecondTime = int64_t;
+using MicrosecondTime = int64_t;
 
 static inline MillisecondTime now() {
     return std::chrono::duration_cast< std::chrono::milliseconds >(
             std::chrono::steady_clock::now().time_since_epoch() ).count();
 }
 
+/* finer clock for things which happen faster than a millisecond,
+ * such as round trip times in LAN */
+static inline MicrosecondTime nowMicro() {
+    return std::chrono::duration_cast< std::chrono::microseconds >(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/* wall clock, comparable (up to clock synchronization) between nodes */
+static inline MicrosecondTime wallMicro() {
+    return std::chrono::duration_cast< std::chrono::microseconds >(
+            std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
 static inline std::chrono::milliseconds toSystemTime( MillisecondTime mtime ) {
     return std::chrono::milliseconds( mtime );
 }
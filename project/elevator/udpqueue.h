@@ -17,7 +17,7 @@ struct QueueSender {
         _sock.enableBroadcast();
     }
     void run() {
-        _thr = std::thread( restartWrapper( &QueueSender::_runLocal ), this );
+        _thr = std::thread( restartWrapper( &QueueSender::_runLocal, ThreadClass::Network, "udp send" ), this );
     }
 
   private:
@@ -28,22 +28,30 @@ struct QueueSender {
     std::thread _thr;
 };
 
+/* Packets of other types and local feedback are dropped by kernel, so is
+ * everything not matching optional filter. Predicate is evaluated on
+ * deserialized data and it can also modify them.
+ */
 template< typename T >
 struct QueueReceiver {
-    QueueReceiver( udp::Address bindAddr, ConcurrentQueue< T > &queue ) :
-        _sock( bindAddr, true ), _queue( queue )
-    {
-        _sock.enableBroadcast();
-    }
+    QueueReceiver( udp::Address bindAddr, ConcurrentQueue< T > &queue,
+            udp::PacketFilter filter = udp::PacketFilter() ) :
+        QueueReceiver( bindAddr, queue, std::function< bool( T & ) >(), filter )
+    { }
 
     QueueReceiver( udp::Address bindAddr, ConcurrentQueue< T > &queue,
-            std::function< bool( T & ) > predicate ) :
+            std::function< bool( T & ) > predicate,
+            udp::PacketFilter filter = udp::PacketFilter() ) :
         _sock( bindAddr, true ), _queue( queue ), _pred( predicate )
     {
         _sock.enableBroadcast();
+        auto f = serialization::Serializer::typeFilter( T::type() );
+        if ( bindAddr.ip() != udp::IPv4Address::any )
+            f.rejectSource( bindAddr.ip() ); // local feedback
+        _sock.attachFilter( f.append( filter ) );
     }
     void run() {
-        _thr = std::thread( restartWrapper( &QueueReceiver::_runLocal ), this );
+        _thr = std::thread( restartWrapper( &QueueReceiver::_runLocal, ThreadClass::Network, "udp receive" ), this );
     }
 
   private:
@@ -68,10 +76,10 @@ template< typename T >
 void QueueReceiver< T >::_runLocal() {
     while ( true ) {
         auto pack = _sock.recvPacket();
-        if ( pack.address().ip() == _sock.localAddress().ip() )
-            continue; // ignore local feedback
         auto mx = serialization::Serializer::fromPacket< T >( pack );
-        assert( !mx.isNothing(), "Received invalid message" );
+        // malformed datagrams (or ones from incompatible version) are dropped
+        if ( mx.isNothing() )
+            continue;
         if ( !_pred || _pred( mx.value() ) )
             _queue.enqueue( mx.value() );
     }
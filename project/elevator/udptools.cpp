@@ -1,6 +1,7 @@
 // C++11 (c) 2014 Vladimír Štill
 
 #include <elevator/udptools.h>
+#include <elevator/capture.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -9,6 +10,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ifaddrs.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <netinet/udp.h>
 
 namespace udp {
 
@@ -44,6 +48,27 @@ std::set< IPv4Address > IPv4Address::getMachineAddresses() {
     return addresses;
 }
 
+std::set< uint64_t > IPv4Address::getHardwareAddresses() {
+    std::set< uint64_t > addresses;
+    struct ifaddrs *interfaces;
+    int rc = getifaddrs( &interfaces );
+    assert_eq( rc, 0, "getifaddrs failed" );
+    for ( struct ifaddrs *addr = interfaces; addr != NULL; addr = addr->ifa_next ) {
+        if ( !addr->ifa_addr || addr->ifa_addr->sa_family != AF_PACKET )
+            continue;
+        auto *ll = reinterpret_cast< sockaddr_ll * >( addr->ifa_addr );
+        if ( ll->sll_halen != 6 )
+            continue;
+        uint64_t mac = 0;
+        for ( int i = 0; i < 6; ++i )
+            mac = (mac << 8) | ll->sll_addr[ i ];
+        if ( mac != 0 ) // loopback
+            addresses.insert( mac );
+    }
+    freeifaddrs( interfaces );
+    return addresses;
+}
+
 struct Socket::_Data {
     _Data( Address local, bool reuseAddr, int rcvbufsize ) :
         localAddress( local ), rcvbufsize( rcvbufsize ), rcvbuf( new char[ rcvbufsize ] )
@@ -103,6 +128,8 @@ bool Socket::sendPacket( Packet &packet ) {
     sockaddr_in remote = getNetAddress( packet.address() );
     int snd = sendto( _data->fd, packet.data(), packet.size(), 0,
                 reinterpret_cast< struct sockaddr * >( &remote ), sizeof( sockaddr_in ) );
+    if ( snd == packet.size() )
+        elevator::Capture::recordActive( true, packet );
     return snd == packet.size();
 }
 
@@ -113,9 +140,11 @@ Packet Socket::recvPacket() {
     int rc = recvfrom( _data->fd, _data->rcvbuf.get(), _data->rcvbufsize,
             0, reinterpret_cast< struct sockaddr * >( &remote ), &remlen );
     assert_leq( remlen, sizeof( sockaddr_in ), "Invalid address returned" );
-    return rc > 0
-        ? Packet( _data->rcvbuf.get(), rc, fromNetAddress( remote ) )
-        : Packet();
+    if ( rc <= 0 )
+        return Packet();
+    Packet packet( _data->rcvbuf.get(), rc, fromNetAddress( remote ) );
+    elevator::Capture::recordActive( false, packet );
+    return packet;
 }
 
 Packet Socket::recvPacketWithTimeout( long ms ) {
@@ -142,4 +171,91 @@ void Socket::disableBroadcast() {
     setBroadcast( 0, _data->fd );
 }
 
+PacketFilter &PacketFilter::requireWord( int offset, std::vector< uint32_t > values ) {
+    assert_leq( 0, offset, "invalid offset" );
+    assert( !values.empty(), "at least one value is required" );
+    _clauses.push_back( Clause{ Kind::WordIn, offset, values } );
+    return *this;
+}
+
+PacketFilter &PacketFilter::rejectWord( int offset, uint32_t value ) {
+    assert_leq( 0, offset, "invalid offset" );
+    _clauses.push_back( Clause{ Kind::WordNotIn, offset, { value } } );
+    return *this;
+}
+
+PacketFilter &PacketFilter::rejectSource( IPv4Address addr ) {
+    _clauses.push_back( Clause{ Kind::SourceNotIn, 0, { addr.asInt() } } );
+    return *this;
+}
+
+PacketFilter &PacketFilter::append( const PacketFilter &other ) {
+    _clauses.insert( _clauses.end(), other._clauses.begin(), other._clauses.end() );
+    return *this;
+}
+
+/* layout of program is: clauses, accept, reject; each clause jumps to reject
+ * if it is not satisfied, jumps are relative to next instruction;
+ * kernel runs filter of UDP socket on packet starting with UDP header */
+std::vector< PacketFilter::Instruction > PacketFilter::compile() const {
+    std::vector< Instruction > prog;
+    std::vector< size_t > toReject; // instructions with jt/k to be patched
+
+    for ( auto &c : _clauses ) {
+        // BPF loads words in network byte order, payload is in host order,
+        // on the other hand IP address in IP header is in network order
+        // and IPv4Address::asInt is just its numeric value
+        bool ip = c.kind == Kind::SourceNotIn;
+        prog.push_back( Instruction{ BPF_LD | BPF_W | BPF_ABS, 0, 0,
+                ip ? uint32_t( SKF_NET_OFF + 12 ) : uint32_t( sizeof( udphdr ) + c.offset ) } );
+        int n = c.values.size();
+        for ( int i = 0; i < n; ++i ) {
+            uint32_t k = ip ? c.values[ i ] : ntohl( c.values[ i ] );
+            if ( c.kind == Kind::WordIn ) {
+                // on match skip rest of comparisons and final jump to reject
+                prog.push_back( Instruction{ BPF_JMP | BPF_JEQ | BPF_K,
+                        uint8_t( n - i ), 0, k } );
+            } else {
+                toReject.push_back( prog.size() );
+                prog.push_back( Instruction{ BPF_JMP | BPF_JEQ | BPF_K, 0, 0, k } );
+            }
+        }
+        if ( c.kind == Kind::WordIn ) {
+            toReject.push_back( prog.size() );
+            prog.push_back( Instruction{ BPF_JMP | BPF_JA, 0, 0, 0 } );
+        }
+    }
+    prog.push_back( Instruction{ BPF_RET | BPF_K, 0, 0, 0xffffffffu } ); // accept
+    size_t reject = prog.size();
+    prog.push_back( Instruction{ BPF_RET | BPF_K, 0, 0, 0 } );
+
+    for ( size_t i : toReject ) {
+        size_t dist = reject - i - 1;
+        if ( BPF_OP( prog[ i ].code ) == BPF_JA )
+            prog[ i ].k = dist;
+        else {
+            assert_leq( dist, 255u, "filter too long" );
+            prog[ i ].jt = dist;
+        }
+    }
+    return prog;
+}
+
+static_assert( sizeof( PacketFilter::Instruction ) == sizeof( sock_filter ),
+        "PacketFilter::Instruction must match sock_filter" );
+
+void Socket::attachFilter( const PacketFilter &filter ) {
+    auto prog = filter.compile();
+    sock_fprog fprog;
+    fprog.len = prog.size();
+    fprog.filter = reinterpret_cast< sock_filter * >( prog.data() );
+    int rc = setsockopt( _data->fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof( fprog ) );
+    assert_eq( 0, rc, "attaching socket filter failed" );
+}
+
+void Socket::detachFilter() {
+    int dummy = 0;
+    setsockopt( _data->fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof( dummy ) );
+}
+
 }
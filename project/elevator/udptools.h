@@ -5,6 +5,7 @@
 #include <memory>
 #include <tuple>
 #include <set>
+#include <vector>
 
 #include <elevator/test.h>
 
@@ -64,6 +65,8 @@ struct IPv4Address {
     static const IPv4Address broadcast;
 
     static std::set< IPv4Address > getMachineAddresses();
+    /** MAC addresses of (non-loopback) interfaces, as 48 bit numbers */
+    static std::set< uint64_t > getHardwareAddresses();
 
   private:
     uint32_t _addr;
@@ -178,6 +181,48 @@ struct Packet {
 
 enum { standardMTU = 1500 };
 
+/** kernel-side filter of received packets (compiled to classic BPF)
+ *
+ * Filter is conjunction of clauses, packet which does not satisfy all
+ * of them is dropped by kernel and never wakes up reader. Offsets are
+ * relative to beginning of UDP payload and words are compared in host byte
+ * order, that is as they were written by Packet::get< uint32_t >. Packet
+ * too short to contain compared word is dropped.
+ */
+struct PacketFilter {
+    /** word at offset must be equal to one of values */
+    PacketFilter &requireWord( int offset, std::vector< uint32_t > values );
+    PacketFilter &requireWord( int offset, uint32_t value ) {
+        return requireWord( offset, std::vector< uint32_t >{ value } );
+    }
+    /** word at offset must not be equal to value */
+    PacketFilter &rejectWord( int offset, uint32_t value );
+    /** source IP address must not be addr */
+    PacketFilter &rejectSource( IPv4Address addr );
+    /** add all clauses of other filter */
+    PacketFilter &append( const PacketFilter &other );
+
+    bool empty() const { return _clauses.empty(); }
+
+    /** BPF instruction, binary compatible with struct sock_filter */
+    struct Instruction {
+        uint16_t code;
+        uint8_t jt;
+        uint8_t jf;
+        uint32_t k;
+    };
+    std::vector< Instruction > compile() const;
+
+  private:
+    enum class Kind { WordIn, WordNotIn, SourceNotIn };
+    struct Clause {
+        Kind kind;
+        int offset;
+        std::vector< uint32_t > values;
+    };
+    std::vector< Clause > _clauses;
+};
+
 /** UDP socket (reader and writer) abstraction,
  * local address can be zero (or IP in address can be zero),
  * menaning all local addresses and arbitrary port
@@ -201,6 +246,11 @@ struct Socket {
     void enableBroadcast();
     void disableBroadcast();
 
+    /** replace kernel-side filter of received packets, see PacketFilter,
+     * note that packets which are already queued are not filtered */
+    void attachFilter( const PacketFilter & );
+    void detachFilter();
+
   private:
     /* separate private data to provide better abstraction and avoid
      * including messy linux headers with too much macros into our
@@ -30,7 +30,7 @@ struct TestUdp {
     }
 
     Test send() {
-        udp::Address target{ udp::IPv4Address::localhost, udp::Port{ 64123 } };
+        udp::Address target{ udp::IPv4Address::localhost, udp::Port( test::port( 64123 ) ) };
         udp::Packet packet{ "Test", 5 };
         packet.address() = target;
         udp::Socket sock{};
@@ -39,13 +39,13 @@ struct TestUdp {
     }
 
     Test timeout() {
-        udp::Socket sock{ udp::Address{ udp::IPv4Address::localhost, udp::Port{ 64123 } } };
+        udp::Socket sock{ udp::Address{ udp::IPv4Address::localhost, udp::Port( test::port( 64123 ) ) } };
         udp::Packet empty = sock.recvPacketWithTimeout( 300 );
         assert_eq( empty.size(), 0, "Packet should not be received" );
     }
 
     Test timeoutReset() {
-        udp::Socket sock{ udp::Address{ udp::IPv4Address::localhost, udp::Port{ 64123 } } };
+        udp::Socket sock{ udp::Address{ udp::IPv4Address::localhost, udp::Port( test::port( 64123 ) ) } };
         udp::Packet empty = sock.recvPacketWithTimeout( 300 );
 
         // setup SIGALRM handler
@@ -72,8 +72,8 @@ struct TestUdp {
     }
 
     Test sendRcv() {
-        udp::Address sndAddr{ udp::IPv4Address::localhost, udp::Port{ 64124 } };
-        udp::Address target{ udp::IPv4Address::localhost, udp::Port{ 64123 } };
+        udp::Address sndAddr{ udp::IPv4Address::localhost, udp::Port( test::port( 64124 ) ) };
+        udp::Address target{ udp::IPv4Address::localhost, udp::Port( test::port( 64123 ) ) };
 
         std::thread sender( [=]() {
                 usleep( 400000 );
@@ -107,4 +107,48 @@ struct TestUdp {
 
         sender.join();
     }
+
+    Test filter() {
+        udp::Address target{ udp::IPv4Address::localhost, udp::Port( test::port( 64125 ) ) };
+        udp::Socket recv{ target };
+        recv.attachFilter( udp::PacketFilter()
+                .requireWord( 0, { 42, 43 } )
+                .rejectWord( sizeof( int ), 7 ) );
+
+        udp::Socket sock{};
+        auto send = [&]( int a, int b ) {
+            udp::Packet packet{ 2 * sizeof( int ) };
+            packet.address() = target;
+            packet.get< int >() = a;
+            packet.get< int >( sizeof( int ) ) = b;
+            sock.sendPacket( packet );
+        };
+        send( 1, 1 );
+        send( 42, 7 );
+        send( 43, 8 );
+        udp::Packet tooShort{ "", 1, target };
+        sock.sendPacket( tooShort );
+        send( 42, 9 );
+
+        udp::Packet pck = recv.recvPacketWithTimeout( 300 );
+        assert_eq( pck.get< int >( sizeof( int ) ), 8, "wrong packet passed filter" );
+        pck = recv.recvPacketWithTimeout( 300 );
+        assert_eq( pck.get< int >( sizeof( int ) ), 9, "wrong packet passed filter" );
+        assert_eq( recv.recvPacketWithTimeout( 100 ).size(), 0, "nothing else should pass" );
+
+        recv.detachFilter();
+        send( 1, 1 );
+        assert_eq( recv.recvPacketWithTimeout( 300 ).size(), int( 2 * sizeof( int ) ),
+                "filter should be detached" );
+    }
+
+    Test filterSource() {
+        udp::Address target{ udp::IPv4Address::localhost, udp::Port( test::port( 64126 ) ) };
+        udp::Socket recv{ target };
+        recv.attachFilter( udp::PacketFilter().rejectSource( udp::IPv4Address::localhost ) );
+        udp::Packet packet{ "Test", 5, target };
+        udp::Socket sock{};
+        sock.sendPacket( packet );
+        assert_eq( recv.recvPacketWithTimeout( 300 ).size(), 0, "local packet should be dropped" );
+    }
 };
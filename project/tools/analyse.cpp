@@ -0,0 +1,309 @@
+#include <wibble/commandline/parser.h>
+
+#include <elevator/dispatchtrace.h>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <map>
+#include <climits>
+
+/* Offline analysis of dispatch trace (elevator --trace=<file> or replay
+ * --trace=<file>)
+ *
+ * Every dispatch is matched with the first served call of the same floor and
+ * direction which follows it, time between them is wait time of the call.
+ * Wait times are summarized, together with decisions in which the nearest
+ * elevator was not chosen and the penalty which made the difference.
+ *
+ * Penalties can be tuned by --weights: dispatches are decided again with
+ * penalties scaled by given factors. The outcome of alternative decision
+ * cannot be observed, so its wait is estimated from linear fit of measured
+ * wait times to cost of chosen elevator (decisions which do not change keep
+ * their measured wait).
+ */
+
+namespace elevator {
+
+using namespace wibble::commandline;
+
+using Candidate = DispatchTrace::Candidate;
+
+struct Dispatch {
+    MillisecondTime time;
+    ButtonType button;
+    int floor;
+    int chosen;
+    std::vector< Candidate > candidates;
+    MillisecondTime wait; // -1 if not served
+    int servedBy;
+};
+
+enum class Reason { None, Outdated, Stopped, Busy, Opposite, Last };
+
+static const char *showReason( Reason r ) {
+#define show( X ) case Reason::X: return #X
+    switch ( r ) {
+        show( None );
+        show( Outdated );
+        show( Stopped );
+        show( Busy );
+        show( Opposite );
+        show( Last );
+    }
+#undef show
+    return "<<unknown>>";
+}
+
+struct Weights {
+    double outdated = 1, stopped = 1, busy = 1, opposite = 1;
+
+    double cost( const Candidate &c ) const {
+        return c.distance + outdated * c.outdated + stopped * c.stopped
+            + busy * c.busy + opposite * c.opposite;
+    }
+};
+
+struct Analyse {
+    StandardParser opts;
+    StringOption *optWeights;
+    BoolOption *optCsv;
+    std::string path;
+    std::vector< Dispatch > dispatches;
+
+    Analyse( int argc, const char **argv ) : opts( "analyse", "1.0" ) {
+        optWeights = opts.add< StringOption >(
+                "weights", 'w', "weights", "<outdated>,<stopped>,<busy>,<opposite>",
+                "estimate outcome of scheduling with penalties scaled by given "
+                "factors (such as 1,1,0.5,2)" );
+        optCsv = opts.add< BoolOption >(
+                "csv", 0, "csv", "",
+                "print one CSV line per dispatch instead of summary" );
+        opts.usage = "<trace>";
+        opts.description = "Analyses scheduler decisions from dispatch trace against "
+                           "wait times of calls, for tuning of scheduler penalties.";
+
+        try {
+            opts.parse( argc, argv );
+        } catch ( wibble::exception::BadOption &ex ) {
+            std::cerr << "FATAL: " << ex.fullInfo() << std::endl;
+            exit( 1 );
+        }
+        if ( opts.help->boolValue() || opts.version->boolValue() )
+            exit( 0 );
+        if ( !opts.hasNext() ) {
+            std::cerr << "FATAL: trace file expected" << std::endl;
+            exit( 1 );
+        }
+        path = opts.next();
+    }
+
+    void load() {
+        // served calls by button and floor, (time, elevator)
+        std::map< std::pair< ButtonType, int >,
+                  std::vector< std::pair< MillisecondTime, int > > > served;
+
+        DispatchTraceReader reader( path );
+        while ( auto *r = reader.next() ) {
+            if ( r->kind == DispatchTrace::Kind::Served )
+                served[ { ButtonType( r->button ), r->floor } ].emplace_back( r->time, r->elevator );
+            else
+                dispatches.push_back( Dispatch{ r->time, ButtonType( r->button ), r->floor,
+                        r->elevator, std::vector< Candidate >( r->candidates(),
+                                r->candidates() + r->count ), -1, INT_MIN } );
+        }
+
+        // first served call after dispatch is its outcome (records are almost
+        // in order, scheduler and request check threads can race)
+        for ( auto &s : served )
+            std::sort( s.second.begin(), s.second.end() );
+        for ( auto &d : dispatches ) {
+            auto &calls = served[ { d.button, d.floor } ];
+            auto it = std::lower_bound( calls.begin(), calls.end(),
+                    std::make_pair( d.time, INT_MIN ) );
+            if ( it != calls.end() ) {
+                d.wait = it->first - d.time;
+                d.servedBy = it->second;
+            }
+        }
+    }
+
+    static const Candidate *find( const Dispatch &d, int id ) {
+        for ( auto &c : d.candidates )
+            if ( c.id == id )
+                return &c;
+        return nullptr;
+    }
+
+    /* alive candidate which is the nearest one (by distance only), ties are
+     * resolved in favour of chosen elevator */
+    static const Candidate *nearest( const Dispatch &d ) {
+        const Candidate *best = nullptr;
+        for ( auto &c : d.candidates )
+            if ( !c.dead && ( !best || c.distance < best->distance
+                        || ( c.distance == best->distance && c.id == d.chosen ) ) )
+                best = &c;
+        return best;
+    }
+
+    static int decide( const Dispatch &d, const Weights &w ) {
+        double min = 0;
+        int id = INT_MIN;
+        for ( auto &c : d.candidates )
+            if ( !c.dead && ( id == INT_MIN || w.cost( c ) < min ) ) {
+                min = w.cost( c );
+                id = c.id;
+            }
+        return id;
+    }
+
+    /* penalty which made nearest elevator lose to chosen one */
+    static Reason reason( const Dispatch &d ) {
+        const Candidate *chosen = find( d, d.chosen ), *near = nearest( d );
+        if ( !chosen || !near || near == chosen )
+            return Reason::None;
+        std::pair< int, Reason > diffs[] = {
+            { near->outdated - chosen->outdated, Reason::Outdated },
+            { near->stopped - chosen->stopped, Reason::Stopped },
+            { near->busy - chosen->busy, Reason::Busy },
+            { near->opposite - chosen->opposite, Reason::Opposite }
+        };
+        return std::max_element( std::begin( diffs ), std::end( diffs ) )->second;
+    }
+
+    static MillisecondTime percentile( std::vector< MillisecondTime > v, int p ) {
+        if ( v.empty() )
+            return -1;
+        std::sort( v.begin(), v.end() );
+        return v[ std::min( v.size() - 1, v.size() * p / 100 ) ];
+    }
+
+    static double mean( const std::vector< MillisecondTime > &v ) {
+        double sum = 0;
+        for ( auto x : v )
+            sum += x;
+        return v.empty() ? 0 : sum / v.size();
+    }
+
+    void printWaits( std::string name, const std::vector< MillisecondTime > &waits ) {
+        std::cout << name << ": " << waits.size() << " calls, wait mean " << mean( waits )
+                  << " ms, p50 " << percentile( waits, 50 ) << " ms, p90 "
+                  << percentile( waits, 90 ) << " ms, max " << percentile( waits, 100 )
+                  << " ms" << std::endl;
+    }
+
+    int csv() {
+        std::cout << "time,button,floor,candidates,chosen,chosen_cost,chosen_age_ms,"
+                     "runner_up,runner_up_cost,nearest,reason,served_by,wait_ms" << std::endl;
+        for ( auto &d : dispatches ) {
+            const Candidate *chosen = find( d, d.chosen ), *runnerUp = nullptr, *near = nearest( d );
+            for ( auto &c : d.candidates )
+                if ( !c.dead && &c != chosen && ( !runnerUp || c.cost() < runnerUp->cost() ) )
+                    runnerUp = &c;
+            std::cout << d.time << "," << ( d.button == ButtonType::CallUp ? "up" : "down" )
+                      << "," << d.floor << "," << d.candidates.size() << "," << d.chosen << ","
+                      << ( chosen ? chosen->cost() : -1 ) << "," << ( chosen ? chosen->age : -1 )
+                      << "," << ( runnerUp ? runnerUp->id : -1 ) << ","
+                      << ( runnerUp ? runnerUp->cost() : -1 ) << "," << ( near ? near->id : -1 )
+                      << "," << showReason( reason( d ) ) << "," << d.servedBy << "," << d.wait
+                      << std::endl;
+        }
+        return 0;
+    }
+
+    int summary() {
+        std::vector< MillisecondTime > all, nearestChosen, nearestSkipped;
+        std::vector< std::vector< MillisecondTime > > byReason( int( Reason::Last ) );
+        long unserved = 0, servedByOther = 0;
+        for ( auto &d : dispatches ) {
+            if ( d.wait < 0 ) {
+                ++unserved;
+                continue;
+            }
+            servedByOther += d.servedBy != d.chosen;
+            all.push_back( d.wait );
+            Reason r = reason( d );
+            ( r == Reason::None ? nearestChosen : nearestSkipped ).push_back( d.wait );
+            byReason[ int( r ) ].push_back( d.wait );
+        }
+        std::cout << "dispatches: " << dispatches.size() << ", not served: " << unserved
+                  << ", served by other than chosen elevator: " << servedByOther << std::endl;
+        printWaits( "all", all );
+        printWaits( "nearest chosen", nearestChosen );
+        printWaits( "nearest not chosen", nearestSkipped );
+        for ( int r = int( Reason::Outdated ); r < int( Reason::Last ); ++r )
+            if ( !byReason[ r ].empty() )
+                printWaits( std::string( "    because of " ) + showReason( Reason( r ) ),
+                        byReason[ r ] );
+        return 0;
+    }
+
+    /* least squares fit of wait = a + b * cost over dispatches served by
+     * chosen elevator */
+    std::pair< double, double > fit() {
+        double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for ( auto &d : dispatches ) {
+            const Candidate *c = find( d, d.chosen );
+            if ( d.wait < 0 || d.servedBy != d.chosen || !c )
+                continue;
+            double x = c->cost(), y = d.wait;
+            n += 1; sx += x; sy += y; sxx += x * x; sxy += x * y;
+        }
+        if ( n == 0 )
+            return { 0, 0 };
+        double den = n * sxx - sx * sx;
+        double b = den == 0 ? 0 : ( n * sxy - sx * sy ) / den;
+        return { ( sy - b * sx ) / n, b };
+    }
+
+    int whatIf( std::string spec ) {
+        Weights w;
+        char sep;
+        std::istringstream in( spec );
+        in >> w.outdated >> sep >> w.stopped >> sep >> w.busy >> sep >> w.opposite;
+        if ( !in ) {
+            std::cerr << "FATAL: --weights expects four comma separated numbers" << std::endl;
+            return 1;
+        }
+        auto model = fit();
+        std::cout << "wait model: " << model.first << " ms + " << model.second
+                  << " ms per cost unit" << std::endl;
+
+        std::vector< MillisecondTime > measured, estimated;
+        long changed = 0;
+        for ( auto &d : dispatches ) {
+            if ( d.wait < 0 )
+                continue;
+            measured.push_back( d.wait );
+            int id = decide( d, w );
+            if ( id == d.chosen ) {
+                estimated.push_back( d.wait );
+                continue;
+            }
+            ++changed;
+            estimated.push_back( model.first + model.second * find( d, id )->cost() );
+        }
+        std::cout << "decisions changed: " << changed << " of " << measured.size() << std::endl;
+        printWaits( "measured", measured );
+        printWaits( "estimated", estimated );
+        return 0;
+    }
+
+    int main() {
+        load();
+        if ( optCsv->boolValue() )
+            return csv();
+        summary();
+        if ( optWeights->isSet() )
+            return whatIf( optWeights->stringValue() );
+        return 0;
+    }
+};
+
+}
+
+int main( int argc, const char **argv ) {
+    return elevator::Analyse( argc, argv ).main();
+}
@@ -0,0 +1,325 @@
+#include <wibble/commandline/parser.h>
+
+#include <elevator/concurrentqueue.h>
+#include <elevator/serialization.h>
+#include <elevator/scheduler.h>
+#include <elevator/requestqueue.h>
+#include <elevator/globalstate.h>
+#include <elevator/floorset.h>
+#include <elevator/latency.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+
+/* Microbenchmarks of hot parts of elevator
+ *
+ * Every benchmark is run once for warmup and then given number of samples,
+ * result is one line per benchmark and parameter with median and minimum
+ * time per operation (in nanoseconds). Output is CSV (default) or JSON lines,
+ * so results from different commits can be compared by scripts.
+ */
+
+namespace elevator {
+
+using Clock = std::chrono::steady_clock;
+
+static int64_t nanoTime() {
+    return std::chrono::duration_cast< std::chrono::nanoseconds >(
+            Clock::now().time_since_epoch() ).count();
+}
+
+// results are accumulated here so that compiler cannot optimize benchmarks out
+static volatile int64_t sink;
+
+// compiler must assume memory was changed, so work on it cannot be hoisted out of loop
+static inline void clobber() { asm volatile( "" : : : "memory" ); }
+
+struct Result {
+    std::string name;
+    int param;
+    int64_t operations; // per sample
+    double median;      // ns per operation
+    double min;
+    int64_t p50, p99;   // latency percentiles in ns, -1 if not measured
+};
+
+using namespace wibble::commandline;
+
+struct Bench {
+    StandardParser opts;
+    StringOption *optFilter;
+    IntOption *optSamples;
+    BoolOption *optJson;
+    int samples = 5;
+
+    Bench( int argc, const char **argv ) : opts( "bench", "1.0" ) {
+        optFilter = opts.add< StringOption >(
+                "filter", 'f', "filter", "<substring>",
+                "run only benchmarks whose name contains given string" );
+        optSamples = opts.add< IntOption >(
+                "samples", 's', "samples", "<n>",
+                "number of measured runs of each benchmark (default: 5)" );
+        optJson = opts.add< BoolOption >(
+                "json", 0, "json", "",
+                "print one JSON object per line instead of CSV" );
+        opts.usage = "";
+        opts.description = "Microbenchmarks of elevator queues, serialization, "
+                           "scheduler and floor sets.";
+
+        try {
+            opts.parse( argc, argv );
+        } catch ( wibble::exception::BadOption &ex ) {
+            std::cerr << "FATAL: " << ex.fullInfo() << std::endl;
+            exit( 1 );
+        }
+        if ( opts.help->boolValue() || opts.version->boolValue() )
+            exit( 0 );
+        if ( optSamples->boolValue() )
+            samples = std::max( 1, optSamples->intValue() );
+    }
+
+    bool enabled( std::string name ) {
+        return !optFilter->boolValue()
+            || name.find( optFilter->stringValue() ) != std::string::npos;
+    }
+
+    void header() {
+        if ( !optJson->boolValue() )
+            std::cout << "benchmark,param,operations,median_ns,min_ns,p50_ns,p99_ns" << std::endl;
+    }
+
+    void print( const Result &r ) {
+        if ( optJson->boolValue() )
+            std::cout << "{ \"benchmark\": \"" << r.name << "\", \"param\": " << r.param
+                      << ", \"operations\": " << r.operations
+                      << ", \"median_ns\": " << r.median << ", \"min_ns\": " << r.min
+                      << ", \"p50_ns\": " << r.p50 << ", \"p99_ns\": " << r.p99 << " }"
+                      << std::endl;
+        else
+            std::cout << r.name << "," << r.param << "," << r.operations << ","
+                      << r.median << "," << r.min << "," << r.p50 << "," << r.p99 << std::endl;
+    }
+
+    /* run sample( operations ) warmup + samples times, sample returns
+     * duration in nanoseconds; histogram (if any) is reset after warmup */
+    template< typename Sample >
+    void measure( std::string name, int param, int64_t operations, Sample sample,
+            Histogram *latency = nullptr )
+    {
+        if ( !enabled( name ) )
+            return;
+        sample( operations );
+        if ( latency )
+            latency->reset();
+        std::vector< double > perOp;
+        for ( int i = 0; i < samples; ++i )
+            perOp.push_back( double( sample( operations ) ) / operations );
+        std::sort( perOp.begin(), perOp.end() );
+        print( Result{ name, param, operations, perOp[ perOp.size() / 2 ], perOp[ 0 ],
+                latency ? latency->percentile( 50 ) : -1,
+                latency ? latency->percentile( 99 ) : -1 } );
+    }
+
+    /* producers enqueue timestamps, single consumer dequeues them and
+     * records queueing latency (producers run flat out, so latency is the
+     * one of saturated queue) */
+    void concurrentQueue() {
+        for ( int producers : { 1, 2, 4, 8 } ) {
+            Histogram latency;
+            measure( "queue", producers, 200000, [&]( int64_t ops ) {
+                    ConcurrentQueue< int64_t > queue;
+                    int64_t start = nanoTime();
+                    std::vector< std::thread > threads;
+                    for ( int i = 0; i < producers; ++i )
+                        threads.emplace_back( [&queue, ops, producers, i]() {
+                                for ( int64_t j = i; j < ops; j += producers )
+                                    queue.enqueue( nanoTime() );
+                            } );
+                    for ( int64_t j = 0; j < ops; ++j )
+                        latency.record( nanoTime() - queue.dequeue() );
+                    for ( auto &t : threads )
+                        t.join();
+                    return nanoTime() - start;
+                }, &latency );
+        }
+    }
+
+    void serialization() {
+        StateChange change;
+        change.changeType = ChangeType::ButtonUpPressed;
+        change.changeFloor = 2;
+        change.state.id = 42;
+        change.state.lastFloor = 1;
+        change.state.direction = Direction::Up;
+        change.created = wallMicro();
+        Command command( CommandType::CallToFloorAndGoUp, 42, 3, wallMicro() );
+
+        auto changePacket = serialization::Serializer::toPacket( change );
+        auto commandPacket = serialization::Serializer::toPacket( command );
+
+        measure( "serialize/StateChange/toPacket", 0, 100000, [&]( int64_t ops ) {
+                int64_t start = nanoTime();
+                for ( int64_t i = 0; i < ops; ++i )
+                    sink = serialization::Serializer::toPacket( change ).size();
+                return nanoTime() - start;
+            } );
+        measure( "serialize/StateChange/fromPacket", 0, 100000, [&]( int64_t ops ) {
+                int64_t start = nanoTime();
+                for ( int64_t i = 0; i < ops; ++i ) {
+                    clobber();
+                    sink = serialization::Serializer::fromPacket< StateChange >( changePacket )
+                        .value().changeFloor;
+                }
+                return nanoTime() - start;
+            } );
+        measure( "serialize/Command/toPacket", 0, 100000, [&]( int64_t ops ) {
+                int64_t start = nanoTime();
+                for ( int64_t i = 0; i < ops; ++i )
+                    sink = serialization::Serializer::toPacket( command ).size();
+                return nanoTime() - start;
+            } );
+        measure( "serialize/Command/fromPacket", 0, 100000, [&]( int64_t ops ) {
+                int64_t start = nanoTime();
+                for ( int64_t i = 0; i < ops; ++i ) {
+                    clobber();
+                    sink = serialization::Serializer::fromPacket< Command >( commandPacket )
+                        .value().targetFloor;
+                }
+                return nanoTime() - start;
+            } );
+    }
+
+    void scheduler() {
+        BasicDriverInfo info( 0, 3 );
+        for ( int elevators : { 2, 4, 8, 16, 32, 64 } ) {
+            GlobalState global;
+            ConcurrentQueue< StateChange > stateIn, stateOut;
+            ConcurrentQueue< Command > toRemote, toLocal;
+            Scheduler scheduler( 0, info, global, stateIn, stateOut, toRemote, toLocal );
+
+            // timestamps must be fresh, otherwise elevators are
+            // considered dead and skipped
+            auto fill = [&]() {
+                for ( int i = 0; i < elevators; ++i ) {
+                    ElevatorState state;
+                    state.id = i;
+                    state.timestamp = now();
+                    state.lastFloor = i % 4;
+                    state.direction = Direction( i % 3 );
+                    global.update( state );
+                }
+            };
+            auto dispatch = [&]( Scheduler &sched, int64_t ops ) {
+                int64_t start = nanoTime();
+                for ( int64_t i = 0; i < ops; ++i )
+                    sink = sched.optimalElevator(
+                            i & 1 ? ButtonType::CallUp : ButtonType::CallDown, i % 3 );
+                return nanoTime() - start;
+            };
+
+            measure( "scheduler/optimalElevator", elevators, 20000, [&]( int64_t ops ) {
+                    fill();
+                    return dispatch( scheduler, ops );
+                } );
+            // fresh trace for every sample, so that it never fills up
+            measure( "scheduler/optimalElevator/traced", elevators, 20000, [&]( int64_t ops ) {
+                    fill();
+                    std::string path = "bench-trace." + std::to_string( getpid() );
+                    int64_t time;
+                    {
+                        DispatchTrace trace( path, ops * ( sizeof( DispatchTrace::Record )
+                                    + elevators * sizeof( DispatchTrace::Candidate ) ) + 4096 );
+                        Scheduler traced( 0, info, global, stateIn, stateOut, toRemote, toLocal );
+                        traced.traceTo( trace );
+                        time = dispatch( traced, ops );
+                    }
+                    unlink( path.c_str() );
+                    return time;
+                } );
+        }
+    }
+
+    /* push requests, acknowledge them twice (accepted and served) and let
+     * queue clean them up; cost is per request */
+    void requestQueue() {
+        for ( int pending : { 1, 16, 128 } ) {
+            measure( "requestqueue/push-ack-clean", pending, 128 * 100, [&]( int64_t ops ) {
+                    RequestQueue queue;
+                    int64_t start = nanoTime();
+                    for ( int64_t done = 0; done < ops; done += pending ) {
+                        for ( int i = 0; i < pending; ++i )
+                            queue.push( Request( Command( CommandType::CallToFloorAndGoUp,
+                                            i, i % 4 ), 1000 ) );
+                        for ( int i = 0; i < pending; ++i ) {
+                            StateChange change;
+                            change.state.id = i;
+                            change.changeFloor = i % 4;
+                            change.changeType = ChangeType::GoingToServeUp;
+                            queue.ackRequest( change );
+                            change.changeType = ChangeType::ServedUp;
+                            queue.ackRequest( change );
+                        }
+                        sink = queue.waitForEarliestDeadline( 0 ).isNothing();
+                    }
+                    return nanoTime() - start;
+                } );
+        }
+
+        measure( "requestqueue/push-wait", 0, 100000, [&]( int64_t ops ) {
+                RequestQueue queue;
+                int64_t start = nanoTime();
+                for ( int64_t i = 0; i < ops; ++i ) {
+                    queue.push( Request( Command( CommandType::CallToFloorAndGoUp, 1, 2 ), 0 ) );
+                    sink = queue.waitForEarliestDeadline( 0 ).value().command.targetFloor;
+                }
+                return nanoTime() - start;
+            } );
+    }
+
+    void floorSet() {
+        BasicDriverInfo info( 0, 3 );
+        measure( "floorset/set-get", 0, 1000000, [&]( int64_t ops ) {
+                FloorSet set;
+                int64_t start = nanoTime();
+                for ( int64_t i = 0; i < ops; ++i ) {
+                    int floor = i & 3;
+                    set.set( !set.get( floor, info ), floor, info );
+                }
+                sink = set.hasAny();
+                return nanoTime() - start;
+            } );
+        measure( "floorset/any", 0, 1000000, [&]( int64_t ops ) {
+                FloorSet set;
+                set.set( true, 1, info );
+                int64_t count = 0, start = nanoTime();
+                for ( int64_t i = 0; i < ops; ++i ) {
+                    int floor = i & 3;
+                    count += set.anyHigher( floor, info ) + set.anyLower( floor, info )
+                        + set.anyOther( floor, info );
+                }
+                sink = count;
+                return nanoTime() - start;
+            } );
+    }
+
+    int main() {
+        header();
+        concurrentQueue();
+        serialization();
+        scheduler();
+        requestQueue();
+        floorSet();
+        return 0;
+    }
+};
+
+}
+
+int main( int argc, const char **argv ) {
+    return elevator::Bench( argc, argv ).main();
+}
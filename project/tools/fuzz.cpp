@@ -0,0 +1,365 @@
+#include <wibble/commandline/parser.h>
+
+#include <elevator/serialization.h>
+#include <elevator/command.h>
+#include <elevator/state.h>
+#include <elevator/reliability.h>
+#include <elevator/checkpoint.h>
+#include <elevator/journal.h>
+#include <elevator/sessionprotocol.h>
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+/* Fuzz target of packet decoding
+ *
+ * Every input is taken as received datagram. It is decoded the way receivers
+ * do it (dispatch on packetType), then its type signature is rewritten to
+ * each of the types which have one, so that every decoder sees the same
+ * bytes. Successfully decoded value must survive encoding and decoding
+ * again. Decoding must never throw, crash nor read outside of packet.
+ *
+ * Decoders are header-only templates, so they are compiled (and
+ * instrumented) as part of this file. With -DFUZZ_LIBFUZZER=ON (needs clang)
+ * this is libFuzzer target with address sanitizer, otherwise standalone
+ * program which can seed corpus, decode files (afl-fuzz ... -- fuzz @@), run
+ * its own simple mutation fuzzing or measure decode throughput.
+ */
+
+namespace elevator {
+
+using namespace serialization;
+
+template< typename T >
+static int decodeAs( udp::Packet &packet ) {
+    if ( packet.size() >= int( sizeof( TypeSignature ) ) )
+        packet.get< TypeSignature >( Serializer::typeOffset() ) = T::type();
+    auto value = Serializer::fromPacket< T >( packet );
+    if ( value.isNothing() )
+        return 0;
+    auto again = Serializer::fromPacket< T >( Serializer::toPacket( value.value() ) );
+    assert( !again.isNothing(), "re-encoded value rejected" );
+    return 1;
+}
+
+/* decoding as done by receivers, returns whether packet was accepted */
+static bool decodeReceived( const udp::Packet &packet ) {
+    switch ( Serializer::packetType( packet ) ) {
+        case TypeSignature::ElevatorCommand:
+            return !Serializer::fromPacket< Command >( packet ).isNothing();
+        case TypeSignature::ElevatorState:
+            return !Serializer::fromPacket< StateChange >( packet ).isNothing();
+        case TypeSignature::InitialPacket:
+            return !Serializer::fromPacket< session::Initial >( packet ).isNothing();
+        case TypeSignature::ElevatorReady:
+            return !Serializer::fromPacket< session::Ready >( packet ).isNothing();
+        case TypeSignature::RecoveryState:
+            return !Serializer::fromPacket< session::RecoveryState >( packet ).isNothing();
+        case TypeSignature::RecoveryPeers:
+            return !Serializer::fromPacket< session::RecoveryPeers >( packet ).isNothing();
+        case TypeSignature::ReliableData:
+            return !Serializer::fromPacket< reliable::DataFrame< Command > >( packet ).isNothing();
+        case TypeSignature::ReliableAck:
+            return !Serializer::fromPacket< reliable::AckFrame >( packet ).isNothing();
+        case TypeSignature::ElevatorLeave:
+            return !Serializer::fromPacket< session::Leave >( packet ).isNothing();
+        case TypeSignature::ElevatorAlive:
+            return !Serializer::fromPacket< session::Alive >( packet ).isNothing();
+        default:
+            return false;
+    }
+}
+
+/* decode packet as every type, returns number of types which accepted it */
+static int decodeEvery( const udp::Packet &original ) {
+    udp::Packet packet{ original.cdata(), original.size() };
+    return decodeAs< Command >( packet )
+        + decodeAs< StateChange >( packet )
+        + decodeAs< session::Initial >( packet )
+        + decodeAs< session::Ready >( packet )
+        + decodeAs< session::Leave >( packet )
+        + decodeAs< session::Alive >( packet )
+        + decodeAs< session::RecoveryPeers >( packet )
+        + decodeAs< session::RecoveryState >( packet )
+        + decodeAs< reliable::DataFrame< Command > >( packet )
+        + decodeAs< reliable::AckFrame >( packet )
+        + decodeAs< Checkpoint >( packet )
+        + decodeAs< RequestEvent >( packet );
+}
+
+static void fuzzOne( const uint8_t *data, size_t size ) {
+    if ( size == 0 || size > udp::standardMTU * 64 )
+        return;
+    udp::Packet packet{ reinterpret_cast< const char * >( data ), int( size ) };
+    decodeReceived( packet );
+    decodeEvery( packet );
+}
+
+}
+
+#ifdef O_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput( const uint8_t *data, size_t size ) {
+    elevator::fuzzOne( data, size );
+    return 0;
+}
+
+#else
+
+namespace elevator {
+
+using Clock = std::chrono::steady_clock;
+using Bytes = std::vector< uint8_t >;
+
+static Bytes bytes( const udp::Packet &packet ) {
+    return Bytes( packet.cdata(), packet.cdata() + packet.size() );
+}
+
+static ElevatorState sampleState( int id ) {
+    BasicDriverInfo info( 0, 3 );
+    ElevatorState state;
+    state.id = id;
+    state.timestamp = 1000 + id;
+    state.lastFloor = 1;
+    state.direction = Direction::Up;
+    state.stopped = false;
+    state.doorOpen = false;
+    state.insideButtons.set( true, 3, info );
+    state.upButtons.set( true, 1, info );
+    state.downButtons.set( true, 2, info );
+    return state;
+}
+
+/* real packets of every type which is received from network */
+static std::vector< std::pair< std::string, Bytes > > seeds() {
+    Command command( CommandType::CallToFloorAndGoUp, 2, 3, 123456 );
+    StateChange change;
+    change.changeType = ChangeType::ButtonUpPressed;
+    change.changeFloor = 1;
+    change.state = sampleState( 1 );
+    change.created = 123456;
+    std::vector< session::Peer > peers{ { 1, udp::IPv4Address( 10, 0, 0, 1 ) },
+                                        { 2, udp::IPv4Address( 10, 0, 0, 2 ) },
+                                        { 3, udp::IPv4Address( 10, 0, 0, 3 ) } };
+
+    return {
+        { "statechange", bytes( Serializer::toPacket( change ) ) },
+        { "command", bytes( Serializer::toPacket( command ) ) },
+        { "recoverystate", bytes( Serializer::toPacket( session::RecoveryState( sampleState( 2 ), peers ) ) ) },
+        { "recoverypeers", bytes( Serializer::toPacket( session::RecoveryPeers( peers ) ) ) },
+        { "initial", bytes( Serializer::toPacket( session::Initial( 1, false ) ) ) },
+        { "ready", bytes( Serializer::toPacket( session::Ready( 2, true ) ) ) },
+        { "leave", bytes( Serializer::toPacket( session::Leave( 3 ) ) ) },
+        { "alive", bytes( Serializer::toPacket( session::Alive( 1 ) ) ) },
+        { "reliabledata", bytes( Serializer::toPacket( reliable::DataFrame< Command >(
+                            1, 2, 77, 5, 3, command ) ) ) },
+        { "reliableack", bytes( Serializer::toPacket( reliable::AckFrame( 2, 1, 77, 5, 0x5 ) ) ) },
+        { "checkpoint", bytes( Serializer::toPacket( Checkpoint( sampleState( 1 ),
+                            std::vector< Command >{ command, command } ) ) ) },
+        { "requestevent", bytes( Serializer::toPacket( RequestEvent( true, command ) ) ) },
+    };
+}
+
+/* simple mutations, biased towards header and counts which is where
+ * decoders have to be careful */
+struct Mutator {
+    explicit Mutator( unsigned seed ) : _rand( seed ) { }
+
+    Bytes operator()( const std::vector< std::pair< std::string, Bytes > > &corpus ) {
+        Bytes input = corpus[ _pick( corpus.size() ) ].second;
+        for ( int i = 0, n = 1 + _pick( 4 ); i < n; ++i )
+            _mutate( input, corpus );
+        return input;
+    }
+
+  private:
+    std::mt19937 _rand;
+
+    size_t _pick( size_t n ) { return n ? _rand() % n : 0; }
+
+    template< typename T >
+    void _store( Bytes &input, size_t at, T value ) {
+        if ( at + sizeof( T ) <= input.size() )
+            std::memcpy( &input[ at ], &value, sizeof( T ) );
+    }
+
+    void _mutate( Bytes &input, const std::vector< std::pair< std::string, Bytes > > &corpus ) {
+        static const long interesting[] = { 0, 1, -1, 2, 255, 65535, INT_MAX, INT_MIN,
+                                            1L << 31, 1L << 40, LONG_MAX, LONG_MIN };
+        long value = interesting[ _pick( sizeof( interesting ) / sizeof( long ) ) ];
+        size_t at = _pick( input.size() );
+        switch ( _pick( 8 ) ) {
+            case 0: // bit flip
+                if ( !input.empty() )
+                    input[ at ] ^= 1 << _pick( 8 );
+                break;
+            case 1:
+                if ( !input.empty() )
+                    input[ at ] = _rand();
+                break;
+            case 2:
+                _store( input, at & ~size_t( 3 ), int( value ) );
+                break;
+            case 3:
+                _store( input, at, value );
+                break;
+            case 4: // header size field
+                _store( input, Serializer::sizeOffset(), int( value ) + int( _pick( 9 ) ) - 4 );
+                break;
+            case 5:
+                input.resize( at );
+                break;
+            case 6:
+                for ( size_t i = 0, n = 1 + _pick( 32 ); i < n; ++i )
+                    input.push_back( _rand() );
+                break;
+            case 7: { // splice tail of other seed
+                const Bytes &other = corpus[ _pick( corpus.size() ) ].second;
+                size_t from = _pick( other.size() );
+                input.resize( at );
+                input.insert( input.end(), other.begin() + from, other.end() );
+                break; }
+        }
+    }
+};
+
+using namespace wibble::commandline;
+
+struct Fuzz {
+    StandardParser opts;
+    StringOption *optCorpus;
+    IntOption *optIterations;
+    IntOption *optSeed;
+    IntOption *optThroughput;
+
+    Fuzz( int argc, const char **argv ) : opts( "fuzz", "1.0" ) {
+        optCorpus = opts.add< StringOption >(
+                "write-corpus", 0, "write-corpus", "<dir>",
+                "write seed corpus (real packets of every type) to directory and exit" );
+        optIterations = opts.add< IntOption >(
+                "iterations", 'i', "iterations", "<n>",
+                "number of inputs for built-in mutation fuzzing (default: 100000)" );
+        optSeed = opts.add< IntOption >(
+                "seed", 's', "seed", "<n>",
+                "random seed of built-in mutation fuzzing (default: 1)" );
+        optThroughput = opts.add< IntOption >(
+                "throughput", 't', "throughput", "<seconds>",
+                "measure decode throughput of valid and mutated packets" );
+        opts.usage = "[<file>...]";
+        opts.description = "Fuzz target of packet decoding. Given files are decoded "
+                           "once each (use as 'afl-fuzz -i <corpus> -o <out> -- fuzz @@'), "
+                           "without files built-in mutation fuzzing of seed packets is run.";
+
+        try {
+            opts.parse( argc, argv );
+        } catch ( wibble::exception::BadOption &ex ) {
+            std::cerr << "FATAL: " << ex.fullInfo() << std::endl;
+            exit( 1 );
+        }
+        if ( opts.help->boolValue() || opts.version->boolValue() )
+            exit( 0 );
+    }
+
+    int writeCorpus( std::string dir ) {
+        for ( auto &s : seeds() ) {
+            std::string path = dir + "/" + s.first;
+            std::ofstream out( path.c_str(), std::ios::binary );
+            out.write( reinterpret_cast< const char * >( s.second.data() ), s.second.size() );
+            if ( !out ) {
+                std::cerr << "FATAL: cannot write " << path << std::endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    int files() {
+        while ( opts.hasNext() ) {
+            std::ifstream in( opts.next().c_str(), std::ios::binary );
+            Bytes input{ std::istreambuf_iterator< char >( in ), std::istreambuf_iterator< char >() };
+            fuzzOne( input.data(), input.size() );
+        }
+        return 0;
+    }
+
+    int mutate() {
+        long iterations = optIterations->isSet() ? optIterations->intValue() : 100000;
+        Mutator mutator( optSeed->isSet() ? optSeed->intValue() : 1 );
+        auto corpus = seeds();
+        long accepted = 0;
+        for ( long i = 0; i < iterations; ++i ) {
+            Bytes input = mutator( corpus );
+            try {
+                if ( !input.empty() ) {
+                    udp::Packet packet{ reinterpret_cast< const char * >( input.data() ), int( input.size() ) };
+                    accepted += decodeReceived( packet );
+                    decodeEvery( packet );
+                }
+            } catch ( std::exception &ex ) {
+                std::string path = "crash-" + std::to_string( i );
+                std::ofstream out( path.c_str(), std::ios::binary );
+                out.write( reinterpret_cast< const char * >( input.data() ), input.size() );
+                std::cerr << "CRASH: " << ex.what() << " (input written to " << path << ")" << std::endl;
+                return 1;
+            }
+        }
+        std::cout << iterations << " inputs, " << accepted << " accepted by receivers" << std::endl;
+        return 0;
+    }
+
+    /* decode benchmark: receiver path over valid seeds and mutated packets */
+    int throughput( int seconds ) {
+        auto corpus = seeds();
+        Mutator mutator( 1 );
+        std::vector< udp::Packet > valid, mutated;
+        for ( auto &s : corpus )
+            valid.emplace_back( reinterpret_cast< const char * >( s.second.data() ), s.second.size() );
+        while ( mutated.size() < 4096 ) {
+            Bytes input = mutator( corpus );
+            if ( !input.empty() )
+                mutated.emplace_back( reinterpret_cast< const char * >( input.data() ), input.size() );
+        }
+
+        std::cout << "input,packets,ns_per_packet,accepted_percent" << std::endl;
+        for ( auto *set : { &valid, &mutated } ) {
+            long packets = 0, accepted = 0;
+            auto start = Clock::now(), end = start + std::chrono::seconds( seconds ) / 2;
+            while ( Clock::now() < end )
+                for ( int round = 0; round < 16; ++round )
+                    for ( auto &p : *set ) {
+                        accepted += decodeReceived( p );
+                        ++packets;
+                    }
+            double ns = std::chrono::duration_cast< std::chrono::nanoseconds >(
+                    Clock::now() - start ).count();
+            std::cout << ( set == &valid ? "valid" : "mutated" ) << "," << packets << ","
+                      << ns / packets << "," << 100.0 * accepted / packets << std::endl;
+        }
+        return 0;
+    }
+
+    int main() {
+        if ( optCorpus->boolValue() )
+            return writeCorpus( optCorpus->stringValue() );
+        if ( optThroughput->boolValue() )
+            return throughput( std::max( 1, optThroughput->intValue() ) );
+        if ( opts.hasNext() )
+            return files();
+        return mutate();
+    }
+};
+
+}
+
+int main( int argc, const char **argv ) {
+    return elevator::Fuzz( argc, argv ).main();
+}
+
+#endif
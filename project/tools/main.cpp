@@ -2,6 +2,8 @@
 #include <iostream>
 #include <set>
 #include <cstring>
+#include <cerrno>
+#include <thread>
 
 #include <signal.h>
 #include <unistd.h>
@@ -13,7 +15,16 @@
 #include <elevator/elevator.h>
 #include <elevator/scheduler.h>
 #include <elevator/udpqueue.h>
+#include <elevator/reliablequeue.h>
 #include <elevator/sessionmanager.h>
+#include <elevator/checkpoint.h>
+#include <elevator/log.h>
+#include <elevator/latency.h>
+#include <elevator/statusserver.h>
+#include <elevator/threadconfig.h>
+#include <elevator/restartwrapper.h>
+#include <elevator/capture.h>
+#include <elevator/dispatchtrace.h>
 
 void handler( int sig, siginfo_t *info, void * ) {
     elevator::Driver driver;
@@ -29,6 +40,34 @@ void handler( int sig, siginfo_t *info, void * ) {
 
 namespace elevator {
 
+// for announcing departure when we are interrupted: neither sending nor
+// driver is async-signal-safe, so handler only wakes thread which does it
+static int leavePipe[ 2 ] = { -1, -1 };
+
+void leaveHandler( int sig ) {
+    int err = errno;
+    char s = sig;
+    if ( write( leavePipe[ 1 ], &s, 1 ) != 1 ) { } // nothing to do about it
+    errno = err;
+}
+
+void watchLeave( SessionManager &sessman ) {
+    int rc = pipe( leavePipe );
+    assert_eq( rc, 0, "pipe failed" );
+    std::thread( [&sessman] {
+            char sig;
+            while ( read( leavePipe[ 0 ], &sig, 1 ) != 1 ) { }
+            if ( sessman.connected() )
+                sessman.leave();
+            Driver driver;
+            driver.stopElevator();
+            signal( sig, SIG_DFL );
+            raise( sig );
+        } ).detach();
+    signal( SIGINT, leaveHandler );
+    signal( SIGTERM, leaveHandler );
+}
+
 using namespace wibble;
 using namespace wibble::commandline;
 using namespace udp;
@@ -41,26 +80,94 @@ struct Main {
 
     const Port stateChangePort{ 64016 };
     const Port commandPort{ 64017 };
+    const Port commandAckPort{ 64018 }; // must not be shared, acks are sent here
 
     StandardParser opts;
     OptionGroup *execution;
     IntOption *optNodes;
+    IntOption *optId;
     BoolOption *avoidRecovery;
+    BoolOption *warmStandby;
+    StringOption *optJournal;
+    StringOption *optCapture;
+    StringOption *optTrace;
+    BoolOption *quiet;
+    IntOption *optHeartbeatWarning;
+    IntOption *optStatusPort;
+    StringOption *optStatusHost;
+    OptionGroup *realtime;
+    StringOption *optSched;
+    IntOption *optPriority;
+    StringOption *optCpus;
+    BoolOption *optMlock;
     const int peerMsg = 1000;
     std::set< IPv4Address > peerAddresses;
     int id = INT_MIN;
     int nodes = 1;
+    std::unique_ptr< CheckpointRing > checkpoints; // shared with children
+    int backupPipe = -1; // writing wakes up backup
 
     Main( int argc, const char **argv ) : opts( "elevator", "1.0" ) {
         // setup options
         execution = opts.createGroup( "Execution options" );
         optNodes = execution->add< IntOption >(
                 "nodes", 'n', "nodes", "",
-                "specifies number of elevator nodes to expect" );
+                "specifies minimal number of elevator nodes to wait for "
+                "(others can join later, single node does not use network)" );
+        optId = execution->add< IntOption >(
+                "id", 'i', "id", "",
+                "stable id of this node (default: derived from MAC address, 0 for "
+                "single node)" );
 
         avoidRecovery = execution->add< BoolOption >(
                 "avoid recovery", 0, "avoid-recovery", "",
                 "avoid auto-recovery when program is killed (do not fork)" );
+        warmStandby = execution->add< BoolOption >(
+                "warm standby", 0, "warm-standby", "",
+                "keep pre-forked backup process which takes over with "
+                "checkpointed state when primary one dies" );
+        optJournal = execution->add< StringOption >(
+                "journal", 0, "journal", "<file>",
+                "keep crash-safe journal of state and pending requests in file "
+                "and recover from it on start" );
+        optCapture = execution->add< StringOption >(
+                "capture", 0, "capture", "<file>",
+                "capture all sent and received packets for replay (existing "
+                "file is not overwritten, <file>.1, <file>.2, ... is used instead)" );
+        optTrace = execution->add< StringOption >(
+                "trace", 0, "trace", "<file>",
+                "trace scheduler decisions with costs of all candidates for offline "
+                "analysis (existing file is not overwritten, as with --capture)" );
+        quiet = execution->add< BoolOption >(
+                "quiet", 'q', "quiet", "",
+                "log only warnings and errors (no log of state updates)" );
+        optHeartbeatWarning = execution->add< IntOption >(
+                "heartbeat warning", 0, "heartbeat-warning", "<percent>",
+                "warn when heartbeat is late by given percentage of its "
+                "threshold (default: 50)" );
+        optStatusPort = execution->add< IntOption >(
+                "status port", 0, "status-port", "<port>",
+                "serve status and metrics over HTTP on given port of localhost "
+                "(/status in JSON, /metrics in Prometheus text format)" );
+        optStatusHost = execution->add< StringOption >(
+                "status host", 0, "status-host", "<address>",
+                "serve status on given address instead of localhost" );
+
+        realtime = opts.createGroup( "Real-time options" );
+        optSched = realtime->add< StringOption >(
+                "scheduling policy", 0, "sched", "<policy>",
+                "scheduling policy of control and network threads: other (default), "
+                "fifo or rr (elevator loop polls without sleeping, so real-time "
+                "policy should be combined with --cpus with spare CPU)" );
+        optPriority = realtime->add< IntOption >(
+                "priority", 0, "priority", "<n>",
+                "real-time priority of control threads, network threads get one less" );
+        optCpus = realtime->add< StringOption >(
+                "cpus", 0, "cpus", "<list>",
+                "pin control threads to given CPUs (such as 2,3 or 2-3)" );
+        optMlock = realtime->add< BoolOption >(
+                "mlock", 0, "mlock", "",
+                "lock all memory and prefault stacks of control and network threads" );
 
         opts.usage = "";
         opts.description = "Elevator control software as a project for the "
@@ -70,6 +177,7 @@ struct Main {
                            "https://github.com/vlstill/ttk4145/tree/master/project";
 
         opts.add( execution );
+        opts.add( realtime );
 
         // parse options
         try {
@@ -124,43 +232,182 @@ struct Main {
         }
     }
 
+    /* backup is forked in advance and waits for parent to wake it up when
+     * primary dies, then it runs elevator from last checkpoint of primary */
+    int forkBackup() {
+        int fds[ 2 ];
+        int rc = pipe( fds );
+        assert_eq( rc, 0, "pipe failed" );
+        int pid = fork();
+        if ( pid == 0 ) { // backup
+            close( fds[ 1 ] );
+            struct sigaction act;
+            memset( &act, 0, sizeof( struct sigaction ) );
+            act.sa_handler = SIG_DFL;
+            sigaction( SIGINT, &act, nullptr );
+
+            char go;
+            if ( read( fds[ 0 ], &go, 1 ) != 1 )
+                exit( 0 ); // parent died
+            close( fds[ 0 ] );
+            std::cerr << "Backup taking over" << std::endl;
+            runElevator( checkpoints->read() );
+            exit( 0 );
+        }
+        assert_leq( 0, pid, "fork failed" );
+        close( fds[ 0 ] );
+        backupPipe = fds[ 1 ];
+        return pid;
+    }
+
+    void initWarmStandby() {
+        struct sigaction act;
+        memset( &act, 0, sizeof( struct sigaction ) );
+        act.sa_sigaction = handler;
+        act.sa_flags = SA_SIGINFO;
+        sigaction( SIGINT, &act, nullptr ); // ctrl+c
+
+        std::cerr << "Starting warm-standby wrapper... " << std::flush;
+        checkpoints.reset( new CheckpointRing() );
+        int primary = fork();
+        if ( primary == 0 ) {
+            setupChild();
+            exit( 0 );
+        }
+        assert_leq( 0, primary, "fork failed" );
+        int backup = forkBackup();
+        std::cerr << "OK" << std::endl;
+
+        while ( true ) {
+            int dead = waitpid( -1, nullptr, 0 );
+            if ( dead == primary ) {
+                Driver driver;
+                driver.stopElevator();
+                std::cerr << "Primary died, waking backup" << std::endl;
+                char go = 1;
+                int rc = write( backupPipe, &go, 1 );
+                assert_eq( rc, 1, "waking backup failed" );
+                close( backupPipe );
+                primary = backup;
+                backup = forkBackup();
+            } else if ( dead == backup ) {
+                std::cerr << "Backup died, starting new one" << std::endl;
+                close( backupPipe );
+                backup = forkBackup();
+            }
+        }
+    }
+
+    void setupThreads() {
+        try {
+            ThreadConfig control;
+            if ( optSched->isSet() )
+                control.policy = ThreadConfig::parsePolicy( optSched->stringValue() );
+            if ( control.policy != SCHED_OTHER ) {
+                int min = sched_get_priority_min( control.policy ) + 1;
+                int max = sched_get_priority_max( control.policy );
+                control.priority = optPriority->isSet() ? optPriority->intValue() : min;
+                // network threads run one level below control ones
+                if ( control.priority < min || control.priority > max )
+                    throw exception::BadOption( "priority must be between "
+                            + std::to_string( min ) + " and " + std::to_string( max ),
+                            "parsing --priority" );
+            }
+            if ( optMlock->boolValue() )
+                control.stackPrefault = ThreadConfig::defaultStackPrefault;
+
+            ThreadConfig network = control;
+            network.priority = control.policy == SCHED_OTHER ? 0 : control.priority - 1;
+
+            if ( optCpus->isSet() )
+                control.cpus = ThreadConfig::parseCpus( optCpus->stringValue() );
+
+            ThreadConfig::set( ThreadClass::Control, control );
+            ThreadConfig::set( ThreadClass::Network, network );
+        } catch ( exception::BadOption &ex ) {
+            std::cerr << "FATAL: " << ex.fullInfo() << std::endl;
+            exit( 1 );
+        }
+    }
+
     void main() {
+        if ( quiet->boolValue() )
+            log::Logger::instance().setLevel( log::Level::Warning );
+        setupThreads();
 
         if ( avoidRecovery->boolValue() ) {
             runElevator();
+        } else if ( warmStandby->boolValue() ) {
+            initWarmStandby();
         } else {
             initRecovery();
         }
     }
 
-    void runElevator() {
-        int id;
+    /* capture (or trace) of restarted process must not overwrite the one of
+     * process which failed */
+    std::string freshPath( std::string base ) {
+        std::string path = base;
+        for ( int i = 1; access( path.c_str(), F_OK ) == 0; ++i )
+            path = base + "." + std::to_string( i );
+        return path;
+    }
+
+    void runElevator( wibble::Maybe< Checkpoint > takeover = wibble::Maybe< Checkpoint >::Nothing() ) {
+        latency::dumpOnSignal( SIGUSR1 );
+        if ( optMlock->boolValue() )
+            lockMemory(); // locks are not inherited by fork
+        std::unique_ptr< Capture > capture;
+        if ( optCapture->isSet() ) {
+            capture.reset( new Capture( freshPath( optCapture->stringValue() ) ) );
+            capture->install();
+        }
         GlobalState global;
         HeartBeatManager heartbeatManager;
-        SessionManager sessman{ global };
-
-        if ( optNodes->boolValue() && optNodes->intValue() > 1 ) {
-            std::cerr << "Initializing network connections, this might take some time" << std::endl
-                      << "Please start other peers and wait... " << std::flush;
+        // network is not used at all by single elevator (backup has the same
+        // options as primary, so it rejoins only if primary was connected)
+        if ( optNodes->boolValue() && optNodes->intValue() > 1 )
             nodes = optNodes->intValue();
-            sessman.connect( heartbeatManager.getNew( 5000 ), nodes );
-            id = sessman.id();
+        bool networked = nodes > 1;
+        SessionManager sessman{ global, optId->isSet() ? optId->intValue()
+                                        : networked ? SessionManager::defaultId() : 0 };
+        int id = sessman.id();
+
+        if ( networked && takeover.isNothing() ) {
+            std::cerr << "Initializing network connections, waiting for at least "
+                      << nodes << " nodes" << std::endl
+                      << "Please start other peers and wait... " << std::flush;
+            sessman.connect( heartbeatManager.getNew( 5000, "session" ), nodes );
             std::cerr << "OK" << std::endl;
-        } else {
-            id = 0;
+        } else if ( networked ) {
+            // after takeover others are already running and they know us,
+            // so backup does not wait for bootstrap
+            sessman.rejoin( heartbeatManager.getNew( 5000, "session" ) );
         }
 
-        std::cout << "Starting elevator, id " << id << " of " << nodes << " elevators." << std::endl;
+        std::unique_ptr< Journal > journal;
+        if ( optJournal->isSet() )
+            journal.reset( new Journal( optJournal->stringValue() ) );
+        std::unique_ptr< DispatchTrace > trace; // must outlive scheduler
+        if ( optTrace->isSet() )
+            trace.reset( new DispatchTrace( freshPath( optTrace->stringValue() ) ) );
+        // checkpoint from warm standby is at least as fresh as journal
+        auto checkpoint = takeover.isNothing() && journal ? journal->recovered() : takeover;
+        watchLeave( sessman );
+
+        std::cout << "Starting elevator, id " << id << ", "
+                  << ( networked ? sessman.peerAddresses().size() : 1 ) << " elevator(s) known." << std::endl;
 
         ConcurrentQueue< Command > commandsToLocalElevator;
         ConcurrentQueue< Command > commandsToOthers;
         ConcurrentQueue< StateChange > stateChangesIn;
         ConcurrentQueue< StateChange > stateChangesOut;
+        StatusBoard statusBoard;
 
-        QueueReceiver< Command > commandsToLocalElevatorReceiver {
+        ReliableReceiver< Command > commandsToLocalElevatorReceiver {
+            id,
             Address{ IPv4Address::any, commandPort },
-            commandsToLocalElevator,
-            [id]( const Command &comm ) { return comm.targetElevatorId == id; }
+            commandsToLocalElevator
         };
         QueueReceiver< StateChange > stateChangesInReceiver {
             Address{ IPv4Address::any, stateChangePort },
@@ -170,18 +417,24 @@ struct Main {
                 // best approximation of timestamp of change is the time
                 // we received it
                 chan.state.timestamp = now();
-                return chan.state.id != id;
-            }
+                return true;
+            },
+            // our own broadcasts are looped back, drop them in kernel
+            PacketFilter().rejectWord( StateChange::idOffset(), id )
         };
         QueueSender< StateChange > stateChangesOutSender {
             commSend,
             Address{ IPv4Address::broadcast, stateChangePort },
             stateChangesOut
         };
-        QueueSender< Command > commandsToOthersReceiver {
-            commSend,
+        ReliableSender< Command > commandsToOthersReceiver {
+            id,
+            Address{ IPv4Address::any, commandAckPort },
             Address{ IPv4Address::broadcast, commandPort },
-            commandsToOthers
+            commandsToOthers,
+            []( const Command &comm ) { return comm.targetElevatorId; },
+            // commands are unicasted to their target, only ANY_ID is broadcasted
+            [&sessman]( int target ) { return sessman.peerAddress( target ); }
         };
 
         /* about heartbeat lengths:
@@ -210,23 +463,69 @@ struct Main {
             commandsToLocalElevator
         };
 
-        if ( nodes > 1 ) {
+        if ( networked ) {
             commandsToLocalElevatorReceiver.run();
             stateChangesInReceiver.run();
             commandsToOthersReceiver.run();
             stateChangesOutSender.run();
         }
 
-        if ( sessman.needRecoveryState() )
+        if ( !checkpoint.isNothing() ) {
+            // local checkpoint is fresher than anything peers can have
+            global.update( checkpoint.value().state );
+            elevator.recover( checkpoint.value().state );
+            for ( auto &comm : checkpoint.value().requests )
+                global.requests().push( Request( comm, 100 ) );
+            if ( checkpoint.value().dropped )
+                log::warning( "{} pending request(s) did not fit into checkpoint "
+                        "and were not recovered", checkpoint.value().dropped );
+        } else if ( sessman.needRecoveryState() )
             elevator.recover( sessman.recoveryState() );
+        if ( checkpoints )
+            scheduler.checkpointTo( *checkpoints );
+        if ( trace )
+            scheduler.traceTo( *trace );
+        if ( journal ) {
+            scheduler.journalTo( *journal );
+            journal->run();
+        }
+        std::unique_ptr< StatusServer > statusServer;
+        if ( optStatusPort->boolValue() ) {
+            scheduler.publishTo( statusBoard );
+            statusServer.reset( new StatusServer( statusBoard, optStatusPort->intValue(),
+                        optStatusHost->isSet() ? optStatusHost->stringValue().c_str() : "127.0.0.1" ) );
+            statusServer->watchQueue( "commandsToLocalElevator", commandsToLocalElevator );
+            statusServer->watchQueue( "commandsToOthers", commandsToOthers );
+            statusServer->watchQueue( "stateChangesIn", stateChangesIn );
+            statusServer->watchQueue( "stateChangesOut", stateChangesOut );
+            statusServer->watchHeartBeats( heartbeatManager );
+        }
 
-        elevator.run( heartbeatManager.getNew( 100 ) );
-        scheduler.run( heartbeatManager.getNew( 200 ), heartbeatManager.getNew( 200 ) );
-
-        // wait for 2 seconds so that everything has chance to start
-        // it something fails to start in this time heartbeat will
-        // fail and process will be terminated
-        std::this_thread::sleep_for( std::chrono::seconds( 2 ) );
+        elevator.run( heartbeatManager.getNew( 100, "elevator" ) );
+        scheduler.run( heartbeatManager.getNew( 200, "scheduler" ),
+                heartbeatManager.getNew( 200, "request check" ) );
+
+        int warnPercent = optHeartbeatWarning->boolValue() ? optHeartbeatWarning->intValue() : 50;
+        heartbeatManager.setWarning( warnPercent / 100.0, []( const HeartBeat &hb, MillisecondTime delta ) {
+                log::warning( "heartbeat {} is late: {} ms, threshold is {} ms",
+                    hb.name(), delta, hb.threshold() );
+            } );
+        if ( statusServer )
+            statusServer->run();
+        // process terminates when heartbeat manager fails, so it outlives dumps
+        latency::addDumper( [&heartbeatManager]( std::ostream &os ) {
+                heartbeatManager.dump( os );
+            } );
+        latency::addDumper( []( std::ostream &os ) {
+                eachRestartCounter( [&os]( const RestartCounter &c ) {
+                        os << "    restarts of " << c.name << ": " << c.restarts.load() << std::endl;
+                    } );
+            } );
+
+        // wait (at most 2 seconds) untill everything starts, if something
+        // fails to start in this time heartbeat will fail and process will
+        // be terminated
+        heartbeatManager.waitForFirstBeats( 2000 );
         // heartbeat failure will throw an exception which will terminate
         // process (as it is not catched)
         heartbeatManager.runInThisThread();
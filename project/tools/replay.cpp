@@ -0,0 +1,266 @@
+#include <wibble/commandline/parser.h>
+
+#include <elevator/capture.h>
+#include <elevator/dispatchtrace.h>
+#include <elevator/scheduler.h>
+#include <elevator/globalstate.h>
+#include <elevator/serialization.h>
+#include <elevator/sessionprotocol.h>
+#include <elevator/log.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <climits>
+#include <memory>
+
+/* Deterministic replay of packet capture (elevator --capture=<file>)
+ *
+ * State changes from capture (both received and sent by captured node, the
+ * latter are its local changes) are fed to Scheduler and GlobalState in
+ * order, at original pace, accelerated or as fast as possible. Scheduler
+ * measures age of states against time of capture, not against wall clock,
+ * so its decisions do not depend on replay speed; they are summarized (and
+ * hashed, so that two replays can be compared quickly) or printed one by one.
+ * Replay can also write dispatch trace, so that penalties of scheduler can be
+ * tuned on captured production traffic.
+ *
+ * Only packet-driven part of node is replayed: request re-sending and
+ * failure detection are driven by timers and they are not run (departures
+ * announced by leave packets are replayed).
+ */
+
+namespace elevator {
+
+using namespace serialization;
+using namespace wibble::commandline;
+using Clock = std::chrono::steady_clock;
+
+// time of capture (in milliseconds) of packet being replayed
+static MillisecondTime replayTime = 0;
+static MillisecondTime replayNow() { return replayTime; }
+
+static const char *showType( TypeSignature t ) {
+#define show( X ) case TypeSignature::X: return #X
+    switch ( t ) {
+        show( NoType );
+        show( TestType );
+        show( ElevatorCommand );
+        show( ElevatorState );
+        show( InitialPacket );
+        show( ElevatorReady );
+        show( RecoveryState );
+        show( RecoveryPeers );
+        show( ReliableData );
+        show( ReliableAck );
+        show( ElevatorLeave );
+        show( ElevatorAlive );
+        show( Checkpoint );
+        show( RequestEvent );
+    }
+#undef show
+    return "<<unknown>>";
+}
+
+struct Replay {
+    StandardParser opts;
+    IntOption *optSpeed;
+    IntOption *optId;
+    IntOption *optFloors;
+    IntOption *optRepeat;
+    BoolOption *optDump;
+    BoolOption *optDecisions;
+    StringOption *optTrace;
+    std::string path;
+
+    struct Stats {
+        long packets = 0, updates = 0, leaves = 0, malformed = 0;
+        long calls = 0, commands = 0;
+        uint64_t hash = 14695981039346656037ull; // FNV-1a of call decisions
+        int64_t ns = 0; // spent in scheduler
+    };
+
+    Replay( int argc, const char **argv ) : opts( "replay", "1.0" ) {
+        optSpeed = opts.add< IntOption >(
+                "speed", 's', "speed", "<factor>",
+                "replay given times faster than original, 0 = as fast as possible "
+                "(default: 1)" );
+        optId = opts.add< IntOption >(
+                "id", 'i', "id", "<n>",
+                "id of captured node (default: id of first state change it sent)" );
+        optFloors = opts.add< IntOption >(
+                "floors", 'f', "floors", "<n>",
+                "number of floors (default: 4)" );
+        optRepeat = opts.add< IntOption >(
+                "repeat", 'r', "repeat", "<n>",
+                "replay capture n times, each time from empty state (default: 1)" );
+        optDump = opts.add< BoolOption >(
+                "dump", 'd', "dump", "",
+                "only list captured packets" );
+        optDecisions = opts.add< BoolOption >(
+                "decisions", 0, "decisions", "",
+                "print every call scheduled by replayed scheduler" );
+        optTrace = opts.add< StringOption >(
+                "trace", 't', "trace", "<file>",
+                "write dispatch trace of (first) replay, for analyse tool" );
+        opts.usage = "<capture>";
+        opts.description = "Replays packet capture of elevator node to its scheduler, "
+                           "for debugging and as realistic benchmark workload.";
+
+        try {
+            opts.parse( argc, argv );
+        } catch ( wibble::exception::BadOption &ex ) {
+            std::cerr << "FATAL: " << ex.fullInfo() << std::endl;
+            exit( 1 );
+        }
+        if ( opts.help->boolValue() || opts.version->boolValue() )
+            exit( 0 );
+        if ( !opts.hasNext() ) {
+            std::cerr << "FATAL: capture file expected" << std::endl;
+            exit( 1 );
+        }
+        path = opts.next();
+    }
+
+    int dump() {
+        CaptureReader reader( path );
+        CaptureReader::Entry e;
+        while ( reader.next( e ) )
+            std::cout << e.time << " " << ( e.sent ? "sent to " : "received from " )
+                      << e.packet.address() << " " << showType( Serializer::packetType( e.packet ) )
+                      << " (" << e.packet.size() << " B)" << std::endl;
+        return 0;
+    }
+
+    int localId() {
+        if ( optId->isSet() )
+            return optId->intValue();
+        CaptureReader reader( path );
+        CaptureReader::Entry e;
+        while ( reader.next( e ) )
+            if ( e.sent && Serializer::packetType( e.packet ) == TypeSignature::ElevatorState ) {
+                auto change = Serializer::fromPacket< StateChange >( e.packet );
+                if ( !change.isNothing() )
+                    return change.value().state.id;
+            }
+        std::cerr << "FATAL: capture contains no local state change, use --id" << std::endl;
+        exit( 1 );
+    }
+
+    template< typename Yield >
+    static void drain( ConcurrentQueue< Command > &queue, Yield yield ) {
+        for ( ;; ) {
+            auto c = queue.tryDequeue();
+            if ( c.isNothing() )
+                return;
+            yield( c.value() );
+        }
+    }
+
+    void replayOnce( int id, int speed, Stats &stats, DispatchTrace *trace ) {
+        BasicDriverInfo info( 0, ( optFloors->boolValue() ? optFloors->intValue() : 4 ) - 1 );
+        GlobalState global;
+        ConcurrentQueue< StateChange > stateIn, stateOut;
+        ConcurrentQueue< Command > toRemote, toLocal;
+        Scheduler scheduler( id, info, global, stateIn, stateOut, toRemote, toLocal );
+        scheduler.useClock( &replayNow );
+        if ( trace )
+            scheduler.traceTo( *trace );
+
+        auto command = [&]( const Command &c ) {
+            ++stats.commands;
+            if ( c.commandType != CommandType::CallToFloorAndGoUp
+                    && c.commandType != CommandType::CallToFloorAndGoDown )
+                return;
+            ++stats.calls;
+            for ( int x : { int( c.commandType ), c.targetFloor, c.targetElevatorId } ) {
+                stats.hash ^= uint32_t( x );
+                stats.hash *= 1099511628211ull;
+            }
+            if ( optDecisions->boolValue() )
+                std::cout << replayTime << " " << showCommand( c.commandType )
+                          << " floor " << c.targetFloor << " -> " << c.targetElevatorId << std::endl;
+        };
+
+        CaptureReader reader( path );
+        CaptureReader::Entry e;
+        auto start = Clock::now();
+        while ( reader.next( e ) ) {
+            ++stats.packets;
+            replayTime = e.time / 1000;
+            TypeSignature type = Serializer::packetType( e.packet );
+            if ( type != TypeSignature::ElevatorState && type != TypeSignature::ElevatorLeave )
+                continue;
+            if ( speed > 0 )
+                std::this_thread::sleep_until( start + std::chrono::microseconds( e.time / speed ) );
+
+            auto t = Clock::now();
+            if ( type == TypeSignature::ElevatorLeave ) {
+                auto leave = Serializer::fromPacket< session::Leave >( e.packet );
+                if ( leave.isNothing() )
+                    ++stats.malformed;
+                else if ( !e.sent ) {
+                    global.remove( leave.value().id );
+                    ++stats.leaves;
+                }
+            } else {
+                auto change = Serializer::fromPacket< StateChange >( e.packet );
+                if ( change.isNothing() ) {
+                    ++stats.malformed;
+                    continue;
+                }
+                // just like receiver does, timestamp is time of arrival
+                change.value().state.timestamp = replayTime;
+                scheduler.update( change.value() );
+                ++stats.updates;
+            }
+            stats.ns += std::chrono::duration_cast< std::chrono::nanoseconds >(
+                    Clock::now() - t ).count();
+
+            drain( toLocal, command );
+            drain( toRemote, [&]( const Command &c ) {
+                    // commands for any elevator are already counted from local queue
+                    if ( c.targetElevatorId != Command::ANY_ID )
+                        command( c );
+                } );
+            while ( !stateOut.tryDequeue().isNothing() )
+            { }
+        }
+    }
+
+    int main() {
+        if ( optDump->boolValue() )
+            return dump();
+        // replayed updates would be logged otherwise
+        log::Logger::instance().setLevel( log::Level::Warning );
+
+        int id = localId();
+        int speed = optSpeed->isSet() ? optSpeed->intValue() : 1;
+        int repeat = optRepeat->isSet() ? std::max( 1, optRepeat->intValue() ) : 1;
+        for ( int i = 0; i < repeat; ++i ) {
+            Stats stats;
+            std::unique_ptr< DispatchTrace > trace;
+            if ( i == 0 && optTrace->isSet() )
+                trace.reset( new DispatchTrace( optTrace->stringValue() ) );
+            replayOnce( id, speed, stats, trace.get() );
+            std::cout << "packets: " << stats.packets << ", state updates: " << stats.updates
+                      << ", leaves: " << stats.leaves << ", malformed: " << stats.malformed
+                      << std::endl
+                      << "commands: " << stats.commands << ", calls: " << stats.calls
+                      << ", decision hash: " << std::hex << stats.hash << std::dec << std::endl
+                      << "scheduler time: " << stats.ns / 1000 << " us";
+            if ( stats.updates )
+                std::cout << " (" << stats.ns / stats.updates << " ns per update)";
+            std::cout << std::endl;
+        }
+        return 0;
+    }
+};
+
+}
+
+int main( int argc, const char **argv ) {
+    return elevator::Replay( argc, argv ).main();
+}
@@ -0,0 +1,485 @@
+#include <wibble/commandline/parser.h>
+
+#include <elevator/channels.h>
+#include <elevator/time.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <climits>
+#include <cstring>
+#include <cstdlib>
+
+#include <signal.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+/* Soak test of full multi-node stack
+ *
+ * Every node is complete elevator process (--avoid-recovery) with simulated
+ * hardware (see elevator/simulator.h) running in its own network namespace,
+ * namespaces are connected by bridge so that broadcasts work just like on
+ * real LAN and all nodes use the same ports. Button presses are sent to
+ * simulators with rate which is ramped up in steps; after each step queue
+ * depths and heartbeat slack are read from status server of each node, UDP
+ * receive errors from /proc/<pid>/net/snmp and CPU time of each thread from
+ * /proc/<pid>/task. Ramp stops at first step which breaks any limit.
+ *
+ * Needs root (for namespaces), output is CSV (one line per node and step)
+ * on stdout, progress and result on stderr.
+ */
+
+namespace elevator {
+
+using namespace wibble::commandline;
+
+static const char *bridge = "elvsoak0";
+static const char *bridgeAddress = "10.77.0.254";
+static const int simulatorPort = 64100;
+static const int statusPort = 64101;
+
+// buttons which exist on simulated elevator
+static const int buttons[] = {
+    FLOOR_UP1, FLOOR_UP2, FLOOR_UP3,
+    FLOOR_DOWN2, FLOOR_DOWN3, FLOOR_DOWN4,
+    FLOOR_COMMAND1, FLOOR_COMMAND2, FLOOR_COMMAND3, FLOOR_COMMAND4
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interruptHandler( int ) { interrupted = 1; }
+
+static bool shell( std::string command ) {
+    int rc = std::system( (command + " 2>/dev/null").c_str() );
+    return rc == 0;
+}
+
+static std::string readFile( std::string path ) {
+    std::ifstream file( path );
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+static std::string httpGet( std::string address, int port, std::string path ) {
+    int fd = socket( AF_INET, SOCK_STREAM, 0 );
+    if ( fd < 0 )
+        return "";
+    struct timeval timeout{ 1, 0 };
+    setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+    setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+    sockaddr_in addr;
+    std::memset( &addr, 0, sizeof( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons( port );
+    inet_pton( AF_INET, address.c_str(), &addr.sin_addr );
+    std::string resp;
+    if ( connect( fd, reinterpret_cast< sockaddr * >( &addr ), sizeof( addr ) ) == 0 ) {
+        std::string req = "GET " + path + " HTTP/1.0\r\n\r\n";
+        if ( write( fd, req.data(), req.size() ) == ssize_t( req.size() ) ) {
+            char buf[ 4096 ];
+            ssize_t n;
+            while ( (n = read( fd, buf, sizeof( buf ) )) > 0 )
+                resp.append( buf, n );
+        }
+    }
+    close( fd );
+    return resp;
+}
+
+struct Node {
+    int index;
+    std::string ns;
+    std::string address;
+    pid_t pid = -1;
+    bool alive = false;
+
+    // metrics, reset every step
+    int64_t maxQueue = 0;
+    int64_t minSlack = INT_MAX;
+    int64_t requests = 0;
+    int64_t udpErrors = 0;
+    std::map< int, std::pair< std::string, int64_t > > cpu; // tid -> (name, ticks)
+
+    /* max over all queues and min over all heartbeats */
+    bool sampleMetrics() {
+        std::string metrics = httpGet( address, statusPort, "/metrics" );
+        if ( metrics.find( "200 OK" ) == std::string::npos )
+            return false;
+        std::stringstream ss( metrics );
+        std::string line;
+        while ( std::getline( ss, line ) ) {
+            auto space = line.rfind( ' ' );
+            if ( line.empty() || line[ 0 ] == '#' || space == std::string::npos )
+                continue;
+            int64_t value = std::atoll( line.c_str() + space + 1 );
+            if ( line.compare( 0, 21, "elevator_queue_depth{" ) == 0 )
+                maxQueue = std::max( maxQueue, value );
+            else if ( line.compare( 0, 28, "elevator_heartbeat_slack_ms{" ) == 0 )
+                minSlack = std::min( minSlack, value );
+            else if ( line.compare( 0, 18, "elevator_requests " ) == 0 )
+                requests = value;
+        }
+        return true;
+    }
+
+    /* RcvbufErrors of UDP in namespace of node, datagrams dropped because of
+     * full receive buffer (InErrors would count also own broadcasts rejected
+     * by socket filters) */
+    int64_t readUdpErrors() const {
+        std::stringstream ss( readFile( "/proc/" + std::to_string( pid ) + "/net/snmp" ) );
+        std::string header, values;
+        while ( std::getline( ss, header ) && std::getline( ss, values ) ) {
+            if ( header.compare( 0, 4, "Udp:" ) != 0 )
+                continue;
+            std::stringstream hs( header ), vs( values );
+            std::string name, value;
+            while ( hs >> name && vs >> value )
+                if ( name == "RcvbufErrors" )
+                    return std::atoll( value.c_str() );
+        }
+        return 0;
+    }
+
+    /* user + system clock ticks of every thread */
+    std::map< int, std::pair< std::string, int64_t > > readCpu() const {
+        std::map< int, std::pair< std::string, int64_t > > out;
+        std::string dir = "/proc/" + std::to_string( pid ) + "/task";
+        DIR *d = opendir( dir.c_str() );
+        if ( !d )
+            return out;
+        while ( dirent *ent = readdir( d ) ) {
+            if ( ent->d_name[ 0 ] == '.' )
+                continue;
+            std::string stat = readFile( dir + "/" + ent->d_name + "/stat" );
+            auto open = stat.find( '(' ), close = stat.rfind( ')' );
+            if ( open == std::string::npos || close == std::string::npos )
+                continue;
+            std::stringstream fields( stat.substr( close + 2 ) );
+            std::string field;
+            int64_t utime = 0, stime = 0;
+            // fields after name start with state (3rd), utime is 14th, stime 15th
+            for ( int i = 3; i <= 15 && fields >> field; ++i ) {
+                if ( i == 14 )
+                    utime = std::atoll( field.c_str() );
+                if ( i == 15 )
+                    stime = std::atoll( field.c_str() );
+            }
+            out[ std::atoi( ent->d_name ) ] = { stat.substr( open + 1, close - open - 1 ),
+                                                utime + stime };
+        }
+        closedir( d );
+        return out;
+    }
+};
+
+struct Soak {
+    StandardParser opts;
+    IntOption *optNodes;
+    StringOption *optBinary;
+    IntOption *optStep;
+    IntOption *optStartRate;
+    IntOption *optMaxRate;
+    IntOption *optMaxQueue;
+    IntOption *optMinSlack;
+    StringOption *optLogDir;
+
+    std::vector< Node > nodes;
+    std::string binary;
+    std::mt19937 random{ 42 }; // fixed seed, runs are repeatable
+    int udp = -1;
+
+    Soak( int argc, const char **argv ) : opts( "soak", "1.0" ) {
+        optNodes = opts.add< IntOption >(
+                "nodes", 'n', "nodes", "<n>",
+                "number of elevator nodes (default: 3)" );
+        optBinary = opts.add< StringOption >(
+                "binary", 'b', "binary", "<path>",
+                "elevator binary (default: elevator next to soak)" );
+        optStep = opts.add< IntOption >(
+                "step", 0, "step", "<seconds>",
+                "duration of one step of ramp (default: 5)" );
+        optStartRate = opts.add< IntOption >(
+                "start-rate", 0, "start-rate", "<presses/s>",
+                "button presses per second (over all nodes) in first step, rate "
+                "doubles every step (default: 1)" );
+        optMaxRate = opts.add< IntOption >(
+                "max-rate", 0, "max-rate", "<presses/s>",
+                "stop ramp at this rate (default: 1024)" );
+        optMaxQueue = opts.add< IntOption >(
+                "max-queue", 0, "max-queue", "<n>",
+                "queue depth considered breakdown (default: 100)" );
+        optMinSlack = opts.add< IntOption >(
+                "min-slack", 0, "min-slack", "<ms>",
+                "heartbeat slack considered breakdown (default: 10)" );
+        optLogDir = opts.add< StringOption >(
+                "log-dir", 0, "log-dir", "<dir>",
+                "directory for output of nodes (default: current)" );
+        opts.usage = "";
+        opts.description = "Soak test of elevator nodes with simulated hardware "
+                           "in network namespaces, ramps button press rate until "
+                           "queues, heartbeats or network break down (needs root).";
+
+        try {
+            opts.parse( argc, argv );
+        } catch ( wibble::exception::BadOption &ex ) {
+            std::cerr << "FATAL: " << ex.fullInfo() << std::endl;
+            exit( 1 );
+        }
+        if ( opts.help->boolValue() || opts.version->boolValue() )
+            exit( 0 );
+
+        std::string self = argv[ 0 ];
+        auto slash = self.rfind( '/' );
+        binary = optBinary->isSet() ? optBinary->stringValue()
+            : (slash == std::string::npos ? "." : self.substr( 0, slash )) + "/elevator";
+    }
+
+    int intOpt( IntOption *opt, int def ) {
+        return opt->boolValue() ? opt->intValue() : def;
+    }
+
+    void setupNetwork() {
+        shell( std::string( "ip link del " ) + bridge ); // leftover of previous run
+        bool ok = shell( std::string( "ip link add " ) + bridge + " type bridge" )
+            && shell( std::string( "ip addr add " ) + bridgeAddress + "/24 dev " + bridge )
+            && shell( std::string( "ip link set " ) + bridge + " up" );
+        for ( auto &n : nodes ) {
+            std::string veth = "elvsoakv" + std::to_string( n.index );
+            shell( "ip netns del " + n.ns );
+            ok = ok && shell( "ip netns add " + n.ns )
+                && shell( "ip link add " + veth + " type veth peer name eth0 netns " + n.ns )
+                && shell( "ip link set " + veth + " master " + bridge + " up" )
+                && shell( "ip -n " + n.ns + " addr add " + n.address + "/24 dev eth0" )
+                && shell( "ip -n " + n.ns + " link set eth0 up" )
+                && shell( "ip -n " + n.ns + " link set lo up" )
+                // limited broadcast is routed by default route
+                && shell( "ip -n " + n.ns + " route add default via " + bridgeAddress );
+        }
+        if ( !ok ) {
+            std::cerr << "FATAL: cannot set up network namespaces" << std::endl;
+            teardown();
+            exit( 1 );
+        }
+    }
+
+    void launch( Node &n ) {
+        std::string log = (optLogDir->isSet() ? optLogDir->stringValue() : ".")
+            + "/soak-node" + std::to_string( n.index ) + ".log";
+        pid_t pid = fork();
+        if ( pid == 0 ) {
+            int nsfd = open( ("/var/run/netns/" + n.ns).c_str(), O_RDONLY );
+            if ( nsfd < 0 || setns( nsfd, CLONE_NEWNET ) != 0 ) {
+                std::cerr << "FATAL: cannot enter namespace " << n.ns << std::endl;
+                _exit( 1 );
+            }
+            int out = open( log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+            dup2( out, 1 );
+            dup2( out, 2 );
+            setenv( "ELEVATOR_SIMULATOR", std::to_string( simulatorPort ).c_str(), 1 );
+            // long options of wibble parser take values only after '='
+            std::string id = "--id=" + std::to_string( n.index + 1 ),
+                        count = "--nodes=" + std::to_string( nodes.size() ),
+                        port = "--status-port=" + std::to_string( statusPort ),
+                        host = "--status-host=" + n.address;
+            execl( binary.c_str(), binary.c_str(), "--avoid-recovery", "--quiet",
+                    id.c_str(), count.c_str(), port.c_str(), host.c_str(),
+                    static_cast< char * >( nullptr ) );
+            std::cerr << "FATAL: cannot execute " << binary << std::endl;
+            _exit( 1 );
+        }
+        n.pid = pid;
+        n.alive = pid > 0;
+    }
+
+    void teardown() {
+        for ( auto &n : nodes )
+            if ( n.pid > 0 )
+                kill( n.pid, SIGTERM );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
+        for ( auto &n : nodes )
+            if ( n.pid > 0 ) {
+                kill( n.pid, SIGKILL );
+                waitpid( n.pid, nullptr, 0 );
+            }
+        for ( auto &n : nodes )
+            shell( "ip netns del " + n.ns );
+        shell( std::string( "ip link del " ) + bridge );
+    }
+
+    void press( const Node &n ) {
+        std::uniform_int_distribution< int > button( 0, sizeof( buttons ) / sizeof( buttons[ 0 ] ) - 1 );
+        uint32_t channel = htonl( buttons[ button( random ) ] );
+        sockaddr_in addr;
+        std::memset( &addr, 0, sizeof( addr ) );
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons( simulatorPort );
+        inet_pton( AF_INET, n.address.c_str(), &addr.sin_addr );
+        sendto( udp, &channel, sizeof( channel ), 0,
+                reinterpret_cast< sockaddr * >( &addr ), sizeof( addr ) );
+    }
+
+    bool checkAlive() {
+        bool all = true;
+        for ( auto &n : nodes ) {
+            if ( n.alive && waitpid( n.pid, nullptr, WNOHANG ) == n.pid )
+                n.alive = false;
+            all = all && n.alive;
+        }
+        return all;
+    }
+
+    bool waitForStart() {
+        MillisecondTime deadline = now() + 30000;
+        for ( auto &n : nodes ) {
+            while ( !n.sampleMetrics() ) {
+                if ( !checkAlive() || now() > deadline || interrupted )
+                    return false;
+                std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+            }
+        }
+        return true;
+    }
+
+    /* one step of ramp, returns reason of breakdown or empty string */
+    std::string step( int stepNo, int rate ) {
+        for ( auto &n : nodes ) {
+            n.maxQueue = 0;
+            n.minSlack = INT_MAX;
+            n.udpErrors = n.readUdpErrors();
+            n.cpu = n.readCpu();
+        }
+        std::uniform_int_distribution< int > node( 0, nodes.size() - 1 );
+        MillisecondTime start = now(), end = start + intOpt( optStep, 5 ) * 1000,
+                        lastSample = start;
+        int64_t sent = 0;
+        for ( MillisecondTime t = start; t < end && !interrupted; t = now() ) {
+            for ( int64_t due = (t - start) * rate / 1000; sent < due; ++sent )
+                press( nodes[ node( random ) ] );
+            if ( t - lastSample >= 250 ) {
+                for ( auto &n : nodes )
+                    if ( n.alive )
+                        n.sampleMetrics();
+                lastSample = t;
+            }
+            if ( !checkAlive() )
+                break;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+        double seconds = (now() - start) / 1000.0;
+        long ticks = sysconf( _SC_CLK_TCK );
+
+        std::string breakdown;
+        for ( auto &n : nodes ) {
+            int64_t udpErrors = n.alive ? n.readUdpErrors() - n.udpErrors : 0;
+            // per thread CPU usage in percents of one CPU
+            std::vector< std::pair< double, std::string > > threads;
+            double total = 0;
+            if ( n.alive )
+                for ( auto &t : n.readCpu() ) {
+                    double pct = 100.0 * (t.second.second - n.cpu[ t.first ].second)
+                        / ticks / seconds;
+                    total += pct;
+                    threads.emplace_back( pct, t.second.first );
+                }
+            std::sort( threads.rbegin(), threads.rend() );
+            std::stringstream profile;
+            for ( size_t i = 0; i < threads.size() && i < 4; ++i )
+                profile << (i ? ";" : "") << threads[ i ].second << ":" << threads[ i ].first;
+
+            std::cout << stepNo << "," << rate << "," << n.index + 1 << "," << n.alive
+                      << "," << total << "," << n.maxQueue << ","
+                      << (n.minSlack == INT_MAX ? -1 : n.minSlack) << "," << n.requests
+                      << "," << udpErrors << "," << profile.str() << std::endl;
+
+            std::string node = "node " + std::to_string( n.index + 1 );
+            if ( !breakdown.empty() )
+                continue;
+            if ( !n.alive )
+                breakdown = node + " died (see its log)";
+            else if ( n.maxQueue > intOpt( optMaxQueue, 100 ) )
+                breakdown = node + " queue depth " + std::to_string( n.maxQueue );
+            else if ( n.minSlack < intOpt( optMinSlack, 10 ) )
+                breakdown = node + " heartbeat slack " + std::to_string( n.minSlack ) + " ms";
+            else if ( udpErrors > 0 )
+                breakdown = node + " lost " + std::to_string( udpErrors ) + " datagrams";
+        }
+        return breakdown;
+    }
+
+    int main() {
+        if ( geteuid() != 0 ) {
+            std::cerr << "FATAL: soak needs root to create network namespaces" << std::endl;
+            return 1;
+        }
+        if ( access( binary.c_str(), X_OK ) != 0 ) {
+            std::cerr << "FATAL: " << binary << " is not executable" << std::endl;
+            return 1;
+        }
+        int count = intOpt( optNodes, 3 );
+        for ( int i = 0; i < count; ++i ) {
+            Node n;
+            n.index = i;
+            n.ns = "elvsoak" + std::to_string( i );
+            n.address = "10.77.0." + std::to_string( i + 1 );
+            nodes.push_back( n );
+        }
+        signal( SIGINT, interruptHandler );
+        signal( SIGTERM, interruptHandler );
+        udp = socket( AF_INET, SOCK_DGRAM, 0 );
+
+        setupNetwork();
+        for ( auto &n : nodes )
+            launch( n );
+        std::cerr << "Waiting for " << count << " nodes... " << std::flush;
+        if ( !waitForStart() ) {
+            std::cerr << "FAILED" << std::endl;
+            teardown();
+            return 1;
+        }
+        std::cerr << "OK" << std::endl;
+
+        std::cout << "step,rate,node,alive,cpu_percent,max_queue,min_slack_ms,requests,"
+                     "udp_drops,threads" << std::endl;
+        int lastGood = 0;
+        std::string breakdown;
+        int stepNo = 0;
+        for ( int rate = std::max( 1, intOpt( optStartRate, 1 ) );
+                rate <= intOpt( optMaxRate, 1024 ) && !interrupted; rate *= 2 )
+        {
+            std::cerr << "step " << stepNo << ": " << rate << " presses/s" << std::endl;
+            breakdown = step( stepNo++, rate );
+            if ( !breakdown.empty() ) {
+                std::cerr << "Breakdown at " << rate << " presses/s: " << breakdown << std::endl;
+                break;
+            }
+            lastGood = rate;
+        }
+        if ( breakdown.empty() )
+            std::cerr << "No breakdown up to " << lastGood << " presses/s" << std::endl;
+        else
+            std::cerr << "Last good rate: " << lastGood << " presses/s" << std::endl;
+
+        teardown();
+        return 0;
+    }
+};
+
+}
+
+int main( int argc, const char **argv ) {
+    return elevator::Soak( argc, argv ).main();
+}
@@ -6,6 +6,7 @@
 #include <wibble/log/null.h>
 #include <wibble/log/file.h>
 #include <wibble/log/ostream.h>
+#include <wibble/sys/fs.h>
 #include <vector>
 #include <iostream>
 #include <fstream>
@@ -31,9 +32,9 @@ struct TestLog {
         virtual ~Sender1() {}
         
         // Interface for the streambuf to send messages
-        virtual void send(Level level, const std::string& msg)
+        virtual void send(Level level, StringView msg)
         {
-            log.push_back(make_pair(level, msg));
+            log.push_back(make_pair(level, msg.str()));
         }
         
         // Dump all the logged messages to cerr
@@ -77,6 +78,34 @@ struct TestLog {
         //s.dump();
     }
 
+    // Lines longer than the put area and several lines in one write
+    Test streambufLongLines() {
+        Sender1 s;
+        std::string longLine(3000, 'x');
+        {
+            log::Streambuf ls(&s);
+            ostream o(&ls);
+
+            o << longLine << "y" << endl;
+            assert_eq(s.log.size(), 1u);
+            assert_eq(s.log[0].second, longLine + "y");
+
+            o << "a\nb\n" << log::WARN << "c";
+            assert_eq(s.log.size(), 3u);
+            assert_eq(s.log[1].second, "a");
+            assert_eq(s.log[2].second, "b");
+            assert_eq(s.log[2].first, log::INFO);
+
+            o << '\n' << longLine;
+            o.flush();
+            assert_eq(s.log.size(), 4u);
+            assert_eq(s.log[3].first, log::WARN);
+            assert_eq(s.log[3].second, "c");
+        }
+        assert_eq(s.log.size(), 5u);
+        assert_eq(s.log[4].second, longLine);
+    }
+
     // Test the NullSender
     Test nullSender() {
         // Null does nothing, so we cannot test the results.
@@ -121,6 +150,48 @@ struct TestLog {
 #endif
     }
 
+// Test the BufferedFileSender
+    Test bufferedFileSender() {
+#ifdef POSIX
+        std::string name = "wibble-test-log.buffered";
+        unlink(name.c_str());
+        {
+            log::BufferedFileSender sender(name, 1024, 60 * 1000, log::WARN);
+            log::Streambuf file(&sender);
+            ostream o(&file);
+
+            o << "first" << endl;
+            o << "second" << endl;
+            // nothing is written until a threshold is hit
+            assert_eq(sys::fs::readFile(name), "");
+
+            o << log::WARN << "third" << endl;
+            assert_eq(sys::fs::readFile(name), "first\nsecond\nthird\n");
+
+            o << "fourth" << endl;
+        }
+        // pending messages are written on destruction
+        assert_eq(sys::fs::readFile(name), "first\nsecond\nthird\nfourth\n");
+
+        {
+            log::BufferedFileSender sender(name, 10, 60 * 1000, log::CRIT);
+            sender.send(log::INFO, "0123456789");
+            // size threshold, appended to existing content
+            assert_eq(sys::fs::readFile(name), "first\nsecond\nthird\nfourth\n0123456789\n");
+        }
+
+        {
+            log::BufferedFileSender sender(name, 1024, 20, log::CRIT);
+            sender.send(log::INFO, "late");
+            // age threshold is enforced even if nothing else is sent
+            for (int i = 0; i < 100 && sys::fs::readFile(name).find("late") == std::string::npos; ++i)
+                sys::usleep(10 * 1000);
+            assert_eq(sys::fs::readFile(name), "first\nsecond\nthird\nfourth\n0123456789\nlate\n");
+        }
+        unlink(name.c_str());
+#endif
+    }
+
 // Test the OstreamSender
     Test ostreamSender() {
         // We send to /dev/null, so we cannot test the results.
@@ -7,6 +7,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/uio.h>
 
 namespace wibble {
 namespace log {
@@ -23,7 +26,7 @@ FileSender::~FileSender()
 	if (out >= 0) close(out);
 }
 
-void FileSender::send(Level level, const std::string& msg)
+void FileSender::send(Level level, StringView msg)
 {
 #ifdef POSIX // FIXME
 	// Write it all in a single write(2) so multiple processes can log to
@@ -55,7 +58,155 @@ void FileSender::send(Level level, const std::string& msg)
             break;
     }
 }
-	
+
+static int64_t monotonicMs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return int64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+BufferedFileSender::BufferedFileSender(const std::string& filename, size_t maxBytes,
+		int maxDelay, Level flushLevel)
+	: out(-1), name(filename), maxBytes(maxBytes), maxDelay(maxDelay),
+	  flushLevel(flushLevel), pendingCount(0), pendingBytes(0), oldest(0),
+	  stopping(false), flusher(*this)
+{
+	out = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+	if (out < 0)
+		throw wibble::exception::File(filename, "opening logfile for append");
+	flusher.start();
+}
+
+BufferedFileSender::~BufferedFileSender()
+{
+	{
+		sys::MutexLock lock(mutex);
+		stopping = true;
+		changed.broadcast();
+	}
+	flusher.join();
+	if (out >= 0)
+	{
+		try {
+			flush();
+		} catch (wibble::exception::File&) {
+			// nowhere to report it
+		}
+		close(out);
+	}
+}
+
+void* BufferedFileSender::Flusher::main()
+{
+	sys::MutexLock lock(sender.mutex);
+	while (!sender.stopping)
+	{
+		if (sender.pendingCount == 0)
+		{
+			sender.changed.wait(lock);
+			continue;
+		}
+		int64_t left = sender.oldest + sender.maxDelay - monotonicMs();
+		if (left > 0)
+		{
+			// condition waits for realtime clock
+			struct timespec abstime;
+			clock_gettime(CLOCK_REALTIME, &abstime);
+			abstime.tv_sec += left / 1000;
+			abstime.tv_nsec += (left % 1000) * 1000000;
+			if (abstime.tv_nsec >= 1000000000)
+			{
+				abstime.tv_sec += 1;
+				abstime.tv_nsec -= 1000000000;
+			}
+			sender.changed.wait(lock, abstime);
+			continue;
+		}
+		try {
+			sender.flushLocked();
+		} catch (wibble::exception::File&) {
+			// nowhere to report it, next flush will try again
+		}
+	}
+	return 0;
+}
+
+void BufferedFileSender::send(Level level, StringView msg)
+{
+	sys::MutexLock lock(mutex);
+	int64_t now = monotonicMs();
+	if (pendingCount == 0)
+	{
+		oldest = now;
+		changed.signal();
+	}
+	if (pendingCount == pending.size())
+		pending.push_back(std::string());
+	pending[pendingCount++].assign(msg.data(), msg.size());
+	pendingBytes += msg.size() + 1;
+
+	// each message takes two iovecs: text and newline
+	if (level >= flushLevel || pendingBytes >= maxBytes
+			|| now - oldest >= maxDelay || pendingCount * 2 >= IOV_MAX)
+		flushLocked();
+}
+
+void BufferedFileSender::flushIfDue()
+{
+	sys::MutexLock lock(mutex);
+	if (pendingCount > 0 && monotonicMs() - oldest >= maxDelay)
+		flushLocked();
+}
+
+void BufferedFileSender::flush()
+{
+	sys::MutexLock lock(mutex);
+	flushLocked();
+}
+
+void BufferedFileSender::flushLocked()
+{
+	if (pendingCount == 0)
+		return;
+
+	std::vector<struct iovec> iov;
+	iov.reserve(pendingCount * 2);
+	static char newline = '\n';
+	for (std::vector<std::string>::iterator i = pending.begin(); i != pending.begin() + pendingCount; ++i)
+	{
+		struct iovec text = { const_cast<char*>(i->data()), i->size() };
+		struct iovec nl = { &newline, 1 };
+		iov.push_back(text);
+		iov.push_back(nl);
+	}
+
+	// On regular files O_APPEND writev is written in one go, partial writes
+	// are possible only on errors like full disk; finish them anyway
+	size_t first = 0;
+	while (first < iov.size())
+	{
+		ssize_t res = writev(out, &iov[first], iov.size() - first);
+		if (res < 0)
+		{
+			pendingCount = 0;
+			pendingBytes = 0;
+			throw wibble::exception::File(name, "writing to file");
+		}
+		size_t done = res;
+		while (first < iov.size() && done >= iov[first].iov_len)
+			done -= iov[first++].iov_len;
+		if (first < iov.size())
+		{
+			iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + done;
+			iov[first].iov_len -= done;
+		}
+	}
+
+	pendingCount = 0;
+	pendingBytes = 0;
+}
+
 }
 }
 
@@ -2,6 +2,10 @@
 #define WIBBLE_LOG_FILE_H
 
 #include <wibble/log/stream.h>
+#include <wibble/sys/thread.h>
+#include <wibble/sys/mutex.h>
+#include <vector>
+#include <stdint.h>
 
 namespace wibble {
 namespace log {
@@ -17,7 +21,69 @@ public:
 	FileSender(const std::string& filename);
 	virtual ~FileSender();
 
-	virtual void send(Level level, const std::string& msg);
+	virtual void send(Level level, StringView msg);
+};
+
+/**
+ * Append messages to a file, collecting them in memory and writing them out
+ * in batches.
+ *
+ * The file is opened with O_APPEND and every batch is written with a single
+ * writev(2), so batches (and hence records) of multiple processes logging to
+ * the same file do not interleave.
+ *
+ * Pending messages are flushed when their total size reaches maxBytes, when
+ * a message of level flushLevel or higher is sent, when the oldest pending
+ * message is older than maxDelay milliseconds, and on destruction. The age
+ * limit is enforced by a thread of the sender, so that last messages before
+ * a quiet period are not kept in memory (and lost on crash).
+ *
+ * The sender can be used from multiple threads.
+ */
+struct BufferedFileSender : public Sender
+{
+protected:
+	/// Waits for the oldest pending message to become due
+	struct Flusher : public sys::Thread
+	{
+		BufferedFileSender& sender;
+		Flusher(BufferedFileSender& sender) : sender(sender) {}
+		virtual const char* threadTag() { return "log flusher"; }
+		virtual void* main();
+	};
+
+	int out;
+	std::string name;
+	size_t maxBytes;
+	int64_t maxDelay;
+	Level flushLevel;
+
+	/// Only first pendingCount strings are pending, the rest are kept to
+	/// reuse their capacity
+	std::vector<std::string> pending;
+	size_t pendingCount;
+	size_t pendingBytes;
+	int64_t oldest;
+
+	sys::Mutex mutex;
+	/// Signalled when the first message becomes pending and on destruction
+	sys::Condition changed;
+	bool stopping;
+	Flusher flusher;
+
+	void flushLocked();
+
+public:
+	BufferedFileSender(const std::string& filename, size_t maxBytes = 64 * 1024,
+			int maxDelay = 1000, Level flushLevel = WARN);
+	virtual ~BufferedFileSender();
+
+	virtual void send(Level level, StringView msg);
+
+	/// Write out all pending messages
+	void flush();
+	/// Write out pending messages if the oldest one is at least maxDelay old
+	void flushIfDue();
 };
 
 }
@@ -23,7 +23,7 @@ Timestamper::~Timestamper()
 {
 }
 
-void Timestamper::send(Level level, const std::string& msg)
+void Timestamper::send(Level level, StringView msg)
 {
 	if (!next) return;
 
@@ -48,11 +48,11 @@ void Timestamper::send(Level level, const std::string& msg)
 #ifdef POSIX
 	char timebuf[256];
 	strftime(timebuf, 256, fmt.c_str(), &pnow);
-	next->send(level, string(timebuf) + msg);
+	next->send(level, string(timebuf) + msg.str());
 #endif
 
 #ifdef _WIN32
-	next->send(level, string(asctime(pnow)) + " " + msg);
+	next->send(level, string(asctime(pnow)) + " " + msg.str());
 #endif
 }
 
@@ -65,7 +65,7 @@ LevelFilter::~LevelFilter()
 {
 }
 
-void LevelFilter::send(log::Level level, const std::string& msg)
+void LevelFilter::send(log::Level level, StringView msg)
 {
 	if (level < minLevel || !next) return;
 	next->send(level, msg);
@@ -81,7 +81,7 @@ Tee::~Tee()
 {
 }
 
-void Tee::send(log::Level level, const std::string& msg)
+void Tee::send(log::Level level, StringView msg)
 {
 	for (std::vector<Sender*>::iterator i = next.begin(); i != next.end(); ++i)
 		(*i)->send(level, msg);
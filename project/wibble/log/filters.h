@@ -24,7 +24,7 @@ struct Timestamper : public Sender
 	Timestamper(Sender* next = 0, const std::string& fmt = "%b %e %T ");
 	virtual ~Timestamper();
 
-	virtual void send(Level level, const std::string& msg);
+	virtual void send(Level level, StringView msg);
 };
 
 /**
@@ -38,7 +38,7 @@ struct LevelFilter : public log::Sender
 	LevelFilter(Sender* next = 0, log::Level minLevel = log::INFO);
 	virtual ~LevelFilter();
 
-	virtual void send(log::Level level, const std::string& msg);
+	virtual void send(log::Level level, StringView msg);
 };
 
 /**
@@ -53,7 +53,7 @@ struct Tee : public log::Sender
 	Tee(Sender* first, Sender* second);
 	~Tee();
 
-	virtual void send(log::Level level, const std::string& msg);
+	virtual void send(log::Level level, StringView msg);
 };
 
 }
@@ -10,7 +10,7 @@ namespace log {
 struct NullSender : public Sender
 {
 	virtual ~NullSender() {}
-	virtual void send(Level level, const std::string& msg) {}
+	virtual void send(Level level, StringView msg) {}
 };
 
 }
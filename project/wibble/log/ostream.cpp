@@ -5,9 +5,10 @@ namespace log {
 
 OstreamSender::OstreamSender(std::ostream& out) : out(out) {}
 
-void OstreamSender::send(Level level, const std::string& msg)
+void OstreamSender::send(Level level, StringView msg)
 {
-	out << msg << std::endl;
+	out.write(msg.data(), msg.size());
+	out << std::endl;
 	if (level >= WARN)
 		out.flush();
 }
@@ -17,7 +17,7 @@ public:
 	OstreamSender(std::ostream& out);
 	virtual ~OstreamSender() {}
 
-	virtual void send(Level level, const std::string& msg);
+	virtual void send(Level level, StringView msg);
 };
 
 }
@@ -1,12 +1,21 @@
 #include <wibble/log/stream.h>
 #include <ostream>
+#include <algorithm>
 
 namespace wibble {
 namespace log {
 
-Streambuf::Streambuf() : level(defaultLevel), sender(0) {}
+const size_t Streambuf::bufferSize;
 
-Streambuf::Streambuf(Sender* s) : level(defaultLevel), sender(s) {}
+Streambuf::Streambuf() : level(defaultLevel), sender(0)
+{
+	setp(buffer, buffer + bufferSize);
+}
+
+Streambuf::Streambuf(Sender* s) : level(defaultLevel), sender(s)
+{
+	setp(buffer, buffer + bufferSize);
+}
 
 Streambuf::~Streambuf()
 {
@@ -15,33 +24,101 @@ Streambuf::~Streambuf()
 
 void Streambuf::send_partial_line()
 {
-	if (!line.empty())
-		send();
+	sendLines();
+	if (pptr() == pbase() && line.empty())
+		return;
+	line.append(pbase(), pptr() - pbase());
+	send(line);
+	line.clear();
+	setp(buffer, buffer + bufferSize);
 }
 
 void Streambuf::setSender(Sender* s) { sender = s; }
 
-void Streambuf::send()
+void Streambuf::send(StringView msg)
 {
 	// Send the message
-	sender->send(level, line);
+	sender->send(level, msg);
 	// Reset the level
 	level = defaultLevel;
-	line.clear();
+}
+
+void Streambuf::sendLines()
+{
+	char* begin = pbase();
+	char* end = pptr();
+	char* nl;
+	while ((nl = static_cast<char*>(memchr(begin, '\n', end - begin))) != 0)
+	{
+		if (line.empty())
+			// Common case: the line is sent straight from the put area
+			send(StringView(begin, nl - begin));
+		else {
+			line.append(begin, nl - begin);
+			send(line);
+			line.clear();
+		}
+		begin = nl + 1;
+	}
+
+	// Move the incomplete line to the beginning of the put area
+	size_t rest = end - begin;
+	if (begin != buffer)
+		memmove(buffer, begin, rest);
+	setp(buffer, buffer + bufferSize);
+	pbump(rest);
 }
 
 void Streambuf::setLevel(const Level& level)
 {
+	// Lines completed so far keep the level they were written with
+	sendLines();
 	this->level = level;
 }
 
 int Streambuf::overflow(int c)
 {
+	if (c == traits_type::eof())
+		return traits_type::not_eof(c);
+
+	sendLines();
+	if (pptr() == epptr())
+	{
+		// No newline in the whole put area
+		line.append(pbase(), pptr() - pbase());
+		setp(buffer, buffer + bufferSize);
+	}
+	*pptr() = c;
+	pbump(1);
 	if (c == '\n')
-		send();
-	else
-		line += c;
-	return c;	// or EOF
+		sendLines();
+	return c;
+}
+
+std::streamsize Streambuf::xsputn(const char* s, std::streamsize n)
+{
+	std::streamsize done = 0;
+	while (done < n)
+	{
+		std::streamsize chunk = std::min<std::streamsize>(n - done, epptr() - pptr());
+		if (chunk == 0)
+		{
+			overflow(traits_type::to_int_type(s[done++]));
+			continue;
+		}
+		memcpy(pptr(), s + done, chunk);
+		pbump(chunk);
+		if (memchr(s + done, '\n', chunk))
+			sendLines();
+		done += chunk;
+	}
+	return n;
+}
+
+int Streambuf::sync()
+{
+	sendLines();
+	return 0;
 }
 
 std::ostream& operator<<(std::ostream& s, Level lev)
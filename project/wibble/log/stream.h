@@ -3,6 +3,7 @@
 
 #include <streambuf>
 #include <string>
+#include <cstring>
 
 namespace wibble {
 namespace log {
@@ -18,6 +19,28 @@ enum Level
 	CRIT
 };
 
+/**
+ * Non-owning reference to the text of a log message.
+ *
+ * It is only valid during the Sender::send call it is passed to, senders
+ * which need to keep the message have to copy it.
+ */
+class StringView
+{
+	const char* m_data;
+	size_t m_size;
+
+public:
+	StringView(const char* data, size_t size) : m_data(data), m_size(size) {}
+	StringView(const char* str) : m_data(str), m_size(strlen(str)) {}
+	StringView(const std::string& str) : m_data(str.data()), m_size(str.size()) {}
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	std::string str() const { return std::string(m_data, m_size); }
+};
+
 /// Handle sending a log message
 struct Sender
 {
@@ -27,7 +50,7 @@ struct Sender
 	 *
 	 * Do not add a trailing newline
 	 */
-	virtual void send(Level level, const std::string& msg) = 0;
+	virtual void send(Level level, StringView msg) = 0;
 };
 
 /// Streambuf class for logging
@@ -36,7 +59,12 @@ class Streambuf : public std::streambuf
 protected:
 	/// Level to use for messages whose level has not been specified
 	static const Level defaultLevel = INFO;
-	/// Line buffer with the log message we are building
+	/// Size of the put area, longer lines spill to "line"
+	static const size_t bufferSize = 512;
+	/// Put area with the log message we are building
+	char buffer[bufferSize];
+	/// Beginning of a line which did not fit into the put area, it keeps its
+	/// capacity so that long lines do not reallocate every time
 	std::string line;
 	/// Level of the next log message
 	Level level;
@@ -47,8 +75,10 @@ protected:
 	 * overridden methods */
 	Sender* sender;
 
-	/// Send the message "line" with the level "level"
-	void send();
+	/// Send the message with the level "level"
+	void send(StringView msg);
+	/// Send all complete lines in the put area
+	void sendLines();
 
 public:
 	/// Construct a nonworking Streambuf to be initialised later.
@@ -73,6 +103,8 @@ public:
 
 	/// override to get data as a std::streambuf
 	int overflow(int c);
+	std::streamsize xsputn(const char* s, std::streamsize n);
+	int sync();
 };
 
 std::ostream& operator<<(std::ostream& s, Level lev);
@@ -14,7 +14,7 @@ SyslogSender::~SyslogSender()
 	closelog();
 }
 
-void SyslogSender::send(Level level, const std::string& msg)
+void SyslogSender::send(Level level, StringView msg)
 {
 	int prio = LOG_INFO;
 	switch (level)
@@ -27,7 +27,7 @@ void SyslogSender::send(Level level, const std::string& msg)
 		case CRIT: prio = LOG_CRIT; break;
 		//LOG_ALERT, LOG_EMERG
 	}
-	syslog(prio, "%s", msg.c_str());
+	syslog(prio, "%.*s", int(msg.size()), msg.data());
 }
 
 }
@@ -21,7 +21,7 @@ public:
 	SyslogSender(const std::string& ident, int option = LOG_PID, int facility = LOG_USER);
 	virtual ~SyslogSender();
 
-	virtual void send(Level level, const std::string& msg);
+	virtual void send(Level level, StringView msg);
 };
 
 }
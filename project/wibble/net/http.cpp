@@ -179,7 +179,7 @@ bool Request::read_buf(std::string& res, size_t size)
 }
 
 
-// Read HTTP method and its following empty line
+// Read HTTP request line
 bool Request::read_method()
 {
     // Request line, such as GET /images/logo.png HTTP/1.1, which
@@ -204,8 +204,8 @@ bool Request::read_method()
         }
     }
 
-    // An empty line
-    return mime_reader.read_line(sock, cmdline);
+    // Headers follow immediately, the empty line terminates them
+    return true;
 }
 
 /**
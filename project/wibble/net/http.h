@@ -119,7 +119,7 @@ struct Request
      */
     bool read_buf(std::string& res, size_t size);
 
-    // Read HTTP method and its following empty line
+    // Read HTTP request line
     bool read_method();
 
     /**
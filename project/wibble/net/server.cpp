@@ -195,32 +195,24 @@ int TCPServer::accept_loop()
             }
         }
 
-        // Resolve the peer
-        char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
+        // Resolve the peer, numeric address is used as hostname if name
+        // cannot be resolved (such as when there is no DNS available)
+        char hbuf[NI_MAXHOST], nbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
         int gaires = getnameinfo(reinterpret_cast<struct sockaddr *>(&peer_addr),
                 peer_addr_len,
-                hbuf, NI_MAXHOST,
+                nbuf, NI_MAXHOST,
                 sbuf, NI_MAXSERV,
-                NI_NUMERICSERV);
-        if (gaires == 0)
-        {
-            string hostname = hbuf;
-            gaires = getnameinfo(reinterpret_cast<struct sockaddr *>(&peer_addr),
-                    peer_addr_len,
-                    hbuf, NI_MAXHOST,
-                    sbuf, NI_MAXSERV,
-                    NI_NUMERICHOST | NI_NUMERICSERV);
-            if (gaires == 0)
-                handle_client(fd, hostname, hbuf, sbuf);
-            else
-                throw wibble::exception::Consistency(
-                        "resolving peer name numerically",
-                        gai_strerror(gaires));
-        }
-        else
+                NI_NUMERICHOST | NI_NUMERICSERV);
+        if (gaires != 0)
             throw wibble::exception::Consistency(
-                    "resolving peer name",
+                    "resolving peer name numerically",
                     gai_strerror(gaires));
+        gaires = getnameinfo(reinterpret_cast<struct sockaddr *>(&peer_addr),
+                peer_addr_len,
+                hbuf, NI_MAXHOST,
+                NULL, 0,
+                0);
+        handle_client(fd, gaires == 0 ? hbuf : nbuf, nbuf, sbuf);
     }
 }
 
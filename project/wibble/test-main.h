@@ -6,15 +6,51 @@
 #ifdef POSIX
 #include <sys/wait.h>
 #include <sys/socket.h>
+#include <signal.h>
 #endif
 
 #include <cstring>
 #include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <map>
+#include <fstream>
+#include <algorithm>
 
 #include <wibble/sys/pipe.h>
 
+/* Environment of test runner:
+ *   WIBBLE_TEST_JOBS     number of tests run in parallel (when running all
+ *                        suites), 0 = twice the number of CPUs, default 1
+ *   WIBBLE_TEST_SHARD    i/n: run only every n-th test starting with i-th
+ *                        (counted from 0 over all suites), implies parallel mode
+ *   WIBBLE_TEST_TIMEOUT  seconds after which test is killed, default 300, 0 = never
+ *   WIBBLE_TEST_JUNIT    file to write JUnit-style XML report with timing to
+ *
+ * In parallel mode suites run in parallel, tests of single suite one after
+ * another (they can share fixtures such as files). Every test runs in its own
+ * process with output captured (and printed only if it fails), results are
+ * reported per suite once all its tests are finished. Every worker slot gets distinct WIBBLE_TEST_PORT_OFFSET
+ * (multiple of portStride) so that network tests can avoid collisions by
+ * adding it to their fixed ports.
+ */
 struct Main : RunFeedback {
 
+    static const int portStride = 16;
+    static const int maxJobs = 64;
+
+    struct Result {
+        int suite, test;
+        std::string suiteName, testName;
+        bool ok;
+        double time; // seconds
+        std::string failure, output;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
     int suite, test;
     wibble::sys::Pipe p_status;
     wibble::sys::Pipe p_confirm;
@@ -34,6 +70,13 @@ struct Main : RunFeedback {
     std::string current;
     bool want_fork;
 
+    int jobs, timeout;
+    int shard, shards;
+    std::string junit;
+    std::vector< Result > results;
+    std::string current_suite, current_test;
+    Clock::time_point started;
+
     RunAll all;
 
     Main() : suite(0), test(0) {
@@ -41,14 +84,330 @@ struct Main : RunFeedback {
         total_ok = total_failed = 0;
         test_ok = 0;
         announced_suite = -1;
+        jobs = 1;
+        timeout = 300;
+        shard = 0;
+        shards = 1;
+    }
+
+    static double since( Clock::time_point t ) {
+        return std::chrono::duration< double >( Clock::now() - t ).count();
+    }
+
+    void configure() {
+        const char *v;
+        if ( (v = getenv( "WIBBLE_TEST_JOBS" )) && *v ) {
+            jobs = atoi( v );
+            if ( jobs <= 0 ) {
+#ifdef POSIX
+                jobs = 2 * sysconf( _SC_NPROCESSORS_ONLN );
+#else
+                jobs = 2;
+#endif
+            }
+            jobs = std::min( std::max( jobs, 1 ), int( maxJobs ) );
+        }
+        if ( (v = getenv( "WIBBLE_TEST_SHARD" )) && *v ) {
+            if ( sscanf( v, "%d/%d", &shard, &shards ) != 2
+                    || shards < 1 || shard < 0 || shard >= shards ) {
+                std::cerr << "Invalid WIBBLE_TEST_SHARD " << v
+                          << ", expected i/n with 0 <= i < n" << std::endl;
+                exit( 3 );
+            }
+        }
+        if ( (v = getenv( "WIBBLE_TEST_TIMEOUT" )) && *v )
+            timeout = std::max( atoi( v ), 0 );
+        if ( (v = getenv( "WIBBLE_TEST_JUNIT" )) )
+            junit = v;
+    }
+
+    static std::string xmlEscape( const std::string &s ) {
+        std::string out;
+        for ( size_t i = 0; i < s.size(); ++i ) {
+            unsigned char c = s[ i ];
+            switch ( c ) {
+                case '&': out += "&amp;"; break;
+                case '<': out += "&lt;"; break;
+                case '>': out += "&gt;"; break;
+                case '"': out += "&quot;"; break;
+                case '\n': case '\t': out += c; break;
+                default:
+                    // other control characters are not allowed in XML 1.0
+                    out += c < 0x20 ? '?' : char( c );
+            }
+        }
+        return out;
+    }
+
+    void writeJUnit() {
+        if ( junit.empty() )
+            return;
+        std::ofstream xml( junit.c_str() );
+        int failures = 0;
+        double time = 0;
+        for ( size_t i = 0; i < results.size(); ++i ) {
+            failures += !results[ i ].ok;
+            time += results[ i ].time;
+        }
+        xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl
+            << "<testsuites tests=\"" << results.size() << "\" failures=\""
+            << failures << "\" time=\"" << time << "\">" << std::endl;
+        // results are sorted by suite, so every suite is one run of them
+        for ( size_t from = 0, to; from < results.size(); from = to ) {
+            int sfail = 0;
+            double stime = 0;
+            for ( to = from; to < results.size() && results[ to ].suite == results[ from ].suite; ++to ) {
+                sfail += !results[ to ].ok;
+                stime += results[ to ].time;
+            }
+            xml << "  <testsuite name=\"" << xmlEscape( results[ from ].suiteName )
+                << "\" tests=\"" << to - from << "\" failures=\"" << sfail
+                << "\" time=\"" << stime << "\">" << std::endl;
+            for ( size_t i = from; i < to; ++i ) {
+                const Result &r = results[ i ];
+                xml << "    <testcase classname=\"" << xmlEscape( r.suiteName )
+                    << "\" name=\"" << xmlEscape( r.testName )
+                    << "\" time=\"" << r.time << "\"";
+                if ( r.ok && r.output.empty() ) {
+                    xml << "/>" << std::endl;
+                    continue;
+                }
+                xml << ">" << std::endl;
+                if ( !r.ok )
+                    xml << "      <failure message=\"" << xmlEscape( r.failure ) << "\"/>" << std::endl;
+                if ( !r.output.empty() )
+                    xml << "      <system-out>" << xmlEscape( r.output ) << "</system-out>" << std::endl;
+                xml << "    </testcase>" << std::endl;
+            }
+            xml << "  </testsuite>" << std::endl;
+        }
+        xml << "</testsuites>" << std::endl;
+        if ( !xml )
+            std::cerr << "Could not write " << junit << std::endl;
+    }
+
+    void record( bool ok, std::string failure ) {
+        Result r;
+        r.suite = suite;
+        r.test = test;
+        r.suiteName = current_suite;
+        r.testName = current_test;
+        r.ok = ok;
+        r.time = since( started );
+        r.failure = failure;
+        results.push_back( r );
+    }
+
+#ifdef POSIX
+    static std::string describeFailure( int status_code, int timeout ) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+        if ( WIFEXITED( status_code ) )
+            return wibble::str::fmtf( "exit status %d", WEXITSTATUS( status_code ) );
+        if ( WIFSIGNALED( status_code ) && WTERMSIG( status_code ) == SIGALRM )
+            return wibble::str::fmtf( "timed out after %d s", timeout );
+        if ( WIFSIGNALED( status_code ) )
+            return wibble::str::fmtf( "caught signal %d", WTERMSIG( status_code ) );
+        return "unknown failure";
+#pragma GCC diagnostic pop
+    }
+
+    struct Job {
+        int suite, test, slot;
+        pid_t pid;
+        FILE *output;
+        Clock::time_point started;
+        bool killed;
+    };
+
+    std::string jobName( const Job &job ) {
+        return xmlEscape( all.suites[ job.suite ].name ) + "::"
+            + xmlEscape( all.suites[ job.suite ].tests[ job.test ].name );
     }
 
+    void startJob( Job &job ) {
+        job.output = tmpfile();
+        if ( !job.output ) {
+            perror( "tmpfile failed" );
+            exit( 5 );
+        }
+        job.started = Clock::now();
+        job.killed = false;
+        std::cout << std::flush;
+        std::cerr << std::flush;
+        fflush( stdout );
+        fflush( stderr );
+        job.pid = fork();
+        if ( job.pid < 0 ) {
+            perror( "fork failed" );
+            exit( 2 );
+        }
+        if ( job.pid == 0 ) {
+            int fd = fileno( job.output );
+            dup2( fd, 1 );
+            dup2( fd, 2 );
+            setenv( "WIBBLE_TEST_PORT_OFFSET",
+                    wibble::str::fmt( job.slot * portStride ).c_str(), 1 );
+            all.suites[ job.suite ].tests[ job.test ].run();
+            exit( 0 );
+        }
+    }
+
+    void finishJob( Job &job, int status_code ) {
+        Result r;
+        r.suite = job.suite;
+        r.test = job.test;
+        r.suiteName = all.suites[ job.suite ].name;
+        r.testName = all.suites[ job.suite ].tests[ job.test ].name;
+        r.time = since( job.started );
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+        r.ok = WIFEXITED( status_code ) && WEXITSTATUS( status_code ) == 0;
+#pragma GCC diagnostic pop
+        if ( !r.ok )
+            r.failure = job.killed
+                ? wibble::str::fmtf( "timed out after %d s", timeout )
+                : describeFailure( status_code, timeout );
+
+        char buf[ 4096 ];
+        size_t n;
+        rewind( job.output );
+        while ( (n = fread( buf, 1, sizeof( buf ), job.output )) > 0 )
+            r.output.append( buf, n );
+        fclose( job.output );
+        results.push_back( r );
+    }
+
+    void reportSuite( int s ) {
+        int ok = 0, failed = 0;
+        std::string failures, dots;
+        for ( size_t i = 0; i < results.size(); ++i ) {
+            const Result &r = results[ i ];
+            if ( r.suite != s )
+                continue;
+            if ( r.ok ) {
+                ++ok;
+                dots += ".";
+                continue;
+            }
+            ++failed;
+            failures += "--> FAILED: " + r.testName + " (" + r.failure + ")\n" + r.output;
+        }
+        std::cout << failures << "(" << s + 1 << "/" << all.suiteCount << ") "
+                  << all.suites[ s ].name << ": " << dots << " " << ok << "/"
+                  << ok + failed << " ok" << std::endl;
+        total_ok += ok;
+        total_failed += failed;
+    }
+
+    /* test durations from previous JUnit report (if any), used to start
+     * longest tests first so that they do not finish last */
+    std::map< std::string, double > previousTimes() {
+        std::map< std::string, double > times;
+        std::ifstream xml( junit.c_str() );
+        std::string line;
+        while ( !junit.empty() && std::getline( xml, line ) ) {
+            std::string::size_type c = line.find( "classname=\"" ), n = line.find( "\" name=\"" ),
+                t = line.find( "\" time=\"" );
+            if ( c == std::string::npos || n == std::string::npos || t == std::string::npos )
+                continue;
+            c += 11;
+            std::string name = line.substr( c, n - c ) + "::" + line.substr( n + 8, t - n - 8 );
+            times[ name ] = atof( line.c_str() + t + 8 );
+        }
+        return times;
+    }
+
+    static bool resultLess( const Result &a, const Result &b ) {
+        return a.suite < b.suite || ( a.suite == b.suite && a.test < b.test );
+    }
+
+    /* runs all (selected) tests, at most jobs of them at once and at most
+     * one of every suite, every one in its own process */
+    int parallel() {
+        std::deque< Job > pending;
+        std::vector< int > left( all.suiteCount, 0 );
+        for ( int s = 0, i = 0; s < all.suiteCount; ++s )
+            for ( int t = 0; t < all.suites[ s ].testCount; ++t, ++i )
+                if ( i % shards == shard ) {
+                    Job job;
+                    job.suite = s;
+                    job.test = t;
+                    pending.push_back( job );
+                    ++left[ s ];
+                }
+
+        std::map< std::string, double > times = previousTimes();
+        std::stable_sort( pending.begin(), pending.end(), [&]( const Job &a, const Job &b ) {
+                return times[ jobName( a ) ] > times[ jobName( b ) ];
+            } );
+
+        std::vector< Job > running;
+        std::vector< bool > busy( jobs, false );
+        std::vector< bool > suiteBusy( all.suiteCount, false );
+        while ( !pending.empty() || !running.empty() ) {
+            while ( int( running.size() ) < jobs ) {
+                auto next = std::find_if( pending.begin(), pending.end(), [&]( const Job &j ) {
+                        return !suiteBusy[ j.suite ];
+                    } );
+                if ( next == pending.end() )
+                    break;
+                Job job = *next;
+                pending.erase( next );
+                suiteBusy[ job.suite ] = true;
+                job.slot = std::find( busy.begin(), busy.end(), false ) - busy.begin();
+                busy[ job.slot ] = true;
+                startJob( job );
+                running.push_back( job );
+            }
+
+            int status_code;
+            pid_t pid = waitpid( -1, &status_code, WNOHANG );
+            if ( pid < 0 ) {
+                perror( "waitpid failed" );
+                exit( 5 );
+            }
+            if ( pid == 0 ) {
+                for ( size_t i = 0; i < running.size(); ++i )
+                    if ( timeout && !running[ i ].killed && since( running[ i ].started ) > timeout ) {
+                        kill( running[ i ].pid, SIGKILL );
+                        running[ i ].killed = true;
+                    }
+                usleep( 5000 );
+                continue;
+            }
+            for ( size_t i = 0; i < running.size(); ++i )
+                if ( running[ i ].pid == pid ) {
+                    finishJob( running[ i ], status_code );
+                    busy[ running[ i ].slot ] = false;
+                    suiteBusy[ running[ i ].suite ] = false;
+                    if ( --left[ running[ i ].suite ] == 0 )
+                        reportSuite( running[ i ].suite );
+                    running.erase( running.begin() + i );
+                    break;
+                }
+        }
+
+        std::sort( results.begin(), results.end(), resultLess );
+        writeJUnit();
+        std::cout << "overall " << total_ok << "/"
+                  << total_ok + total_failed
+                  << " ok" << std::endl;
+        return total_failed == 0 ? 0 : 1;
+    }
+#endif
+
     void child() {
 #ifdef POSIX
         close( status_fds[0] );
         close( confirm_fds[1] );
 #endif
         p_confirm = wibble::sys::Pipe( confirm_fds[0] );
+#ifdef POSIX
+        // every forked child runs single test
+        if ( want_fork && timeout )
+            alarm( timeout );
+#endif
         if ( argc > 1 ) {
             RunSuite *s = all.findSuite( argv[1] );
             if (!s) {
@@ -94,12 +453,9 @@ struct Main : RunFeedback {
             if ( WEXITSTATUS( status_code ) == 0 )
                 return;
         }
-        std::cout << "--> FAILED: "<< current;
-        if ( WIFEXITED( status_code ) )
-            std::cout << " (exit status " << WEXITSTATUS( status_code ) << ")";
-        if ( WIFSIGNALED( status_code ) )
-            std::cout << " (caught signal " << WTERMSIG( status_code ) << ")";
-        std::cout << std::endl;
+        std::string failure = describeFailure( status_code, timeout );
+        std::cout << "--> FAILED: "<< current << " (" << failure << ")" << std::endl;
+        record( false, failure );
         // re-announce the suite
         announced_suite --;
         ++ test; // continue with next test
@@ -123,6 +479,7 @@ struct Main : RunFeedback {
             }
 #pragma GCC diagnostic pop
 #endif
+            writeJUnit();
             std::cout << "overall " << total_ok << "/"
                       << total_ok + total_failed
                       << " ok" << std::endl;
@@ -149,6 +506,8 @@ struct Main : RunFeedback {
                 suite_ok = suite_failed = 0;
             }
             if ( line[2] == 's' ) {
+                // "(i/n) name"
+                current_suite = std::string( line.begin() + line.find( ") " ) + 2, line.end() );
                 if ( announced_suite < suite ) {
                     std::cout << std::string( line.begin() + 5, line.end() )
                               << ": " << std::flush;
@@ -160,10 +519,13 @@ struct Main : RunFeedback {
             if ( line[2] == 'd' ) {
                 confirm();
                 test_ok = 1;
+                record( true, "" );
             }
             if ( line[2] == 's' ) {
                 confirm();
                 current = std::string( line.begin() + 5, line.end() );
+                current_test = std::string( line.begin() + line.find( ") " ) + 2, line.end() );
+                started = Clock::now();
             }
         }
     }
@@ -225,8 +587,11 @@ struct Main : RunFeedback {
         all.suiteCount = sizeof(suites)/sizeof(RunSuite);
         all.suites = suites;
         all.feedback = this;
+        configure();
 #ifdef POSIX
         want_fork = argc <= 2;
+        if ( argc == 1 && ( jobs > 1 || shards > 1 ) )
+            return parallel();
 #else
 	want_fork = false;
 #endif
@@ -44,10 +44,15 @@ macro( wibble_add_test name )
   add_executable( ${name} ${SOURCES} ${main} )
 endmacro( wibble_add_test )
 
+# tests run in parallel (0 = twice the number of CPUs, 1 = serially), every
+# test target writes JUnit-style report <tgt>.junit.xml into its binary dir
+set( WIBBLE_TEST_JOBS 0 CACHE STRING "number of tests run in parallel by unit targets" )
+set( WIBBLE_TEST_TIMEOUT 300 CACHE STRING "timeout of single test in seconds" )
+
 # TODO the LD_LIBRARY_PATH may need to be set more elaborately
 macro( wibble_check_target tgt )
   add_custom_target( unit_${tgt}
-    COMMAND sh -c "LD_LIBRARY_PATH=${CMAKE_CURRENT_BINARY_DIR} ${WIBBLE_WRAP_TESTS} ${CMAKE_CURRENT_BINARY_DIR}/${tgt}"
+    COMMAND sh -c "LD_LIBRARY_PATH=${CMAKE_CURRENT_BINARY_DIR} WIBBLE_TEST_JOBS=${WIBBLE_TEST_JOBS} WIBBLE_TEST_TIMEOUT=${WIBBLE_TEST_TIMEOUT} WIBBLE_TEST_JUNIT=${CMAKE_CURRENT_BINARY_DIR}/${tgt}.junit.xml ${WIBBLE_WRAP_TESTS} ${CMAKE_CURRENT_BINARY_DIR}/${tgt}"
     VERBATIM
     DEPENDS ${ARGV} )
   add_dependencies( unit unit_${tgt} )